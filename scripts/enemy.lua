@@ -15,6 +15,9 @@ function Navigation.new(enemy, paths)
     self.paths = paths
     self.current = 1
     self.max = #self.paths
+    -- Reused every update, so following the path allocates nothing
+    self.from = Vector.new(0, 0)
+    self.to = Vector.new(0, 0)
     return self
 end
 
@@ -25,8 +28,8 @@ function Navigation:next()
 end
 
 function Navigation:update()
-    local a = self.enemy.transform:position()
-    local b = self:path_position()
+    local a = self.from:set(self.enemy.transform:xy())
+    local b = self.to:set(self:path_xy())
     local d = Vector.distance(b, a)
     if math.type(d) == "float" and d <= 100.0 then
         self:next()
@@ -35,33 +38,38 @@ function Navigation:update()
     end
 end
 
-function Navigation:path_position()
+function Navigation:path_xy()
     if self.current > 0 and self.current <= self.max then
         local rect = self.paths[self.current]
-        return rect:position()
+        return rect:xy()
     end
-    return Vector.new(0, 0)
+    return 0, 0
 end
 
 Enemy = {}
 Enemy.__index = Enemy
 
-function Enemy.new(sprite, size, paths, sfx, animator)
+function Enemy.new(sprite, size, paths, sfx, explosions, world)
     local self = setmetatable({}, Enemy)
     self.sprite = sprite
     self.transform = Rect.new(0, 0, size, size)
-    self.transform:position(paths[1]:position())
+    self.transform:set_position(paths[1]:xy())
+    -- Position before the last update, drawing interpolates from it
+    self.prev_x, self.prev_y = self.transform:xy()
+    self.world = world
+    self.body = world:add(self.transform, COLLISION_ENEMY)
+    colliders[self.body] = self
     self.nav = Navigation.new(self, paths)
     self.nav.current = 2
     self.live = true
     self.sfx = sfx
-    self.animator = animator
+    self.explosions = explosions
     return self
 end
 
 function Enemy:collide(tag)
     if tag == "bullet" then
-        self.animator:spawn("enemy_explosion", self.transform:position())
+        self.explosions:burst(self.transform:center_xy())
         Sound.play_sfx(self.sfx)
         self.live = False
     end
@@ -69,14 +77,24 @@ end
 
 function Enemy:update(interpolation, t, speed)
     if self.live then
+        self.prev_x, self.prev_y = self.transform:xy()
         self.nav:update()
-        self.transform:position(Vector.lerp(self.transform:position(), self.nav:path_position(), interpolation * t * speed))
+        local position = self.nav.from:set(self.transform:xy())
+        position:lerp_(self.nav.to:set(self.nav:path_xy()), interpolation * t * speed)
+        self.transform:set_position(position)
+        self.world:move(self.body, self.transform:xy())
     end
 end
 
-function Enemy:draw()
+function Enemy:destroy()
+    colliders[self.body] = nil
+    self.world:remove(self.body)
+end
+
+function Enemy:draw(alpha)
     if self.live then
-        Draw.draw_sprite(self.sprite, self.transform:position())
+        local x, y = self.transform:xy()
+        Draw.draw_sprite(self.sprite, self.prev_x + (x - self.prev_x) * alpha, self.prev_y + (y - self.prev_y) * alpha)
     end
 end
 
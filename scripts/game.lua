@@ -10,6 +10,8 @@ Sound = require("core.sound")
 Font = require("core.font")
 Draw = require("core.draw")
 Screen = require("core.screen")
+Camera = require("core.camera")
+Loader = require("core.loader")
 
 Target = require("target")
 Player = require("player")
@@ -19,21 +21,43 @@ Colors = require("colors")
 Enemy = require("enemy")
 Timer = require("timer")
 Utils = require("utils")
-Animator = require("animation")
+Particles = require("core.particles")
+Animation = require("core.animation")
+Collision = require("core.collision")
+Keys = require("core.keys")
+Trace = require("core.trace")
 ScrollGrid = require("scroll_grid")
 
+-- Draw layers, sprites are batched per texture inside each layer
+LAYER_BACKGROUND = 0
+LAYER_ENEMIES = 1
+LAYER_TORPEDOES = 2
+LAYER_EFFECTS = 3
+LAYER_PLAYER = 4
+LAYER_CURSOR = 5
+
+-- Collision layers, bit masks
+COLLISION_TORPEDO = 1
+COLLISION_ENEMY = 2
+
+-- Created once, per frame code must not allocate vectors
+TORPEDO_DIRECTION = Vector.new(0, 1)
+HUD_POSITION = Vector.new(10, 10)
+
 -- Load
 function _load()
     score = 0
-    animator = Animator.new()
     enemy_grid = NavGrid.new(0, 0, Screen.width, Screen.height / 2, 64, Colors.RED)
 
     enemy_grid:create()
     paths = enemy_grid:find_path()
 
-    ships = Draw.load_sprite_set("assets/ships_packed.png", 32, 32)
-    tiles = Draw.load_sprite_set("assets/tiles_packed.png", 16, 16)
-    map = Draw.load_sprite_set("assets/map2.png", 128, 128)
+    -- All sprite sets share one atlas page, the packing is cached in assets/
+    ships, tiles, map = Draw.build_atlas("assets/atlas", {
+        { "assets/ships_packed.png", 32, 32, true },
+        { "assets/tiles_packed.png", 16, 16, true },
+        { "assets/map2.png", 128, 128, false },
+    }, 1024)
     map_tiles = {
         A = {
             Draw.new_sprite(map, 0, 0, 2, false, false),
@@ -60,25 +84,27 @@ function _load()
             Draw.new_sprite(map, 3, 3, 2, false, false),
         }
     }
-    scroll_grid = ScrollGrid.new(0, 0, Screen.width * 2, Screen.height * 2, 256, map_tiles)
+    scroll_grid = ScrollGrid.new(0, 0, Screen.width, Screen.height, 256, map_tiles)
     scroll_grid:create()
 
-    fontHUD = Font.load("assets/fonts/Kenney Future Narrow.ttf", 64)
-    torpedo_sfx = Sound.load_sfx("assets/sfx/laserSmall_001.ogg")
-    explosion_sfx = Sound.load_sfx("assets/sfx/explosion.wav")
-    level_music = Sound.load_music("assets/music/wars.wav")
+    -- Fonts and sounds decode on loader threads while the loading screen is drawn
+    loading = {
+        font = Loader.load_font("assets/fonts/Kenney Future Narrow.ttf", 64),
+        torpedo_sfx = Loader.load_sfx("assets/sfx/laserSmall_001.ogg"),
+        explosion_sfx = Loader.load_sfx("assets/sfx/explosion.wav"),
+        music = Loader.load_music("assets/music/wars.wav"),
+    }
     target_sprite = Draw.new_sprite(tiles, 3, 2, 4, false, false)
     torpedo_sprite = Draw.new_sprite(tiles, 1, 0, 4, false, false)
     player_sprite = Draw.new_sprite(ships, 0, 0, 4, false, false)
-    ExplosionAnimSprites = {
-        Draw.new_sprite(tiles, 3, 10, 4, false, false),
-        Draw.new_sprite(tiles, 4, 10, 4, false, false),
-        Draw.new_sprite(tiles, 5, 10, 4, false, false),
-        Draw.new_sprite(tiles, 6, 10, 4, false, false),
-        Draw.new_sprite(tiles, 7, 10, 4, false, false),
-        Draw.new_sprite(tiles, 8, 10, 4, false, false),
-        Draw.new_sprite(tiles, 9, 10, 4, false, false),
-    }
+    -- Explosions play the frames once over their lifetime, all drawn by C
+    explosions = Particles.new({
+        sprite_set = tiles,
+        frames = { { 3, 10 }, { 4, 10 }, { 5, 10 }, { 6, 10 }, { 7, 10 }, { 8, 10 }, { 9, 10 } },
+        capacity = 128,
+        scale = 4,
+        life = 7 / 8,
+    })
 
     enemy_sprites = {
         Draw.new_sprite(ships, 0, 1, 4, false, true),
@@ -89,11 +115,30 @@ function _load()
 
     mouse_target = Target.new(target_sprite, 0, 0, 64)
     player = Player.new(player_sprite, 0, 0, 64)
-    torpedo_gun = TorpedoGun.new(torpedo_sprite, 64, torpedo_sfx, 100)
 
     -- ENEMY
-    animator:add_animation("enemy_explosion", ExplosionAnimSprites)
     enemies = {}
+
+    -- Torpedoes and enemies register their bodies, colliders maps them back
+    world = Collision.world(64)
+    colliders = {}
+    hits = {}
+
+    -- Headless frames and recordings must not depend on how fast the loaders are
+    if DETERMINISTIC then
+        Loader.wait()
+    end
+end
+
+-- Runs once everything in loading is ready
+function _start()
+    fontHUD = loading.font:get()
+    torpedo_sfx = loading.torpedo_sfx:get()
+    explosion_sfx = loading.explosion_sfx:get()
+    level_music = loading.music:get()
+    loading = nil
+
+    torpedo_gun = TorpedoGun.new(torpedo_sprite, 64, torpedo_sfx, 100, world)
     local callback = function(tag)
         local nav = enemy_grid:find_path()
         local enemy = Enemy.new(
@@ -101,7 +146,8 @@ function _load()
                 64,
                 nav,
                 explosion_sfx,
-                animator
+                explosions,
+                world
         )
         table.insert(enemies, enemy)
     end
@@ -110,7 +156,26 @@ function _load()
     print('loaded')
 end
 
--- Key Down
+-- All input of a frame in one call, consecutive mouse motion already merged
+function _events(batch)
+    for i = 1, batch.count do
+        local ev = batch[i]
+        local type = ev.type
+        if type == "mousemove" then
+            _mousemove(ev.state, ev.x, ev.y, ev.relx, ev.rely)
+        elseif type == "mousedown" then
+            _mousedown(ev.button, ev.state, ev.x, ev.y)
+        elseif type == "mouseup" then
+            _mouseup(ev.button, ev.state, ev.x, ev.y)
+        elseif type == "keydown" then
+            _keydown(ev.key)
+        elseif type == "keyup" then
+            _keyup(ev.key)
+        end
+    end
+end
+
+-- Key Down, key is a scancode, Keys[key] is its name
 function _keydown(key)
 
 end
@@ -128,47 +193,93 @@ end
 
 -- Mouse Down
 function _mousedown(button, state, x, y)
+    if loading then
+        return
+    end
     if button == "Left" then
-        torpedo_gun:shot(player.transform:center())
+        torpedo_gun:shot(player.transform:center_xy())
     end
 end
 
 
 -- Mouse Move
 function _mousemove(state, x, y, relx, rely)
-    mouse_target:translate(Vector.new(x, y))
+    mouse_target:translate(x, y)
 end
 
 -- Update
 function _update(t)
+    if loading then
+        if Loader.progress() < 1 then
+            return
+        end
+        _start()
+    end
     scroll_grid:update(t)
-    player:translate(Vector.lerp(player:position(), mouse_target:position(), 0.005 * t * 500))
-    torpedo_gun:update(Vector.new(0, 1), t, 800)
+    player:follow(mouse_target.transform, 0.005 * t * 500)
+    torpedo_gun:update(TORPEDO_DIRECTION, t, 800)
     enemies_wave_timer:update(t)
+    Trace.begin("enemies")
     for idx, e in ipairs(enemies) do
         e:update(0.05, t, 50)
-        if e.live then
-            torpedo_gun:check_collision(e)
+    end
+    Trace.finish()
+    -- One query for every torpedo and enemy touching, dead enemies stay in
+    -- the world until they are removed below
+    Trace.begin("collisions")
+    local count = world:query_pairs(COLLISION_TORPEDO, COLLISION_ENEMY, hits)
+    for i = 1, count * 2, 2 do
+        local torpedo, enemy = colliders[hits[i]], colliders[hits[i + 1]]
+        if enemy.live then
+            enemy:collide("bullet")
+            torpedo:collide("enemy")
         end
+    end
+    Trace.finish()
+    for idx, e in ipairs(enemies) do
         if not e.live then
             score = score + 10
+            e:destroy()
             table.remove(enemies, idx)
         end
     end
-    animator:update(t)
+    Particles.update(t)
+    Animation.update(t)
 end
 
 
--- Draw
-function _draw()
+-- Draw, alpha is how far the frame is into the next fixed update
+function _draw(alpha)
+    if loading then
+        local progress = Loader.progress()
+        local width = Screen.width / 2
+        -- Fills are batched and outlines flush the batch, the fill goes first to stay under the outline
+        Draw.draw_fill_rect(Rect.new(width / 2, Screen.height / 2, width * progress, 16), Colors.BLUE)
+        Draw.draw_rect(Rect.new(width / 2, Screen.height / 2, width, 16), Colors.WHITE)
+        return
+    end
+
+    Draw.set_layer(LAYER_BACKGROUND)
     scroll_grid:draw()
+    Draw.set_layer(LAYER_ENEMIES)
+    -- Moving sprites are drawn between their last two updated positions, so
+    -- frames without an update still move them on displays above the update rate
     for idx, e in ipairs(enemies) do
-        e:draw()
+        e:draw(alpha)
     end
-    torpedo_gun:draw()
-    animator:draw()
-    player:draw()
+    Draw.set_layer(LAYER_TORPEDOES)
+    torpedo_gun:draw(alpha)
+    Draw.set_layer(LAYER_EFFECTS)
+    Particles.draw()
+    Animation.draw()
+    Draw.set_layer(LAYER_PLAYER)
+    player:draw(alpha)
+    Draw.set_layer(LAYER_CURSOR)
     mouse_target:draw()
-    Draw.draw_text(fontHUD, string.format("SCORE: %d", score), Vector.new(10, 10), Colors.WHITE)
+
+    -- HUD stays on screen whatever the camera is looking at
+    Camera.enable(false)
+    Draw.draw_text(fontHUD, string.format("SCORE: %d", score), HUD_POSITION, Colors.WHITE)
+    Camera.enable(true)
 end
 
@@ -10,19 +10,30 @@ function Player.new(sprite, x, y, size)
     local self = setmetatable({}, Player)
     self.sprite = sprite
     self.transform = Rect.new(x, y, size, size)
+    -- Position before the last update, drawing interpolates from it
+    self.prev_x, self.prev_y = x, y
     return self
 end
 
-function Player:translate(position)
-    self.transform:position(position)
+function Player:translate(x, y)
+    self.transform:set_position(x, y)
 end
 
 function Player:position()
     return self.transform:position()
 end
 
-function Player:draw()
-    Draw.draw_sprite(self.sprite, self.transform:position())
+-- Moves a fraction k of the way to the target rect, in place
+function Player:follow(target, k)
+    local x, y = self.transform:xy()
+    local tx, ty = target:xy()
+    self.prev_x, self.prev_y = x, y
+    self.transform:set_position(x + (tx - x) * k, y + (ty - y) * k)
+end
+
+function Player:draw(alpha)
+    local x, y = self.transform:xy()
+    Draw.draw_sprite(self.sprite, self.prev_x + (x - self.prev_x) * alpha, self.prev_y + (y - self.prev_y) * alpha)
 end
 
 return Player
@@ -7,4 +7,41 @@ screen_height = 1024
 show_cursor = false
 full_screen = false
 mouse_grab = false
-background = { r = 156, g = 167, b = 167 }
\ No newline at end of file
+background = { r = 156, g = 167, b = 167 }
+
+-- Frame pacing
+vsync = true
+max_fps = 0             -- Frame cap with sleep and spin, 0 leaves it to vsync
+fixed_dt = 1 / 60       -- Simulation step, 0 updates once per frame with the frame time
+max_steps = 5           -- Updates per frame at most when catching up
+idle_unfocused = true   -- Stop and wait for events while the window has no focus
+
+-- Lua garbage collector, run after present within a time budget per frame
+gc_budget_ms = 1.0      -- 0 leaves the collector automatic
+gc_ceiling_mb = 256     -- Heap size forcing a full cycle, 0 for none
+gc_report = false       -- Print collection time and heap size every second
+
+-- Chrome trace of trace_frames frames, captured with F8 or core.trace.capture(),
+-- open it in Perfetto or chrome://tracing
+trace_frames = 120
+trace_output = "trace.json"
+
+-- Lua profiler, toggled with F6 or core.profiler.start/stop
+profiler_interval = 1000            -- VM instructions between samples
+profiler_output = "profile.folded"  -- Collapsed stacks, for flamegraph.pl or speedscope
+
+-- Frame timings of the last stats_frames frames, the overlay is toggled with F7
+stats_overlay = false
+stats_frames = 600
+stats_font = "assets/fonts/Kenney Future Narrow.ttf"
+stats_font_size = 16
+-- stats_csv = "frames.csv"  -- Saved on exit when set
+
+-- Packed assets built by the pack target, loose files are used when missing
+archive = "assets.pak"
+
+-- Headless runs, also enabled with --headless on the command line
+headless = false
+headless_frames = 600
+headless_dt = 1 / 60
+headless_seed = 0
\ No newline at end of file
@@ -13,8 +13,8 @@ function Target.new(sprite, x, y, size)
     return self
 end
 
-function Target:translate(position)
-    self.transform:position(position)
+function Target:translate(x, y)
+    self.transform:set_position(x, y)
 end
 
 function Target:position()
@@ -22,7 +22,7 @@ function Target:position()
 end
 
 function Target:draw()
-    Draw.draw_sprite(self.sprite, self.transform:center())
+    Draw.draw_sprite(self.sprite, self.transform:center_xy())
 end
 
 return Target
\ No newline at end of file
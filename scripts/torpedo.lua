@@ -7,14 +7,24 @@ Draw = require("core.draw")
 Torpedo = {}
 Torpedo.__index = Torpedo
 
-function Torpedo.new(sprite, position, size)
+function Torpedo.new(sprite, x, y, size, world)
     local self = setmetatable({}, Torpedo)
     self.sprite = sprite
-    self.transform = Rect.new(position:x(), position:y(), size, size)
+    self.transform = Rect.new(x, y, size, size)
+    -- Position before the last update, drawing interpolates from it
+    self.prev_x, self.prev_y = x, y
     self.live = true
+    self.world = world
+    self.body = world:add(self.transform, COLLISION_TORPEDO)
+    colliders[self.body] = self
     return self
 end
 
+function Torpedo:destroy()
+    colliders[self.body] = nil
+    self.world:remove(self.body)
+end
+
 function Torpedo:collide(transform)
     self.live = false
 end
@@ -22,9 +32,10 @@ end
 TorpedoGun = {}
 TorpedoGun.__index = TorpedoGun
 
-function TorpedoGun.new(sprite, size, sfx, max_rate)
+function TorpedoGun.new(sprite, size, sfx, max_rate, world)
     local self = setmetatable({}, TorpedoGun)
     self.sprite = sprite
+    self.world = world
     self.sfx = sfx
     self.size = size
     self.torpedos = {}
@@ -32,35 +43,32 @@ function TorpedoGun.new(sprite, size, sfx, max_rate)
     return self
 end
 
-function TorpedoGun:shot(position)
+function TorpedoGun:shot(x, y)
     Sound.play_sfx(self.sfx)
-    table.insert(self.torpedos, Torpedo.new(self.sprite, position, self.size))
+    table.insert(self.torpedos, Torpedo.new(self.sprite, x, y, self.size, self.world))
 end
 
 function TorpedoGun:update(direction, t, speed)
+    local dx, dy = direction:xy()
+    local step = t * speed
     for i, torpedo in ipairs(self.torpedos) do
-        torpedo.transform:position(torpedo.transform:position() - direction * (t * speed))
-        if not torpedo.live or torpedo.transform:position():y() < 0 then
+        torpedo.prev_x, torpedo.prev_y = torpedo.transform:xy()
+        torpedo.transform:translate_(-dx * step, -dy * step)
+        if not torpedo.live or torpedo.transform.y < 0 then
+            torpedo:destroy()
             table.remove(self.torpedos, i)
         else
+            self.world:move(torpedo.body, torpedo.transform:xy())
             self.torpedos[i] = torpedo
         end
     end
 end
 
-function TorpedoGun:draw()
+function TorpedoGun:draw(alpha)
     for i, torpedo in ipairs(self.torpedos) do
-        Draw.draw_sprite(torpedo.sprite, torpedo.transform:position())
-    end
-end
-
-function TorpedoGun:check_collision(gameobject)
-    for i, torpedo in ipairs(self.torpedos) do
-        is_colliding, side = torpedo.transform:overlaps(gameobject.transform)
-        if is_colliding then
-            gameobject:collide("bullet")
-            torpedo:collide("enemy")
-        end
+        local x, y = torpedo.transform:xy()
+        Draw.draw_sprite(torpedo.sprite, torpedo.prev_x + (x - torpedo.prev_x) * alpha,
+                torpedo.prev_y + (y - torpedo.prev_y) * alpha)
     end
 end
 
@@ -2,7 +2,8 @@
 -- License: Apache License 2.0
 Utils = {}
 Utils.__index = Utils
-math.randomseed(os.time())
+-- RANDOM_SEED is set by the engine on headless runs and recordings to repeat them
+math.randomseed(RANDOM_SEED or os.time())
 
 function Utils.random_choice(tb)
     return tb[math.random(#tb)]
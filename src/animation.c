@@ -0,0 +1,323 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "animation.h"
+#include "assets.h"
+
+#define ANIMATION_INITIAL_CAPACITY 64
+
+typedef struct {
+    int index;
+    Uint32 generation;
+} AnimationHandle;
+
+static AnimationInstance *instances = NULL;
+static int instance_count = 0;      // Slots in use or released, never shrinks
+static int instance_capacity = 0;
+static int *free_list = NULL;       // Released slots, reused first, sized like instances
+static int free_count = 0;
+
+static int animation_acquire() {
+    if (free_count > 0)
+        return free_list[--free_count];
+
+    if (instance_count == instance_capacity) {
+        instance_capacity = instance_capacity == 0 ? ANIMATION_INITIAL_CAPACITY : instance_capacity * 2;
+        instances = realloc(instances, sizeof(AnimationInstance) * instance_capacity);
+        free_list = realloc(free_list, sizeof(int) * instance_capacity);
+        if (instances == NULL || free_list == NULL)
+            panic("animation: out of memory\n");
+    }
+
+    AnimationInstance *inst = &instances[instance_count];
+    inst->generation = 0;
+    inst->used = false;
+    return instance_count++;
+}
+
+static void animation_release(lua_State *L, int index) {
+    AnimationInstance *inst = &instances[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, inst->clip_ref);
+    inst->used = false;
+    inst->generation++;
+    free_list[free_count++] = index;
+}
+
+// Moves to the next frame, returns false when a once clip is over
+static bool animation_step(AnimationInstance *inst) {
+    const AnimationClip *clip = inst->clip;
+    int next = inst->frame + inst->direction;
+
+    if (next >= 0 && next < clip->frame_count) {
+        inst->frame = next;
+        return true;
+    }
+
+    switch (clip->mode) {
+        case ANIMATION_LOOP:
+            inst->frame = 0;
+            return true;
+        case ANIMATION_PING_PONG:
+            inst->direction = -inst->direction;
+            if (clip->frame_count > 1)
+                inst->frame += inst->direction;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void animation_update(lua_State *L, double dt) {
+    for (int i = 0; i < instance_count; i++) {
+        AnimationInstance *inst = &instances[i];
+        if (!inst->used || !inst->playing)
+            continue;
+
+        inst->time += (float) dt;
+        while (inst->time >= inst->clip->durations[inst->frame]) {
+            inst->time -= inst->clip->durations[inst->frame];
+            if (!animation_step(inst)) {
+                inst->playing = false;
+                inst->time = 0;
+                break;
+            }
+        }
+
+        if (!inst->playing && inst->owned)
+            animation_release(L, i);
+    }
+}
+
+void animation_draw() {
+    int current = graphics_layer();
+
+    for (int i = 0; i < instance_count; i++) {
+        AnimationInstance *inst = &instances[i];
+        if (!inst->used)
+            continue;
+
+        const AnimationClip *clip = inst->clip;
+        graphics_set_layer(inst->layer == ANIMATION_CURRENT_LAYER ? current : inst->layer);
+        Vector pos = {inst->x, inst->y};
+        graphics_draw_sprite_set(clip->set, pos, clip->frame_cols[inst->frame], clip->frame_rows[inst->frame],
+                                 clip->scale, clip->flip_h, clip->flip_v);
+    }
+
+    graphics_set_layer(current);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static UserdataType ClipType = {"AnimationClip"};
+static UserdataType AnimationType = {"Animation"};
+
+static const char *const animation_modes[] = {"loop", "once", "ping_pong", NULL};
+
+// Animation.clip{sprite_set = set, frames = {{col, row}, ...}, fps = 8 or durations = {...},
+//                mode = "loop" | "once" | "ping_pong", scale = 1, flip_h = false, flip_v = false}
+int api_animation_clip(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    lua_getfield(L, 1, "sprite_set");
+    SpriteSet *set = asset_check(L, -1, &SpriteSetType);
+
+    AnimationClip *clip = udata_new(L, sizeof(AnimationClip), &ClipType);
+    memset(clip, 0, sizeof(AnimationClip));
+    clip->set = set;
+
+    // The clip keeps its sprite set loaded
+    lua_pushvalue(L, -2);
+    lua_setuservalue(L, -2);
+
+    luaL_argcheck(L, lua_getfield(L, 1, "frames") == LUA_TTABLE, 1, "frames expected");
+    int frames = (int) luaL_len(L, -1);
+    luaL_argcheck(L, frames > 0 && frames <= ANIMATION_MAX_FRAMES, 1, "invalid frame count");
+    for (int i = 0; i < frames; i++) {
+        luaL_argcheck(L, lua_rawgeti(L, -1, i + 1) == LUA_TTABLE, 1, "frames must be {col, row} tables");
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        luaL_argcheck(L, lua_isinteger(L, -2) && lua_isinteger(L, -1), 1, "frame col and row must be integers");
+        clip->frame_cols[i] = (int) lua_tointeger(L, -2);
+        clip->frame_rows[i] = (int) lua_tointeger(L, -1);
+        lua_pop(L, 3);
+    }
+    clip->frame_count = frames;
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "fps");
+    float duration = 1.0f / (float) luaL_optnumber(L, -1, 8);
+    lua_pop(L, 1);
+    for (int i = 0; i < frames; i++)
+        clip->durations[i] = duration;
+
+    if (lua_getfield(L, 1, "durations") == LUA_TTABLE) {
+        for (int i = 0; i < frames; i++) {
+            lua_rawgeti(L, -1, i + 1);
+            if (lua_isnumber(L, -1))
+                clip->durations[i] = (float) lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    // A zero duration would never leave its frame
+    for (int i = 0; i < frames; i++)
+        luaL_argcheck(L, clip->durations[i] > 0, 1, "frame durations must be positive");
+
+    lua_getfield(L, 1, "mode");
+    clip->mode = luaL_checkoption(L, -1, "loop", animation_modes);
+    lua_getfield(L, 1, "scale");
+    clip->scale = (float) luaL_optnumber(L, -1, 1);
+    lua_getfield(L, 1, "flip_h");
+    clip->flip_h = lua_toboolean(L, -1);
+    lua_getfield(L, 1, "flip_v");
+    clip->flip_v = lua_toboolean(L, -1);
+    lua_pop(L, 4);
+    return 1;
+}
+
+static int animation_start(lua_State *L, bool owned) {
+    AnimationClip *clip = udata_check(L, 1, &ClipType);
+    float x = (float) luaL_checknumber(L, 2);
+    float y = (float) luaL_checknumber(L, 3);
+    int layer = (int) luaL_optinteger(L, 4, ANIMATION_CURRENT_LAYER);
+
+    int index = animation_acquire();
+    AnimationInstance *inst = &instances[index];
+    lua_pushvalue(L, 1);
+    inst->clip_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    inst->clip = clip;
+    inst->used = true;
+    inst->playing = true;
+    inst->owned = owned;
+    inst->frame = 0;
+    inst->direction = 1;
+    inst->time = 0;
+    inst->x = x;
+    inst->y = y;
+    inst->layer = layer;
+    return index;
+}
+
+// Animation.play(clip, x, y, layer) plays until stopped, returning a handle
+int api_animation_play(lua_State *L) {
+    int index = animation_start(L, false);
+
+    AnimationHandle *handle = udata_new(L, sizeof(AnimationHandle), &AnimationType);
+    handle->index = index;
+    handle->generation = instances[index].generation;
+    return 1;
+}
+
+// Animation.spawn(clip, x, y, layer) frees itself when a "once" clip ends, for effects.
+// Other clips never end and nothing could stop them, they need Animation.play.
+int api_animation_spawn(lua_State *L) {
+    AnimationClip *clip = udata_check(L, 1, &ClipType);
+    luaL_argcheck(L, clip->mode == ANIMATION_ONCE, 1, "only \"once\" clips can be spawned, use play");
+    animation_start(L, true);
+    return 0;
+}
+
+static AnimationInstance *check_instance(lua_State *L) {
+    AnimationHandle *handle = udata_check(L, 1, &AnimationType);
+    if (handle->index < 0 || instances[handle->index].generation != handle->generation)
+        luaL_argerror(L, 1, "animation was released");
+    return &instances[handle->index];
+}
+
+int api_animation_start(lua_State *L) {
+    AnimationInstance *inst = check_instance(L);
+    inst->playing = true;
+    inst->frame = 0;
+    inst->direction = 1;
+    inst->time = 0;
+    return 0;
+}
+
+int api_animation_stop(lua_State *L) {
+    AnimationInstance *inst = check_instance(L);
+    inst->playing = false;
+    return 0;
+}
+
+int api_animation_move(lua_State *L) {
+    AnimationInstance *inst = check_instance(L);
+    inst->x = (float) luaL_checknumber(L, 2);
+    inst->y = (float) luaL_checknumber(L, 3);
+    return 0;
+}
+
+int api_animation_playing(lua_State *L) {
+    AnimationInstance *inst = check_instance(L);
+    lua_pushboolean(L, inst->playing);
+    return 1;
+}
+
+int api_animation_frame(lua_State *L) {
+    AnimationInstance *inst = check_instance(L);
+    lua_pushinteger(L, inst->frame + 1);
+    return 1;
+}
+
+int api_animation_gc(lua_State *L) {
+    AnimationHandle *handle = udata_check(L, 1, &AnimationType);
+    if (handle->index >= 0 && instances[handle->index].generation == handle->generation)
+        animation_release(L, handle->index);
+    handle->index = -1;
+    return 0;
+}
+
+int api_animation_update(lua_State *L) {
+    animation_update(L, luaL_checknumber(L, 1));
+    return 0;
+}
+
+int api_animation_draw(lua_State *L) {
+    animation_draw();
+    return 0;
+}
+
+int api_animation_count(lua_State *L) {
+    lua_pushinteger(L, instance_count - free_count);
+    return 1;
+}
+
+static const struct luaL_Reg animation_methods[] = {
+        {"start",   api_animation_start},
+        {"stop",    api_animation_stop},
+        {"move",    api_animation_move},
+        {"playing", api_animation_playing},
+        {"frame",   api_animation_frame},
+        {"__gc",    api_animation_gc},
+        {NULL, NULL}
+};
+
+static const struct luaL_Reg animation_funcs[] = {
+        {"clip",   api_animation_clip},
+        {"play",   api_animation_play},
+        {"spawn",  api_animation_spawn},
+        {"update", api_animation_update},
+        {"draw",   api_animation_draw},
+        {"count",  api_animation_count},
+        {NULL, NULL}
+};
+
+int module_animation(lua_State *L) {
+    udata_register(L, &ClipType);
+    lua_pop(L, 1);
+
+    udata_register(L, &AnimationType);
+    luaL_setfuncs(L, animation_methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    luaL_setfuncs(L, animation_funcs, 0);
+    return 1;
+}
+
+void api_animation_open(lua_State *L) {
+    luaL_requiref(L, "core.animation", module_animation, 0);
+    lua_pop(L, 1);
+}
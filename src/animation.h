@@ -0,0 +1,53 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "core.h"
+#include "graphics.h"
+
+#define ANIMATION_MAX_FRAMES 32
+#define ANIMATION_CURRENT_LAYER (-1)
+
+typedef enum {
+    ANIMATION_LOOP, ANIMATION_ONCE, ANIMATION_PING_PONG
+} AnimationMode;
+
+// Frames of a sprite set and how long each one is shown
+typedef struct {
+    SpriteSet *set;
+    int frame_count;
+    int frame_cols[ANIMATION_MAX_FRAMES];
+    int frame_rows[ANIMATION_MAX_FRAMES];
+    float durations[ANIMATION_MAX_FRAMES];
+    AnimationMode mode;
+    float scale;
+    bool flip_h;
+    bool flip_v;
+} AnimationClip;
+
+// A clip being played, lives in the animation pool. Lua handles refer to it
+// by index and generation, so a reused slot is never mistaken for the old one.
+typedef struct {
+    AnimationClip *clip;
+    int clip_ref;       // Keeps the clip userdata alive
+    Uint32 generation;
+    bool used;
+    bool playing;
+    bool owned;         // Released by the pool when a once clip ends
+    int frame;
+    int direction;      // 1 or -1 in ping pong
+    float time;         // Time spent in the current frame
+    float x;
+    float y;
+    int layer;
+} AnimationInstance;
+
+
+void animation_update(lua_State *L, double dt);
+
+void animation_draw();
+
+void api_animation_open(lua_State *L);
+
+#endif // ANIMATION_H
@@ -0,0 +1,140 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "archive.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+    void *mapping;
+    size_t size;
+    time_t mtime;
+    const ArchiveHeader *header;
+    const ArchiveEntry *entries;
+} Archive;
+
+static Archive *archive = NULL;
+
+// Decoded entries are wrapped in place, their layout must fit their data
+static bool archive_entry_valid(const ArchiveEntry *entry) {
+    if (entry->kind == ARCHIVE_IMAGE) {
+        Uint64 bytes = SDL_BYTESPERPIXEL(entry->format);
+        return bytes > 0 && entry->width > 0 && entry->height > 0 && entry->pitch > 0 &&
+               (Uint64) entry->pitch >= (Uint64) entry->width * bytes &&
+               (Uint64) entry->pitch * (Uint64) entry->height <= entry->size;
+    }
+
+    if (entry->kind == ARCHIVE_PCM) {
+        // width is the frequency and height the channels, samples are whole frames
+        if (entry->width <= 0 || entry->height <= 0)
+            return false;
+        Uint64 frame = (Uint64) (SDL_AUDIO_BITSIZE(entry->format) / 8) * entry->height;
+        return frame > 0 && entry->size % frame == 0 && entry->size <= SDL_MAX_UINT32;
+    }
+
+    return true;
+}
+
+static bool archive_valid(const void *mapping, size_t size) {
+    const ArchiveHeader *header = mapping;
+    if (size < sizeof(ArchiveHeader) || header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION)
+        return false;
+
+    size_t index_end = sizeof(ArchiveHeader) + (size_t) header->count * sizeof(ArchiveEntry);
+    if (index_end > size)
+        return false;
+
+    const ArchiveEntry *entries = (const ArchiveEntry *) (header + 1);
+    for (Uint32 i = 0; i < header->count; i++) {
+        const ArchiveEntry *entry = &entries[i];
+        if (entry->path[ARCHIVE_PATH_SIZE - 1] != '\0' || entry->offset < index_end ||
+            entry->offset > size || entry->size > size - entry->offset || !archive_entry_valid(entry))
+            return false;
+    }
+    return true;
+}
+
+bool archive_open(const char *filename) {
+    archive_close();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    if (!archive_valid(mapping, st.st_size)) {
+        printf("archive: %s is not a valid archive\n", filename);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    archive = malloc(sizeof(Archive));
+    archive->mapping = mapping;
+    archive->size = st.st_size;
+    archive->mtime = st.st_mtime;
+    archive->header = mapping;
+    archive->entries = (const ArchiveEntry *) (archive->header + 1);
+    return true;
+}
+
+void archive_close() {
+    if (archive == NULL)
+        return;
+
+    munmap(archive->mapping, archive->size);
+    free(archive);
+    archive = NULL;
+}
+
+bool archive_outdated(const char *path) {
+    struct stat st;
+    return archive != NULL && stat(path, &st) == 0 && st.st_mtime > archive->mtime;
+}
+
+static int compare_entry(const void *key, const void *entry) {
+    return strcmp(key, ((const ArchiveEntry *) entry)->path);
+}
+
+const ArchiveEntry *archive_find(const char *path) {
+    if (archive == NULL)
+        return NULL;
+
+    // Paths are stored without the leading "./"
+    if (strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    return bsearch(path, archive->entries, archive->header->count, sizeof(ArchiveEntry), compare_entry);
+}
+
+const void *archive_data(const ArchiveEntry *entry) {
+    return (const Uint8 *) archive->mapping + entry->offset;
+}
+
+SDL_RWops *archive_rw(const char *path) {
+    const ArchiveEntry *entry = archive_find(path);
+    if (entry != NULL && entry->kind == ARCHIVE_RAW)
+        return SDL_RWFromConstMem(archive_data(entry), (int) entry->size);
+
+    return SDL_RWFromFile(path, "rb");
+}
+
+SDL_Surface *archive_load_image(const char *path) {
+    const ArchiveEntry *entry = archive_find(path);
+    if (entry == NULL || entry->kind != ARCHIVE_IMAGE)
+        return IMG_Load(path);
+
+    // The pixels are only read, from the blit into atlas pages or the texture upload
+    return SDL_CreateRGBSurfaceWithFormatFrom((void *) archive_data(entry), entry->width, entry->height,
+                                              SDL_BITSPERPIXEL(entry->format), entry->pitch, entry->format);
+}
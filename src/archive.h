@@ -0,0 +1,61 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "core.h"
+
+#define ARCHIVE_MAGIC 0x4B415057u   // "WPAK"
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_PATH_SIZE 112
+#define ARCHIVE_ALIGN 64
+
+typedef enum {
+    ARCHIVE_RAW,        // File contents as they are: fonts, music
+    ARCHIVE_IMAGE,      // Decoded pixels
+    ARCHIVE_PCM,        // Decoded samples in the mixer output format
+    ARCHIVE_BYTECODE    // Scripts compiled to Lua bytecode
+} ArchiveKind;
+
+// Layout of the packed asset archive built by wars_pack. The header is
+// followed by the entries sorted by path, then the data of every entry
+// aligned to ARCHIVE_ALIGN bytes.
+typedef struct {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 count;
+    Uint32 reserved;
+} ArchiveHeader;
+
+typedef struct {
+    char path[ARCHIVE_PATH_SIZE];
+    Uint32 kind;
+    Uint32 format;      // SDL pixel format of images, SDL audio format of PCM
+    Sint32 width;       // Image width or PCM frequency
+    Sint32 height;      // Image height or PCM channels
+    Sint32 pitch;
+    Uint32 reserved;
+    Uint64 offset;
+    Uint64 size;
+} ArchiveEntry;
+
+
+// Maps the archive, every loader looks into it before the loose files
+bool archive_open(const char *filename);
+
+void archive_close();
+
+const ArchiveEntry *archive_find(const char *path);
+
+// True when the loose file at path was changed after the archive was built
+bool archive_outdated(const char *path);
+
+const void *archive_data(const ArchiveEntry *entry);
+
+// Reads a packed file from memory, or the loose file when it is not packed
+SDL_RWops *archive_rw(const char *path);
+
+// Wraps packed pixels without copying them, or decodes the loose image
+SDL_Surface *archive_load_image(const char *path);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,139 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "assets.h"
+
+static const char *asset_type_names[ASSET_TYPES] = {
+        "sprite_set",
+        "atlas",
+        "font",
+        "sound_effect",
+        "music",
+};
+
+static Asset *assets = NULL;
+static size_t asset_bytes[ASSET_TYPES];
+static int asset_counts[ASSET_TYPES];
+
+// Returns the asset with a new reference, or NULL when it isn't loaded
+Asset *asset_find(const char *key) {
+    for (Asset *asset = assets; asset != NULL; asset = asset->next) {
+        if (strcmp(asset->key, key) == 0) {
+            asset->refs++;
+            return asset;
+        }
+    }
+    return NULL;
+}
+
+// Registers a loaded asset, the caller owns the first reference
+Asset *asset_add(AssetType type, const char *key, void *data, size_t bytes, void (*destroy)(void *data)) {
+    Asset *asset = malloc(sizeof(Asset));
+    asset->type = type;
+    asset->key = strdup(key);
+    asset->data = data;
+    asset->bytes = bytes;
+    asset->refs = 1;
+    asset->destroy = destroy;
+    asset->next = assets;
+    assets = asset;
+
+    asset_bytes[type] += bytes;
+    asset_counts[type]++;
+    return asset;
+}
+
+void asset_retain(Asset *asset) {
+    asset->refs++;
+}
+
+void asset_release(Asset *asset) {
+    if (--asset->refs > 0)
+        return;
+
+    for (Asset **it = &assets; *it != NULL; it = &(*it)->next) {
+        if (*it == asset) {
+            *it = asset->next;
+            break;
+        }
+    }
+
+    asset_bytes[asset->type] -= asset->bytes;
+    asset_counts[asset->type]--;
+
+    if (asset->destroy != NULL)
+        asset->destroy(asset->data);
+    free(asset->key);
+    free(asset);
+}
+
+// Pushes a new handle taking over one reference of the asset
+void asset_push_handle(lua_State *L, Asset *asset, void *data, const UserdataType *type) {
+    AssetHandle *handle = udata_new(L, sizeof(AssetHandle), type);
+    handle->asset = asset;
+    handle->data = data;
+}
+
+void *asset_check(lua_State *L, int idx, const UserdataType *type) {
+    AssetHandle *handle = udata_check(L, idx, type);
+    if (handle->asset == NULL)
+        luaL_argerror(L, idx, "asset already released");
+    return handle->data;
+}
+
+int api_asset_gc(lua_State *L) {
+    AssetHandle *handle = lua_touserdata(L, 1);
+    if (handle->asset != NULL) {
+        asset_release(handle->asset);
+        handle->asset = NULL;
+        handle->data = NULL;
+    }
+    return 0;
+}
+
+int api_asset_tostring(lua_State *L) {
+    AssetHandle *handle = lua_touserdata(L, 1);
+    if (handle->asset == NULL)
+        lua_pushliteral(L, "Asset<released>");
+    else
+        lua_pushfstring(L, "Asset<%s, refs: %d>", handle->asset->key, handle->asset->refs);
+    return 1;
+}
+
+void asset_new_metatable(lua_State *L, UserdataType *type) {
+    udata_register(L, type);
+    lua_pushcfunction(L, api_asset_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, api_asset_tostring);
+    lua_setfield(L, -2, "__tostring");
+    lua_pop(L, 1);
+}
+
+int api_assets_stats(lua_State *L) {
+    lua_newtable(L);
+    int pos = lua_gettop(L);
+    for (int type = 0; type < ASSET_TYPES; type++) {
+        lua_newtable(L);
+        lua_pushinteger(L, asset_counts[type]);
+        lua_setfield(L, -2, "count");
+        lua_pushinteger(L, asset_bytes[type]);
+        lua_setfield(L, -2, "bytes");
+        lua_setfield(L, pos, asset_type_names[type]);
+    }
+    return 1;
+}
+
+static const struct luaL_Reg assets_funcs[] = {
+        {"stats", api_assets_stats},
+        {NULL, NULL}
+};
+
+int module_assets(lua_State *L) {
+    lua_newtable(L);
+    luaL_setfuncs(L, assets_funcs, 0);
+    return 1;
+}
+
+void api_assets_open(lua_State *L) {
+    luaL_requiref(L, "core.assets", module_assets, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,60 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "core.h"
+#include "udata.h"
+
+typedef enum {
+    ASSET_SPRITE_SET,
+    ASSET_ATLAS,
+    ASSET_FONT,
+    ASSET_SOUND_EFFECT,
+    ASSET_MUSIC,
+    ASSET_TYPES
+} AssetType;
+
+// Keys of the loaders, shared by the synchronous and the background ones
+#define ASSET_KEY_SPRITE_SET "sprite_set:%s:%dx%d"
+#define ASSET_KEY_FONT "font:%s:%d"
+#define ASSET_KEY_SOUND_EFFECT "sfx:%s"
+#define ASSET_KEY_MUSIC "music:%s"
+
+// A loaded resource shared by everyone asking for the same key. It is
+// destroyed when the last reference is released.
+typedef struct Asset {
+    AssetType type;
+    char *key;
+    void *data;
+    size_t bytes;
+    int refs;
+    void (*destroy)(void *data);
+    struct Asset *next;
+} Asset;
+
+// What Lua holds: a reference to the asset and the object it points to,
+// which is the asset data itself or a part of it (a sprite set of an atlas)
+typedef struct {
+    Asset *asset;
+    void *data;
+} AssetHandle;
+
+
+Asset *asset_find(const char *key);
+
+Asset *asset_add(AssetType type, const char *key, void *data, size_t bytes, void (*destroy)(void *data));
+
+void asset_retain(Asset *asset);
+
+void asset_release(Asset *asset);
+
+void asset_push_handle(lua_State *L, Asset *asset, void *data, const UserdataType *type);
+
+void *asset_check(lua_State *L, int idx, const UserdataType *type);
+
+void asset_new_metatable(lua_State *L, UserdataType *type);
+
+void api_assets_open(lua_State *L);
+
+#endif // ASSETS_H
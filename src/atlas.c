@@ -0,0 +1,600 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "atlas.h"
+#include "archive.h"
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ATLAS_MAGIC 0x4C544157 // "WATL"
+#define ATLAS_VERSION 2
+
+///////////////////////////////////////////////////////////////////////////////
+///// SKYLINE PACKER
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    int x;
+    int y;
+    int w;
+} SkylineNode;
+
+typedef struct {
+    SkylineNode *nodes;
+    int count;
+    int size;
+} Skyline;
+
+static void skyline_init(Skyline *sky, int size) {
+    // A node never gets narrower than one pixel, so size nodes is the worst case
+    sky->nodes = malloc(sizeof(SkylineNode) * (size + 1));
+    sky->nodes[0].x = 0;
+    sky->nodes[0].y = 0;
+    sky->nodes[0].w = size;
+    sky->count = 1;
+    sky->size = size;
+}
+
+static bool skyline_fit(Skyline *sky, int i, int w, int h, int *out_y) {
+    if (sky->nodes[i].x + w > sky->size)
+        return false;
+
+    int y = sky->nodes[i].y;
+    int width_left = w;
+    while (width_left > 0) {
+        if (i >= sky->count)
+            return false;
+        if (sky->nodes[i].y > y)
+            y = sky->nodes[i].y;
+        if (y + h > sky->size)
+            return false;
+        width_left -= sky->nodes[i].w;
+        i++;
+    }
+
+    *out_y = y;
+    return true;
+}
+
+static bool skyline_insert(Skyline *sky, int w, int h, int *out_x, int *out_y) {
+    int best = -1;
+    int best_y = INT_MAX;
+    int best_w = INT_MAX;
+
+    // Bottom-left rule: lowest position first, then the narrowest node
+    for (int i = 0; i < sky->count; i++) {
+        int y;
+        if (skyline_fit(sky, i, w, h, &y)) {
+            if (y < best_y || (y == best_y && sky->nodes[i].w < best_w)) {
+                best = i;
+                best_y = y;
+                best_w = sky->nodes[i].w;
+            }
+        }
+    }
+
+    if (best == -1)
+        return false;
+
+    *out_x = sky->nodes[best].x;
+    *out_y = best_y;
+
+    memmove(&sky->nodes[best + 1], &sky->nodes[best], sizeof(SkylineNode) * (sky->count - best));
+    sky->nodes[best].x = *out_x;
+    sky->nodes[best].y = best_y + h;
+    sky->nodes[best].w = w;
+    sky->count++;
+
+    // Shrink or drop the nodes now covered by the new one
+    for (int i = best + 1; i < sky->count; i++) {
+        SkylineNode *prev = &sky->nodes[i - 1];
+        SkylineNode *node = &sky->nodes[i];
+        int prev_right = prev->x + prev->w;
+        if (node->x >= prev_right)
+            break;
+
+        int shrink = prev_right - node->x;
+        node->x += shrink;
+        node->w -= shrink;
+        if (node->w > 0)
+            break;
+
+        memmove(node, node + 1, sizeof(SkylineNode) * (sky->count - i - 1));
+        sky->count--;
+        i--;
+    }
+
+    // Merge neighbours at the same height
+    for (int i = 0; i < sky->count - 1; i++) {
+        if (sky->nodes[i].y == sky->nodes[i + 1].y) {
+            sky->nodes[i].w += sky->nodes[i + 1].w;
+            memmove(&sky->nodes[i + 1], &sky->nodes[i + 2], sizeof(SkylineNode) * (sky->count - i - 2));
+            sky->count--;
+            i--;
+        }
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// PACKING
+///////////////////////////////////////////////////////////////////////////////
+
+// A cell together with the page it was placed in, kept by the cache index
+typedef struct {
+    Sint32 page;
+    Sint32 x;
+    Sint32 y;
+    Sint32 w;
+    Sint32 h;
+    Sint32 offset_x;
+    Sint32 offset_y;
+} PackedCell;
+
+typedef struct {
+    int set;
+    int cell;
+    int w;
+    int h;
+} PackItem;
+
+static Sint64 file_mtime(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return 0;
+    return (Sint64) st.st_mtime;
+}
+
+static bool cell_alpha_bounds(SDL_Surface *sur, int x, int y, int w, int h, SDL_Rect *bounds) {
+    int min_x = w, min_y = h, max_x = -1, max_y = -1;
+
+    for (int j = 0; j < h; j++) {
+        Uint8 *row = (Uint8 *) sur->pixels + (y + j) * sur->pitch + x * 4;
+        for (int i = 0; i < w; i++) {
+            // RGBA32 keeps alpha in the fourth byte on every platform
+            if (row[i * 4 + 3] != 0) {
+                if (i < min_x) min_x = i;
+                if (i > max_x) max_x = i;
+                if (j < min_y) min_y = j;
+                if (j > max_y) max_y = j;
+            }
+        }
+    }
+
+    if (max_x < 0)
+        return false;
+
+    bounds->x = min_x;
+    bounds->y = min_y;
+    bounds->w = max_x - min_x + 1;
+    bounds->h = max_y - min_y + 1;
+    return true;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const PackItem *ia = a;
+    const PackItem *ib = b;
+    if (ia->h != ib->h)
+        return ib->h - ia->h;
+    if (ia->w != ib->w)
+        return ib->w - ia->w;
+    if (ia->set != ib->set)
+        return ia->set - ib->set;
+    return ia->cell - ib->cell;
+}
+
+static int atlas_pack(SDL_Renderer *renderer, const AtlasInput *inputs, int count, int page_size,
+                      PackedCell **cells, SDL_Surface **sources, SDL_Texture **textures,
+                      SDL_Surface **page_surfaces) {
+    int total = 0;
+    for (int s = 0; s < count; s++) {
+        SDL_Surface *loaded = archive_load_image(inputs[s].filename);
+        if (loaded == NULL) {
+            printf("error on loading atlas image %s: %s\n", inputs[s].filename, IMG_GetError());
+            return -1;
+        }
+        sources[s] = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(loaded);
+        if (sources[s] == NULL)
+            return -1;
+
+        int cols = sources[s]->w / inputs[s].sprite_width;
+        int rows = sources[s]->h / inputs[s].sprite_height;
+        cells[s] = calloc(cols * rows, sizeof(PackedCell));
+        total += cols * rows;
+    }
+
+    PackItem *items = malloc(sizeof(PackItem) * total);
+    int item_count = 0;
+
+    for (int s = 0; s < count; s++) {
+        int sw = inputs[s].sprite_width;
+        int sh = inputs[s].sprite_height;
+        int cols = sources[s]->w / sw;
+        int rows = sources[s]->h / sh;
+
+        for (int c = 0; c < cols * rows; c++) {
+            PackedCell *cell = &cells[s][c];
+            SDL_Rect bounds = {0, 0, sw, sh};
+            int cell_x = (c % cols) * sw;
+            int cell_y = (c / cols) * sh;
+
+            if (inputs[s].trim && !cell_alpha_bounds(sources[s], cell_x, cell_y, sw, sh, &bounds)) {
+                cell->page = -1;
+                continue;
+            }
+
+            // Source position is kept in x/y until the cell is placed
+            cell->x = cell_x + bounds.x;
+            cell->y = cell_y + bounds.y;
+            cell->w = bounds.w;
+            cell->h = bounds.h;
+            cell->offset_x = bounds.x;
+            cell->offset_y = bounds.y;
+
+            PackItem *item = &items[item_count++];
+            item->set = s;
+            item->cell = c;
+            item->w = bounds.w + ATLAS_PADDING;
+            item->h = bounds.h + ATLAS_PADDING;
+        }
+    }
+
+    qsort(items, item_count, sizeof(PackItem), compare_items);
+
+    Skyline pages[ATLAS_MAX_PAGES];
+    int page_count = 0;
+    bool failed = false;
+
+    for (int i = 0; i < item_count; i++) {
+        PackItem *item = &items[i];
+        PackedCell *cell = &cells[item->set][item->cell];
+        int x = 0, y = 0, page = -1;
+
+        for (int p = 0; p < page_count && page == -1; p++) {
+            if (skyline_insert(&pages[p], item->w, item->h, &x, &y))
+                page = p;
+        }
+
+        if (page == -1 && page_count < ATLAS_MAX_PAGES) {
+            page_surfaces[page_count] = SDL_CreateRGBSurfaceWithFormat(0, page_size, page_size, 32,
+                                                                       SDL_PIXELFORMAT_RGBA32);
+            if (page_surfaces[page_count] == NULL) {
+                printf("error on packing atlas: %s\n", SDL_GetError());
+                failed = true;
+                break;
+            }
+            skyline_init(&pages[page_count], page_size);
+            if (skyline_insert(&pages[page_count], item->w, item->h, &x, &y))
+                page = page_count;
+            page_count++;
+        }
+
+        if (page == -1) {
+            printf("error on packing atlas: cell %dx%d does not fit\n", cell->w, cell->h);
+            failed = true;
+            break;
+        }
+
+        SDL_Rect src = {cell->x, cell->y, cell->w, cell->h};
+        SDL_Rect dst = {x, y, cell->w, cell->h};
+        SDL_SetSurfaceBlendMode(sources[item->set], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(sources[item->set], &src, page_surfaces[page], &dst);
+
+        cell->page = page;
+        cell->x = x;
+        cell->y = y;
+    }
+
+    for (int p = 0; p < page_count; p++)
+        free(pages[p].nodes);
+    free(items);
+
+    if (failed)
+        return -1;
+
+    for (int p = 0; p < page_count; p++) {
+        textures[p] = SDL_CreateTextureFromSurface(renderer, page_surfaces[p]);
+        if (textures[p] == NULL) {
+            printf("error on creating atlas page texture: %s\n", SDL_GetError());
+            for (int i = 0; i < p; i++)
+                SDL_DestroyTexture(textures[i]);
+            return -1;
+        }
+    }
+
+    return page_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// CACHE
+///////////////////////////////////////////////////////////////////////////////
+
+static void atlas_write_int(FILE *file, Sint64 value) {
+    fwrite(&value, sizeof(Sint64), 1, file);
+}
+
+static Sint64 atlas_read_int(FILE *file) {
+    Sint64 value = -1;
+    if (fread(&value, sizeof(Sint64), 1, file) != 1)
+        return -1;
+    return value;
+}
+
+// Pages are cached as raw RGBA32 pixels, loading one is a texture upload
+// straight from the mapped file with nothing to decode
+static bool atlas_save_page(SDL_Surface *page, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+        return false;
+
+    bool ok = true;
+    for (int y = 0; y < page->h && ok; y++)
+        ok = fwrite((Uint8 *) page->pixels + y * page->pitch, 4, page->w, file) == (size_t) page->w;
+
+    if (fclose(file) != 0 || !ok) {
+        remove(filename);
+        return false;
+    }
+    return true;
+}
+
+static SDL_Texture *atlas_load_page(SDL_Renderer *renderer, const char *filename, int page_size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    size_t size = (size_t) page_size * page_size * 4;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != size) {
+        close(fd);
+        return NULL;
+    }
+
+    void *pixels = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pixels == MAP_FAILED)
+        return NULL;
+
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+                                             page_size, page_size);
+    if (texture != NULL) {
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        if (SDL_UpdateTexture(texture, NULL, pixels, page_size * 4) != 0) {
+            SDL_DestroyTexture(texture);
+            texture = NULL;
+        }
+    }
+
+    munmap(pixels, size);
+    return texture;
+}
+
+static void atlas_save_cache(const char *cache, const AtlasInput *inputs, int count, int page_size,
+                             int page_count, PackedCell **cells, SDL_Surface **sources,
+                             SDL_Surface **page_surfaces) {
+    for (int p = 0; p < page_count; p++) {
+        char *page_file = NULL;
+        asprintf(&page_file, "%s_%d.rgba", cache, p);
+        if (!atlas_save_page(page_surfaces[p], page_file))
+            printf("error on saving atlas page %s\n", page_file);
+        free(page_file);
+    }
+
+    char *index_file = NULL;
+    asprintf(&index_file, "%s.atlas", cache);
+    FILE *file = fopen(index_file, "wb");
+    free(index_file);
+    if (file == NULL)
+        return;
+
+    atlas_write_int(file, ATLAS_MAGIC);
+    atlas_write_int(file, ATLAS_VERSION);
+    atlas_write_int(file, page_size);
+    atlas_write_int(file, page_count);
+    atlas_write_int(file, count);
+
+    for (int s = 0; s < count; s++) {
+        int cols = sources[s]->w / inputs[s].sprite_width;
+        int rows = sources[s]->h / inputs[s].sprite_height;
+        size_t len = strlen(inputs[s].filename);
+
+        atlas_write_int(file, (Sint64) len);
+        fwrite(inputs[s].filename, 1, len, file);
+        atlas_write_int(file, file_mtime(inputs[s].filename));
+        atlas_write_int(file, inputs[s].sprite_width);
+        atlas_write_int(file, inputs[s].sprite_height);
+        atlas_write_int(file, inputs[s].trim);
+        atlas_write_int(file, cols);
+        atlas_write_int(file, rows);
+        fwrite(cells[s], sizeof(PackedCell), cols * rows, file);
+    }
+
+    fclose(file);
+}
+
+// Returns the page count, or -1 when there is no cache or it is out of date
+static int atlas_load_cache(SDL_Renderer *renderer, const char *cache, const AtlasInput *inputs, int count,
+                            int page_size, PackedCell **cells, int *cols, int *rows, SDL_Texture **textures) {
+    char *index_file = NULL;
+    asprintf(&index_file, "%s.atlas", cache);
+    FILE *file = fopen(index_file, "rb");
+    free(index_file);
+    if (file == NULL)
+        return -1;
+
+    int page_count = -1;
+
+    if (atlas_read_int(file) != ATLAS_MAGIC || atlas_read_int(file) != ATLAS_VERSION ||
+        atlas_read_int(file) != page_size)
+        goto done;
+
+    Sint64 pages = atlas_read_int(file);
+    if (pages <= 0 || pages > ATLAS_MAX_PAGES || atlas_read_int(file) != count)
+        goto done;
+
+    for (int s = 0; s < count; s++) {
+        size_t len = strlen(inputs[s].filename);
+        if (atlas_read_int(file) != (Sint64) len)
+            goto done;
+
+        char name[len + 1];
+        if (fread(name, 1, len, file) != len || memcmp(name, inputs[s].filename, len) != 0)
+            goto done;
+
+        if (atlas_read_int(file) != file_mtime(inputs[s].filename) ||
+            atlas_read_int(file) != inputs[s].sprite_width ||
+            atlas_read_int(file) != inputs[s].sprite_height ||
+            atlas_read_int(file) != inputs[s].trim)
+            goto done;
+
+        cols[s] = atlas_read_int(file);
+        rows[s] = atlas_read_int(file);
+        if (cols[s] <= 0 || rows[s] <= 0)
+            goto done;
+
+        cells[s] = malloc(sizeof(PackedCell) * cols[s] * rows[s]);
+        if (fread(cells[s], sizeof(PackedCell), cols[s] * rows[s], file) != (size_t) (cols[s] * rows[s]))
+            goto done;
+
+        // Pages index the textures, a stale or corrupt index must not reach past them
+        for (int c = 0; c < cols[s] * rows[s]; c++) {
+            if (cells[s][c].page >= pages)
+                goto done;
+        }
+    }
+
+    for (int p = 0; p < pages; p++) {
+        char *page_file = NULL;
+        asprintf(&page_file, "%s_%d.rgba", cache, p);
+        textures[p] = atlas_load_page(renderer, page_file, page_size);
+        free(page_file);
+
+        if (textures[p] == NULL) {
+            for (int i = 0; i < p; i++)
+                SDL_DestroyTexture(textures[i]);
+            goto done;
+        }
+    }
+
+    page_count = (int) pages;
+
+    done:
+    fclose(file);
+    if (page_count == -1) {
+        for (int s = 0; s < count; s++) {
+            free(cells[s]);
+            cells[s] = NULL;
+        }
+    }
+    return page_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// BUILD
+///////////////////////////////////////////////////////////////////////////////
+
+static SpriteSet *atlas_new_sprite_set(const AtlasInput *input, int cols, int rows, int page_size,
+                                       PackedCell *packed, SDL_Texture **textures) {
+    SpriteSet *set = malloc(sizeof(SpriteSet));
+    set->sprite_width = input->sprite_width;
+    set->sprite_height = input->sprite_height;
+    set->cols = cols;
+    set->rows = rows;
+    set->texture = textures[0];
+    set->w = page_size;
+    set->h = page_size;
+    set->cells = calloc(cols * rows, sizeof(SpriteCell));
+    SDL_QueryTexture(set->texture, &set->format, &set->access, NULL, NULL);
+
+    for (int c = 0; c < cols * rows; c++) {
+        if (packed[c].page < 0)
+            continue;
+
+        SpriteCell *cell = &set->cells[c];
+        cell->texture = textures[packed[c].page];
+        cell->src.x = packed[c].x;
+        cell->src.y = packed[c].y;
+        cell->src.w = packed[c].w;
+        cell->src.h = packed[c].h;
+        cell->offset_x = packed[c].offset_x;
+        cell->offset_y = packed[c].offset_y;
+    }
+
+    return set;
+}
+
+Atlas *atlas_build(SDL_Renderer *renderer, const char *cache, const AtlasInput *inputs, int count, int page_size) {
+    PackedCell *cells[count];
+    int cols[count];
+    int rows[count];
+    SDL_Texture *textures[ATLAS_MAX_PAGES];
+    int page_count = -1;
+
+    for (int s = 0; s < count; s++)
+        cells[s] = NULL;
+
+    if (cache != NULL)
+        page_count = atlas_load_cache(renderer, cache, inputs, count, page_size, cells, cols, rows, textures);
+
+    if (page_count == -1) {
+        SDL_Surface *sources[count];
+        SDL_Surface *page_surfaces[ATLAS_MAX_PAGES];
+        for (int s = 0; s < count; s++)
+            sources[s] = NULL;
+        for (int p = 0; p < ATLAS_MAX_PAGES; p++)
+            page_surfaces[p] = NULL;
+
+        page_count = atlas_pack(renderer, inputs, count, page_size, cells, sources, textures, page_surfaces);
+
+        if (page_count > 0) {
+            for (int s = 0; s < count; s++) {
+                cols[s] = sources[s]->w / inputs[s].sprite_width;
+                rows[s] = sources[s]->h / inputs[s].sprite_height;
+            }
+
+            if (cache != NULL)
+                atlas_save_cache(cache, inputs, count, page_size, page_count, cells, sources, page_surfaces);
+        }
+
+        for (int s = 0; s < count; s++) {
+            if (sources[s] != NULL)
+                SDL_FreeSurface(sources[s]);
+        }
+        for (int p = 0; p < ATLAS_MAX_PAGES; p++) {
+            if (page_surfaces[p] != NULL)
+                SDL_FreeSurface(page_surfaces[p]);
+        }
+    }
+
+    Atlas *atlas = NULL;
+    if (page_count > 0) {
+        atlas = malloc(sizeof(Atlas));
+        atlas->count = count;
+        atlas->sets = malloc(sizeof(SpriteSet *) * count);
+        atlas->page_count = page_count;
+        for (int p = 0; p < page_count; p++)
+            atlas->pages[p] = textures[p];
+        for (int s = 0; s < count; s++)
+            atlas->sets[s] = atlas_new_sprite_set(&inputs[s], cols[s], rows[s], page_size, cells[s], textures);
+    }
+
+    for (int s = 0; s < count; s++)
+        free(cells[s]);
+
+    return atlas;
+}
+
+void atlas_free(Atlas *atlas) {
+    for (int s = 0; s < atlas->count; s++) {
+        free(atlas->sets[s]->cells);
+        free(atlas->sets[s]);
+    }
+    for (int p = 0; p < atlas->page_count; p++)
+        SDL_DestroyTexture(atlas->pages[p]);
+    free(atlas->sets);
+    free(atlas);
+}
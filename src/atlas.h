@@ -0,0 +1,35 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "core.h"
+#include "graphics.h"
+
+#define ATLAS_MAX_PAGES 8
+#define ATLAS_PADDING 1
+
+typedef struct {
+    const char *filename;
+    int sprite_width;
+    int sprite_height;
+    bool trim;
+} AtlasInput;
+
+typedef struct {
+    int count;
+    SpriteSet **sets;   // One per input, in the same order
+    int page_count;
+    SDL_Texture *pages[ATLAS_MAX_PAGES];
+} Atlas;
+
+// Packs the sprite sets of every input into square pages of page_size pixels.
+// When cache is not NULL the pages are saved as raw RGBA32 pixels in
+// "<cache>_<n>.rgba" plus an index "<cache>.atlas", and reused on the next
+// build while the source images are unchanged, without decoding anything.
+// Returns NULL on failure.
+Atlas *atlas_build(SDL_Renderer *renderer, const char *cache, const AtlasInput *inputs, int count, int page_size);
+
+void atlas_free(Atlas *atlas);
+
+#endif // ATLAS_H
@@ -0,0 +1,222 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "batch.h"
+
+#define BATCH_INITIAL_CAPACITY 1024
+
+SpriteBatch *batch_new() {
+    SpriteBatch *batch = malloc(sizeof(SpriteBatch));
+    batch->capacity = BATCH_INITIAL_CAPACITY;
+    batch->quads = malloc(sizeof(BatchQuad) * batch->capacity);
+    batch->count = 0;
+    batch->run_capacity = 0;
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->layer = 0;
+    batch->textures = NULL;
+    batch->texture_count = 0;
+    batch->texture_capacity = 0;
+    batch->last_key = -1;
+    batch->queued = 0;
+    batch->batches = 0;
+    batch->switches = 0;
+    batch->last_texture = NULL;
+    return batch;
+}
+
+void batch_free(SpriteBatch *batch) {
+    free(batch->quads);
+    free(batch->vertices);
+    free(batch->indices);
+    free(batch->textures);
+    free(batch);
+}
+
+void batch_set_layer(SpriteBatch *batch, int layer) {
+    batch->layer = layer;
+}
+
+// A frame uses a handful of textures and consecutive quads mostly share one,
+// the last key is checked before the list
+static int batch_texture_key(SpriteBatch *batch, SDL_Texture *texture) {
+    if (batch->last_key >= 0 && batch->textures[batch->last_key] == texture)
+        return batch->last_key;
+
+    int key = 0;
+    while (key < batch->texture_count && batch->textures[key] != texture)
+        key++;
+
+    if (key == batch->texture_count) {
+        if (batch->texture_count == batch->texture_capacity) {
+            batch->texture_capacity = batch->texture_capacity > 0 ? batch->texture_capacity * 2 : 16;
+            batch->textures = realloc(batch->textures, sizeof(SDL_Texture *) * batch->texture_capacity);
+            if (batch->textures == NULL)
+                panic("batch: out of memory\n");
+        }
+        batch->textures[batch->texture_count++] = texture;
+    }
+
+    batch->last_key = key;
+    return key;
+}
+
+static BatchQuad *batch_next_quad(SpriteBatch *batch) {
+    if (batch->count == batch->capacity) {
+        batch->capacity *= 2;
+        batch->quads = realloc(batch->quads, sizeof(BatchQuad) * batch->capacity);
+        if (batch->quads == NULL)
+            panic("batch: out of memory\n");
+    }
+
+    BatchQuad *quad = &batch->quads[batch->count];
+    quad->layer = batch->layer;
+    quad->order = batch->count;
+    batch->count++;
+    batch->queued++;
+    return quad;
+}
+
+static void set_vertex(SDL_Vertex *v, float x, float y, float u, float t, SDL_Color color) {
+    v->position.x = x;
+    v->position.y = y;
+    v->tex_coord.x = u;
+    v->tex_coord.y = t;
+    v->color = color;
+}
+
+void batch_push(SpriteBatch *batch, SDL_Texture *texture, int tex_w, int tex_h,
+                SDL_Rect src, SDL_FRect dst, SDL_RendererFlip flip, SDL_Color color) {
+    BatchQuad *quad = batch_next_quad(batch);
+    quad->texture = texture;
+    quad->texture_key = batch_texture_key(batch, texture);
+
+    float u0 = (float) src.x / tex_w;
+    float v0 = (float) src.y / tex_h;
+    float u1 = (float) (src.x + src.w) / tex_w;
+    float v1 = (float) (src.y + src.h) / tex_h;
+
+    if (flip & SDL_FLIP_HORIZONTAL) {
+        float tmp = u0;
+        u0 = u1;
+        u1 = tmp;
+    }
+
+    if (flip & SDL_FLIP_VERTICAL) {
+        float tmp = v0;
+        v0 = v1;
+        v1 = tmp;
+    }
+
+    float x0 = dst.x;
+    float y0 = dst.y;
+    float x1 = dst.x + dst.w;
+    float y1 = dst.y + dst.h;
+
+    set_vertex(&quad->vertices[0], x0, y0, u0, v0, color);
+    set_vertex(&quad->vertices[1], x1, y0, u1, v0, color);
+    set_vertex(&quad->vertices[2], x1, y1, u1, v1, color);
+    set_vertex(&quad->vertices[3], x0, y1, u0, v1, color);
+}
+
+void batch_push_rect(SpriteBatch *batch, SDL_FRect dst, SDL_Color color) {
+    BatchQuad *quad = batch_next_quad(batch);
+    quad->texture = NULL;
+    quad->texture_key = batch_texture_key(batch, NULL);
+
+    float x0 = dst.x;
+    float y0 = dst.y;
+    float x1 = dst.x + dst.w;
+    float y1 = dst.y + dst.h;
+
+    set_vertex(&quad->vertices[0], x0, y0, 0, 0, color);
+    set_vertex(&quad->vertices[1], x1, y0, 0, 0, color);
+    set_vertex(&quad->vertices[2], x1, y1, 0, 0, color);
+    set_vertex(&quad->vertices[3], x0, y1, 0, 0, color);
+}
+
+static int compare_quads(const void *a, const void *b) {
+    const BatchQuad *qa = a;
+    const BatchQuad *qb = b;
+
+    if (qa->layer != qb->layer)
+        return qa->layer < qb->layer ? -1 : 1;
+
+    if (qa->texture_key != qb->texture_key)
+        return qa->texture_key - qb->texture_key;
+
+    // qsort is not stable, the submission order keeps it stable
+    return qa->order - qb->order;
+}
+
+static void batch_draw(SpriteBatch *batch, SDL_Renderer *renderer, SDL_Texture *texture, int quads) {
+    SDL_RenderGeometry(renderer, texture, batch->vertices, quads * 4, batch->indices, quads * 6);
+    if (batch->batches > 0 && texture != batch->last_texture)
+        batch->switches++;
+    batch->last_texture = texture;
+    batch->batches++;
+}
+
+static void batch_reserve_run(SpriteBatch *batch, int quads) {
+    if (quads <= batch->run_capacity)
+        return;
+
+    batch->vertices = realloc(batch->vertices, sizeof(SDL_Vertex) * 4 * quads);
+    batch->indices = realloc(batch->indices, sizeof(int) * 6 * quads);
+    if (batch->vertices == NULL || batch->indices == NULL)
+        panic("batch: out of memory\n");
+
+    // Indices never change for a given slot, fill only the new ones
+    for (int i = batch->run_capacity; i < quads; i++) {
+        int *idx = &batch->indices[i * 6];
+        int base = i * 4;
+        idx[0] = base;
+        idx[1] = base + 1;
+        idx[2] = base + 2;
+        idx[3] = base;
+        idx[4] = base + 2;
+        idx[5] = base + 3;
+    }
+    batch->run_capacity = quads;
+}
+
+void batch_flush(SpriteBatch *batch, SDL_Renderer *renderer) {
+    if (batch->count == 0)
+        return;
+
+    qsort(batch->quads, batch->count, sizeof(BatchQuad), compare_quads);
+    batch_reserve_run(batch, batch->count);
+
+    int start = 0;
+    while (start < batch->count) {
+        SDL_Texture *texture = batch->quads[start].texture;
+        int end = start;
+        while (end < batch->count && batch->quads[end].texture == texture) {
+            memcpy(&batch->vertices[(end - start) * 4], batch->quads[end].vertices, sizeof(SDL_Vertex) * 4);
+            end++;
+        }
+
+        batch_draw(batch, renderer, texture, end - start);
+        start = end;
+    }
+
+    batch->count = 0;
+    batch->texture_count = 0;
+    batch->last_key = -1;
+}
+
+SDL_Vertex *batch_begin_quads(SpriteBatch *batch, SDL_Renderer *renderer, int quads) {
+    batch_flush(batch, renderer);
+    batch_reserve_run(batch, quads);
+    return batch->vertices;
+}
+
+void batch_end_quads(SpriteBatch *batch, SDL_Renderer *renderer, SDL_Texture *texture, int quads) {
+    batch_draw(batch, renderer, texture, quads);
+    batch->queued += quads;
+}
+
+void batch_reset_stats(SpriteBatch *batch) {
+    batch->queued = 0;
+    batch->batches = 0;
+    batch->switches = 0;
+}
@@ -0,0 +1,67 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "core.h"
+
+// One textured (or untextured when texture is NULL) quad waiting to be drawn.
+// `order` keeps submission order so sorting by (layer, texture) stays stable.
+// Textures are sorted on `texture_key`, their first use order in the frame,
+// so the draw order does not depend on where the textures were allocated.
+typedef struct {
+    int layer;
+    int order;
+    int texture_key;
+    SDL_Texture *texture;
+    SDL_Vertex vertices[4];
+} BatchQuad;
+
+typedef struct {
+    BatchQuad *quads;
+    int count;
+    int capacity;
+
+    // Scratch buffers reused by every flush, sized to the biggest run seen
+    SDL_Vertex *vertices;
+    int *indices;
+    int run_capacity;
+
+    int layer;
+
+    // Textures of the queued quads in first use order, index is the key
+    SDL_Texture **textures;
+    int texture_count;
+    int texture_capacity;
+    int last_key;
+
+    // Counters for the current frame
+    int queued;
+    int batches;
+    int switches;               // Draws with another texture than the draw before
+    SDL_Texture *last_texture;
+} SpriteBatch;
+
+
+SpriteBatch *batch_new();
+
+void batch_free(SpriteBatch *batch);
+
+void batch_set_layer(SpriteBatch *batch, int layer);
+
+void batch_push(SpriteBatch *batch, SDL_Texture *texture, int tex_w, int tex_h,
+                SDL_Rect src, SDL_FRect dst, SDL_RendererFlip flip, SDL_Color color);
+
+void batch_push_rect(SpriteBatch *batch, SDL_FRect dst, SDL_Color color);
+
+void batch_flush(SpriteBatch *batch, SDL_Renderer *renderer);
+
+// Draws whatever is queued and returns room for `quads` quads that are drawn
+// right away by batch_end_quads, for geometry that is already grouped by texture.
+SDL_Vertex *batch_begin_quads(SpriteBatch *batch, SDL_Renderer *renderer, int quads);
+
+void batch_end_quads(SpriteBatch *batch, SDL_Renderer *renderer, SDL_Texture *texture, int quads);
+
+void batch_reset_stats(SpriteBatch *batch);
+
+#endif // BATCH_H
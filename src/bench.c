@@ -0,0 +1,150 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+// wars_bench: microbenchmarks of the engine hot paths, run without a window
+//
+//   wars_bench [--json results.json] [suite...]
+#include "bench.h"
+
+typedef struct {
+    const char *suite;
+    char *name;
+    int elements;
+    double ns;
+} BenchResult;
+
+typedef struct {
+    const char *name;
+    void (*run)();
+} BenchSuite;
+
+static const BenchSuite suites[] = {
+        {"vecarray", bench_vecarray},
+        {"bindings", bench_bindings},
+        {"math",     bench_math},
+        {"scripts",  bench_scripts},
+};
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int result_count = 0;
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+double bench_run(BenchFunction fn, void *data) {
+    double samples[BENCH_REPETITIONS];
+    double frequency = (double) SDL_GetPerformanceFrequency();
+
+    for (int i = 0; i < BENCH_WARMUP; i++)
+        fn(data);
+
+    for (int i = 0; i < BENCH_REPETITIONS; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        fn(data);
+        samples[i] = (double) (SDL_GetPerformanceCounter() - start) * 1e9 / frequency;
+    }
+
+    qsort(samples, BENCH_REPETITIONS, sizeof(double), compare_double);
+    return samples[BENCH_REPETITIONS / 2];
+}
+
+static void call_lua(void *data) {
+    lua_State *L = data;
+    lua_pushvalue(L, -1);
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+}
+
+double bench_run_lua(lua_State *L) {
+    luaL_checktype(L, -1, LUA_TFUNCTION);
+    double ns = bench_run(call_lua, L);
+    lua_pop(L, 1);
+    return ns;
+}
+
+void bench_report(const char *suite, const char *name, int elements, double ns) {
+    if (result_count < BENCH_MAX_RESULTS) {
+        BenchResult *result = &results[result_count++];
+        result->suite = suite;
+        result->name = strdup(name);
+        result->elements = elements;
+        result->ns = ns;
+    }
+
+    if (elements > 0)
+        printf("%-10s %-28s %8d %14.0f ns %10.3f ns/elem\n", suite, name, elements, ns, ns / elements);
+    else
+        printf("%-10s %-28s %8s %14.0f ns\n", suite, name, "-", ns);
+}
+
+lua_State *bench_lua_state() {
+    lua_State *L = luaL_newstate();
+    if (L == NULL)
+        panic("bench: could not create lua state\n");
+    luaL_openlibs(L);
+    return L;
+}
+
+// One object per result, names are plain ASCII without quotes
+static bool write_json(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "{\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [", BENCH_WARMUP, BENCH_REPETITIONS);
+    for (int i = 0; i < result_count; i++) {
+        const BenchResult *result = &results[i];
+        double per_op = result->elements > 0 ? result->ns / result->elements : result->ns;
+        fprintf(file, "%s\n    {\"suite\": \"%s\", \"name\": \"%s\", \"elements\": %d, \"ns\": %.1f, \"ns_per_op\": %.4f}",
+                i > 0 ? "," : "", result->suite, result->name, result->elements, result->ns, per_op);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+static bool selected(const char *suite, int argc, char *argv[]) {
+    bool any = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            i++;
+            continue;
+        }
+        any = true;
+        if (strcmp(argv[i], suite) == 0)
+            return true;
+    }
+    return !any;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            if (i + 1 == argc)
+                panic("usage: %s [--json results.json] [suite...]\n", argv[0]);
+            json = argv[++i];
+        }
+    }
+
+    if (SDL_Init(0) != 0)
+        panic("bench: %s\n", SDL_GetError());
+
+    printf("%-10s %-28s %8s %17s %17s\n", "suite", "benchmark", "elements", "time", "per element");
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        if (selected(suites[i].name, argc, argv))
+            suites[i].run();
+    }
+
+    if (json != NULL) {
+        if (!write_json(json))
+            panic("bench: could not write %s\n", json);
+        printf("bench: %d results written to %s\n", result_count, json);
+    }
+
+    for (int i = 0; i < result_count; i++)
+        free(results[i].name);
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
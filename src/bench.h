@@ -0,0 +1,37 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "core.h"
+
+#define BENCH_WARMUP 3
+#define BENCH_REPETITIONS 15
+#define BENCH_MAX_RESULTS 256
+
+typedef void (*BenchFunction)(void *data);
+
+// Runs fn BENCH_WARMUP times untimed, then BENCH_REPETITIONS times and
+// returns the median time of one run in nanoseconds
+double bench_run(BenchFunction fn, void *data);
+
+// Same as bench_run for the Lua function at the top of the stack, which is popped
+double bench_run_lua(lua_State *L);
+
+// Prints one result row, ns per element when elements > 0, and keeps it for
+// the JSON output
+void bench_report(const char *suite, const char *name, int elements, double ns);
+
+// lua_State with the standard libraries and no game modules
+lua_State *bench_lua_state();
+
+// SUITES
+void bench_vecarray();
+
+void bench_bindings();
+
+void bench_math();
+
+void bench_scripts();
+
+#endif // BENCH_H
@@ -0,0 +1,74 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+// Cost of one binding call: checking userdata by name against the cached
+// metatable, and reading fields through methods against properties
+#include "bench.h"
+#include "game_math.h"
+
+#define CALLS 1000000
+
+// How every binding checked its arguments before UserdataType
+static int by_name_x(lua_State *L) {
+    Vector *v = luaL_checkudata(L, 1, "Vector");
+    lua_pushnumber(L, v->x);
+    return 1;
+}
+
+static int cached_x(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    lua_pushnumber(L, v->x);
+    return 1;
+}
+
+static void check_by_name(void *data) {
+    lua_State *L = data;
+    for (int i = 0; i < CALLS; i++)
+        luaL_checkudata(L, -1, "Vector");
+}
+
+static void check_cached(void *data) {
+    lua_State *L = data;
+    for (int i = 0; i < CALLS; i++)
+        check_vector(L, -1);
+}
+
+static const char *lua_calls =
+        "local by_name_x, cached_x, n = ...\n"
+        "local v = require('core.vector').new(1, 2)\n"
+        "return {\n"
+        "  {'lua/by_name_x(v)', function() for i = 1, n do local x = by_name_x(v) end end},\n"
+        "  {'lua/cached_x(v)', function() for i = 1, n do local x = cached_x(v) end end},\n"
+        "  {'lua/v:xy()', function() for i = 1, n do local x, y = v:xy() end end},\n"
+        "  {'lua/v.x', function() for i = 1, n do local x = v.x end end},\n"
+        "  {'lua/v:add_(v)', function() for i = 1, n do v:add_(v) end end},\n"
+        "}\n";
+
+void bench_bindings() {
+    lua_State *L = bench_lua_state();
+    api_math_open(L);
+
+    push_vector(L, vector_new(1, 2));
+    bench_report("bindings", "c/luaL_checkudata", CALLS, bench_run(check_by_name, L));
+    bench_report("bindings", "c/check_vector", CALLS, bench_run(check_cached, L));
+    lua_pop(L, 1);
+
+    if (luaL_loadstring(L, lua_calls) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+    lua_pushcfunction(L, by_name_x);
+    lua_pushcfunction(L, cached_x);
+    lua_pushinteger(L, CALLS);
+    if (lua_pcall(L, 3, 1, 0) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+
+    int cases = (int) luaL_len(L, -1);
+    for (int i = 1; i <= cases; i++) {
+        lua_rawgeti(L, -1, i);
+        lua_rawgeti(L, -1, 1);
+        const char *name = lua_tostring(L, -1);
+        lua_rawgeti(L, -2, 2);
+        bench_report("bindings", name, CALLS, bench_run_lua(L));
+        lua_pop(L, 2);
+    }
+
+    lua_close(L);
+}
@@ -0,0 +1,153 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+// game_math functions called from C, and the same operations as a script
+// does them, through the bindings
+#include "bench.h"
+#include "game_math.h"
+
+#define ELEMENTS 4096
+#define CALLS 1000000
+
+// Inputs vary per element and results are summed, so nothing is folded away
+typedef struct {
+    Vector vectors[ELEMENTS];
+    Rect rects[ELEMENTS];
+    double sum;
+} MathData;
+
+static void run_vector_add(void *data) {
+    MathData *d = data;
+    Vector acc = vector_new(0, 0);
+    for (int i = 0; i < ELEMENTS; i++)
+        acc = vector_add(acc, d->vectors[i]);
+    d->sum += acc.x + acc.y;
+}
+
+static void run_vector_sub(void *data) {
+    MathData *d = data;
+    Vector acc = vector_new(0, 0);
+    for (int i = 0; i < ELEMENTS; i++)
+        acc = vector_sub(acc, d->vectors[i]);
+    d->sum += acc.x + acc.y;
+}
+
+static void run_vector_mul_scalar(void *data) {
+    MathData *d = data;
+    double sum = 0;
+    for (int i = 0; i < ELEMENTS; i++) {
+        Vector v = vector_mul_scalar(d->vectors[i], 1.5);
+        sum += v.x + v.y;
+    }
+    d->sum += sum;
+}
+
+static void run_vector_lerp(void *data) {
+    MathData *d = data;
+    Vector acc = vector_new(0, 0);
+    for (int i = 0; i < ELEMENTS; i++)
+        acc = vector_lerp(acc, d->vectors[i], 0.1);
+    d->sum += acc.x + acc.y;
+}
+
+static void run_vector_magnitude(void *data) {
+    MathData *d = data;
+    double sum = 0;
+    for (int i = 0; i < ELEMENTS; i++)
+        sum += vector_magnitude(d->vectors[i]);
+    d->sum += sum;
+}
+
+static void run_vector_distance(void *data) {
+    MathData *d = data;
+    double sum = 0;
+    for (int i = 1; i < ELEMENTS; i++)
+        sum += vector_distance(d->vectors[i - 1], d->vectors[i]);
+    d->sum += sum;
+}
+
+static void run_rect_overlaps(void *data) {
+    MathData *d = data;
+    int hits = 0;
+    Vector side;
+    for (int i = 1; i < ELEMENTS; i++)
+        hits += rect_overlaps(d->rects[i - 1], d->rects[i], &side);
+    d->sum += hits;
+}
+
+static void run_rect_center(void *data) {
+    MathData *d = data;
+    double sum = 0;
+    for (int i = 0; i < ELEMENTS; i++) {
+        Vector c = rect_center(d->rects[i]);
+        sum += c.x + c.y;
+    }
+    d->sum += sum;
+}
+
+static const struct {
+    const char *name;
+    BenchFunction fn;
+} math_benchmarks[] = {
+        {"c/vector_add",        run_vector_add},
+        {"c/vector_sub",        run_vector_sub},
+        {"c/vector_mul_scalar", run_vector_mul_scalar},
+        {"c/vector_lerp",       run_vector_lerp},
+        {"c/vector_magnitude",  run_vector_magnitude},
+        {"c/vector_distance",   run_vector_distance},
+        {"c/rect_overlaps",     run_rect_overlaps},
+        {"c/rect_center",       run_rect_center},
+};
+
+static const char *lua_calls =
+        "local n = ...\n"
+        "local Vector, Rect = require('core.vector'), require('core.rect')\n"
+        "local a, b = Vector.new(1, 2), Vector.new(3, 4)\n"
+        "local r, s = Rect.new(0, 0, 64, 64), Rect.new(32, 32, 64, 64)\n"
+        "return {\n"
+        "  {'lua/Vector.new(x, y)', function() for i = 1, n do local v = Vector.new(i, i) end end},\n"
+        "  {'lua/a + b', function() for i = 1, n do local v = a + b end end},\n"
+        "  {'lua/a - b', function() for i = 1, n do local v = a - b end end},\n"
+        "  {'lua/a * 2', function() for i = 1, n do local v = a * 2 end end},\n"
+        "  {'lua/Vector.distance(a, b)', function() for i = 1, n do local d = Vector.distance(a, b) end end},\n"
+        "  {'lua/r:position()', function() for i = 1, n do local p = r:position() end end},\n"
+        "  {'lua/r:center()', function() for i = 1, n do local c = r:center() end end},\n"
+        "  {'lua/r:overlaps(s)', function() for i = 1, n do local hit, side = r:overlaps(s) end end},\n"
+        "}\n";
+
+void bench_math() {
+    MathData *d = malloc(sizeof(MathData));
+    for (int i = 0; i < ELEMENTS; i++) {
+        d->vectors[i] = vector_new(i % 640, i % 480);
+        d->rects[i] = rect_new(i % 97 * 8, i % 89 * 8, 64, 64);
+    }
+    d->sum = 0;
+
+    for (size_t i = 0; i < sizeof(math_benchmarks) / sizeof(math_benchmarks[0]); i++)
+        bench_report("math", math_benchmarks[i].name, ELEMENTS, bench_run(math_benchmarks[i].fn, d));
+
+    // Printed so the compiler keeps the work
+    if (d->sum == 0.123)
+        printf("%f\n", d->sum);
+    free(d);
+
+    lua_State *L = bench_lua_state();
+    api_math_open(L);
+
+    if (luaL_loadstring(L, lua_calls) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+    lua_pushinteger(L, CALLS);
+    if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+
+    int cases = (int) luaL_len(L, -1);
+    for (int i = 1; i <= cases; i++) {
+        lua_rawgeti(L, -1, i);
+        lua_rawgeti(L, -1, 1);
+        const char *name = lua_tostring(L, -1);
+        lua_rawgeti(L, -2, 2);
+        bench_report("math", name, CALLS, bench_run_lua(L));
+        lua_pop(L, 2);
+    }
+
+    lua_close(L);
+}
@@ -0,0 +1,99 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+// The per frame loops of the game scripts, run from scripts/ as the game
+// requires them. Drawing, sound and tile layers are not linked, they are
+// stubbed in Lua since the loops only queue work for them. The real tile
+// layer takes sprites, which need a renderer, so the scroll grid case times
+// only the script side of building the grid, not core.tilelayer.
+#include "bench.h"
+#include "game_math.h"
+#include "collision.h"
+
+#define FRAMES 60
+#define ENEMIES 200
+#define TORPEDOES 200
+
+static const char *lua_scripts =
+        "local frames, enemy_count, torpedo_count = ...\n"
+        "package.path = './scripts/?.lua;' .. package.path\n"
+        "package.preload['core.draw'] = function() return {draw_sprite = function() end} end\n"
+        "package.preload['core.sound'] = function() return {play_sfx = function() end} end\n"
+        "package.preload['core.tilelayer'] = function()\n"
+        "  local Layer = {}\n"
+        "  Layer.__index = Layer\n"
+        "  function Layer:set_tile(col, row, sprite) self.tiles[(row - 1) * self.cols + col] = sprite end\n"
+        "  return {new = function(x, y, cols, rows) return setmetatable({cols = cols, rows = rows, tiles = {}}, Layer) end}\n"
+        "end\n"
+        "RANDOM_SEED = 1\n"
+        "COLLISION_TORPEDO, COLLISION_ENEMY = 1, 2\n"
+        "colliders = {}\n"
+        "local Collision = require('core.collision')\n"
+        "local Enemy = require('enemy')\n"
+        "local TorpedoGun = require('torpedo')\n"
+        "local ScrollGrid = require('scroll_grid')\n"
+        "local world = Collision.world(64)\n"
+        "\n"
+        "local enemies = {}\n"
+        "for i = 1, enemy_count do\n"
+        "  local paths = {}\n"
+        "  for p = 1, 8 do\n"
+        "    paths[p] = Rect.new((i * 37 + p * 151) % 1440, (i * 53 + p * 97) % 1024, 64, 64)\n"
+        "  end\n"
+        "  enemies[i] = Enemy.new(nil, 64, paths, nil, nil, world)\n"
+        "end\n"
+        "\n"
+        "local gun = TorpedoGun.new(nil, 16, nil, 0, world)\n"
+        "for i = 1, torpedo_count do\n"
+        "  table.insert(gun.torpedos, Torpedo.new(nil, i * 7 % 1440, 1024, 16, world))\n"
+        "end\n"
+        "local direction = Vector.new(0, 1)\n"
+        "\n"
+        "local grid = ScrollGrid.new(0, 0, 1440, 1024, 32, {A = {1, 2}, B = {3}, C = {4, 5}, D = {6}})\n"
+        "grid:create()\n"
+        "\n"
+        "return {\n"
+        "  {'enemy.lua/Enemy:update', enemy_count * frames, function()\n"
+        "    for f = 1, frames do\n"
+        "      for idx, e in ipairs(enemies) do e:update(0.05, 1 / 60, 50) end\n"
+        "    end\n"
+        "  end},\n"
+        "  {'torpedo.lua/TorpedoGun:update', torpedo_count * frames, function()\n"
+        "    -- Back to the bottom, so every run moves the same torpedoes\n"
+        "    for i, torpedo in ipairs(gun.torpedos) do torpedo.transform:set_position(i * 7 % 1440, 1024) end\n"
+        "    for f = 1, frames do gun:update(direction, 1 / 60, 800) end\n"
+        "  end},\n"
+        "  {'scroll_grid.lua/create (script side)', grid.layer.cols * grid.layer.rows, function() grid:create() end},\n"
+        "  {'game.lua/query_pairs', enemy_count + torpedo_count, function()\n"
+        "    local hits = {}\n"
+        "    for f = 1, frames do world:query_pairs(COLLISION_TORPEDO, COLLISION_ENEMY, hits) end\n"
+        "  end},\n"
+        "}\n";
+
+void bench_scripts() {
+    lua_State *L = bench_lua_state();
+    api_math_open(L);
+    api_collision_open(L);
+
+    if (luaL_loadstring(L, lua_scripts) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+    lua_pushinteger(L, FRAMES);
+    lua_pushinteger(L, ENEMIES);
+    lua_pushinteger(L, TORPEDOES);
+    if (lua_pcall(L, 3, 1, 0) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+
+    int cases = (int) luaL_len(L, -1);
+    for (int i = 1; i <= cases; i++) {
+        lua_rawgeti(L, -1, i);
+        lua_rawgeti(L, -1, 2);
+        int elements = (int) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        lua_rawgeti(L, -1, 1);
+        const char *name = lua_tostring(L, -1);
+        lua_rawgeti(L, -2, 3);
+        bench_report("scripts", name, elements, bench_run_lua(L));
+        lua_pop(L, 2);
+    }
+
+    lua_close(L);
+}
@@ -0,0 +1,128 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+// VecArray kernels per backend against the per element Vector path in Lua
+#include "bench.h"
+#include "vecarray.h"
+
+static const int sizes[] = {1000, 10000, 100000};
+
+typedef struct {
+    const VecArrayKernels *kernels;
+    VecArray a;
+    VecArray b;
+    float *out;
+} KernelData;
+
+static void run_add(void *data) {
+    KernelData *d = data;
+    d->kernels->add(d->a.x, d->a.y, d->a.count, 0.5f, -0.5f);
+}
+
+static void run_scale(void *data) {
+    KernelData *d = data;
+    d->kernels->scale(d->a.x, d->a.y, d->a.count, 1.0001f);
+}
+
+static void run_lerp(void *data) {
+    KernelData *d = data;
+    d->kernels->lerp(d->a.x, d->a.y, d->b.x, d->b.y, d->a.count, 0.1f);
+}
+
+static void run_clamp(void *data) {
+    KernelData *d = data;
+    d->kernels->clamp(d->a.x, d->a.y, d->a.count, 0, 0, 640, 480);
+}
+
+static void run_distance(void *data) {
+    KernelData *d = data;
+    d->kernels->distance(d->a.x, d->a.y, d->a.count, 320, 240, d->out);
+}
+
+static const struct {
+    const char *name;
+    BenchFunction fn;
+} kernel_benchmarks[] = {
+        {"add",      run_add},
+        {"scale",    run_scale},
+        {"lerp",     run_lerp},
+        {"clamp",    run_clamp},
+        {"distance", run_distance},
+};
+
+static void bench_kernels(int n) {
+    KernelData d;
+    if (!vecarray_init(&d.a, n) || !vecarray_init(&d.b, n))
+        panic("bench: out of memory\n");
+    d.out = malloc(sizeof(float) * n);
+
+    for (int i = 0; i < n; i++) {
+        d.a.x[i] = (float) (i % 640);
+        d.a.y[i] = (float) (i % 480);
+        d.b.x[i] = (float) ((i * 7) % 640);
+        d.b.y[i] = (float) ((i * 3) % 480);
+    }
+
+    for (int backend = 0; backend < VECARRAY_BACKENDS; backend++) {
+        d.kernels = vecarray_kernels(backend);
+        if (d.kernels == NULL)
+            continue;
+
+        for (size_t i = 0; i < SDL_arraysize(kernel_benchmarks); i++) {
+            char name[64];
+            SDL_snprintf(name, sizeof(name), "%s/%s", d.kernels->name, kernel_benchmarks[i].name);
+            bench_report("vecarray", name, n, bench_run(kernel_benchmarks[i].fn, &d));
+        }
+    }
+
+    free(d.out);
+    vecarray_release(&d.a);
+    vecarray_release(&d.b);
+}
+
+// The same lerp written the way scripts do it today, one Vector userdata
+// per element, against a single VecArray call from Lua
+static const char *lua_setup =
+        "local Vector = require('core.vector')\n"
+        "local VecArray = require('core.vecarray')\n"
+        "local n = ...\n"
+        "local vs, ts = {}, {}\n"
+        "local a, b = VecArray.new(n), VecArray.new(n)\n"
+        "for i = 1, n do\n"
+        "  vs[i] = Vector.new(i % 640, i % 480)\n"
+        "  ts[i] = Vector.new(i * 7 % 640, i * 3 % 480)\n"
+        "  a:set(i, i % 640, i % 480)\n"
+        "  b:set(i, i * 7 % 640, i * 3 % 480)\n"
+        "end\n"
+        "local function per_vector()\n"
+        "  for i = 1, n do vs[i]:lerp_(ts[i], 0.1) end\n"
+        "end\n"
+        "local function bulk()\n"
+        "  a:lerp(b, 0.1)\n"
+        "end\n"
+        "return per_vector, bulk\n";
+
+static void bench_lua(int n) {
+    lua_State *L = bench_lua_state();
+    api_math_open(L);
+    api_vecarray_open(L);
+
+    if (luaL_loadstring(L, lua_setup) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+    lua_pushinteger(L, n);
+    if (lua_pcall(L, 1, 2, 0) != LUA_OK)
+        panic("bench: %s\n", lua_tostring(L, -1));
+
+    double bulk = bench_run_lua(L);
+    double per_vector = bench_run_lua(L);
+    bench_report("vecarray", "lua/Vector:lerp_", n, per_vector);
+    bench_report("vecarray", "lua/VecArray:lerp", n, bulk);
+
+    lua_close(L);
+}
+
+void bench_vecarray() {
+    for (size_t i = 0; i < SDL_arraysize(sizes); i++) {
+        bench_kernels(sizes[i]);
+        bench_lua(sizes[i]);
+    }
+}
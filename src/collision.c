@@ -0,0 +1,381 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "collision.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static void *grow(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (ptr == NULL)
+        panic("collision: out of memory\n");
+    return ptr;
+}
+
+static int cell_of(const CollisionWorld *world, float v) {
+    return (int) floorf(v / world->cell_size);
+}
+
+static int bucket_of(int cx, int cy) {
+    return (int) (((Uint32) cx * 73856093u) ^ ((Uint32) cy * 19349663u)) & (COLLISION_BUCKETS - 1);
+}
+
+void collision_world_init(CollisionWorld *world, float cell_size) {
+    memset(world, 0, sizeof(CollisionWorld));
+    world->cell_size = cell_size;
+    world->dirty = true;
+}
+
+void collision_world_free(CollisionWorld *world) {
+    free(world->x);
+    free(world->y);
+    free(world->w);
+    free(world->h);
+    free(world->mask);
+    free(world->id);
+    free(world->free_list);
+    free(world->entries);
+    free(world->candidates);
+    free(world->candidate_x);
+    free(world->candidate_y);
+    free(world->candidate_right);
+    free(world->candidate_bottom);
+    memset(world, 0, sizeof(CollisionWorld));
+}
+
+int collision_add(CollisionWorld *world, Rect rect, Uint32 mask, lua_Integer id) {
+    int body;
+    if (world->free_count > 0) {
+        body = world->free_list[--world->free_count];
+    } else {
+        if (world->count == world->capacity) {
+            int capacity = world->capacity == 0 ? COLLISION_INITIAL_CAPACITY : world->capacity * 2;
+            world->x = grow(world->x, sizeof(float) * capacity);
+            world->y = grow(world->y, sizeof(float) * capacity);
+            world->w = grow(world->w, sizeof(float) * capacity);
+            world->h = grow(world->h, sizeof(float) * capacity);
+            world->mask = grow(world->mask, sizeof(Uint32) * capacity);
+            world->id = grow(world->id, sizeof(lua_Integer) * capacity);
+            world->free_list = grow(world->free_list, sizeof(int) * capacity);
+            world->capacity = capacity;
+        }
+        body = world->count++;
+    }
+
+    world->x[body] = (float) rect.x;
+    world->y[body] = (float) rect.y;
+    world->w[body] = (float) rect.w;
+    world->h[body] = (float) rect.h;
+    world->mask[body] = mask;
+    world->id[body] = id;
+    world->live++;
+    world->dirty = true;
+    return body;
+}
+
+void collision_move(CollisionWorld *world, int body, float x, float y) {
+    world->x[body] = x;
+    world->y[body] = y;
+    world->dirty = true;
+}
+
+void collision_remove(CollisionWorld *world, int body) {
+    world->mask[body] = 0;
+    world->free_list[world->free_count++] = body;
+    world->live--;
+    world->dirty = true;
+}
+
+// Counting sort of every (body, cell) into the buckets, two passes over the bodies
+static void collision_rebuild(CollisionWorld *world) {
+    int *start = world->bucket_start;
+    memset(start, 0, sizeof(world->bucket_start));
+
+    int total = 0;
+    for (int i = 0; i < world->count; i++) {
+        if (world->mask[i] == 0)
+            continue;
+        int cx0 = cell_of(world, world->x[i]), cx1 = cell_of(world, world->x[i] + world->w[i]);
+        int cy0 = cell_of(world, world->y[i]), cy1 = cell_of(world, world->y[i] + world->h[i]);
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++)
+                start[bucket_of(cx, cy)]++;
+        total += (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+    }
+
+    // Each bucket start now holds its end, decremented below as entries go in
+    for (int b = 1; b < COLLISION_BUCKETS; b++)
+        start[b] += start[b - 1];
+    start[COLLISION_BUCKETS] = total;
+
+    if (total > world->entry_capacity) {
+        world->entry_capacity = total * 2;
+        world->entries = grow(world->entries, sizeof(CollisionEntry) * world->entry_capacity);
+    }
+
+    // Filled back to front so every bucket lists its bodies in slot order
+    for (int i = world->count - 1; i >= 0; i--) {
+        if (world->mask[i] == 0)
+            continue;
+        int cx0 = cell_of(world, world->x[i]), cx1 = cell_of(world, world->x[i] + world->w[i]);
+        int cy0 = cell_of(world, world->y[i]), cy1 = cell_of(world, world->y[i] + world->h[i]);
+        for (int cy = cy1; cy >= cy0; cy--) {
+            for (int cx = cx1; cx >= cx0; cx--) {
+                CollisionEntry *e = &world->entries[--start[bucket_of(cx, cy)]];
+                e->body = i;
+                e->cx = cx;
+                e->cy = cy;
+            }
+        }
+    }
+
+    world->entry_count = total;
+    world->dirty = false;
+}
+
+static void reserve_candidates(CollisionWorld *world, int count) {
+    if (count <= world->candidate_capacity)
+        return;
+
+    int capacity = count * 2;
+    world->candidates = grow(world->candidates, sizeof(int) * capacity);
+    world->candidate_x = grow(world->candidate_x, sizeof(float) * capacity);
+    world->candidate_y = grow(world->candidate_y, sizeof(float) * capacity);
+    world->candidate_right = grow(world->candidate_right, sizeof(float) * capacity);
+    world->candidate_bottom = grow(world->candidate_bottom, sizeof(float) * capacity);
+    world->candidate_capacity = capacity;
+}
+
+// Tests one rect against every gathered candidate without branches, writing
+// the overlapping ones to the front of candidates and returning how many
+static int narrow_phase(CollisionWorld *world, int n, float left, float top, float right, float bottom) {
+    int *candidates = world->candidates;
+    const float *cx = world->candidate_x, *cy = world->candidate_y;
+    const float *cr = world->candidate_right, *cb = world->candidate_bottom;
+    int hits = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128 l = _mm_set1_ps(left), t = _mm_set1_ps(top);
+    __m128 r = _mm_set1_ps(right), b = _mm_set1_ps(bottom);
+    for (; i + 4 <= n; i += 4) {
+        __m128 overlap = _mm_and_ps(
+                _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(cx + i), r), _mm_cmpge_ps(_mm_loadu_ps(cr + i), l)),
+                _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(cy + i), b), _mm_cmpge_ps(_mm_loadu_ps(cb + i), t)));
+        int bits = _mm_movemask_ps(overlap);
+        while (bits) {
+            int lane = __builtin_ctz(bits);
+            candidates[hits++] = candidates[i + lane];
+            bits &= bits - 1;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        bool overlap = (cx[i] <= right) & (cr[i] >= left) & (cy[i] <= bottom) & (cb[i] >= top);
+        candidates[hits] = candidates[i];
+        hits += overlap;
+    }
+    return hits;
+}
+
+int collision_query_pairs(CollisionWorld *world, Uint32 layer_a, Uint32 layer_b, CollisionPairFunction fn, void *data) {
+    if (world->dirty)
+        collision_rebuild(world);
+
+    int pairs = 0;
+    for (int a = 0; a < world->count; a++) {
+        if ((world->mask[a] & layer_a) == 0)
+            continue;
+
+        float left = world->x[a], top = world->y[a];
+        float right = left + world->w[a], bottom = top + world->h[a];
+        bool a_in_b = (world->mask[a] & layer_b) != 0;
+
+        for (int cy = cell_of(world, top); cy <= cell_of(world, bottom); cy++) {
+            for (int cx = cell_of(world, left); cx <= cell_of(world, right); cx++) {
+                int bucket = bucket_of(cx, cy);
+                int first = world->bucket_start[bucket], last = world->bucket_start[bucket + 1];
+                reserve_candidates(world, last - first);
+
+                // Gather the bodies of this cell in layer_b, other cells share the bucket
+                int n = 0;
+                for (int e = first; e < last; e++) {
+                    const CollisionEntry *entry = &world->entries[e];
+                    int b = entry->body;
+                    if (entry->cx != cx || entry->cy != cy || b == a || (world->mask[b] & layer_b) == 0)
+                        continue;
+                    // When both bodies are in both layers the pair is found from each side
+                    if (a_in_b && b < a && (world->mask[b] & layer_a) != 0)
+                        continue;
+                    world->candidates[n] = b;
+                    world->candidate_x[n] = world->x[b];
+                    world->candidate_y[n] = world->y[b];
+                    world->candidate_right[n] = world->x[b] + world->w[b];
+                    world->candidate_bottom[n] = world->y[b] + world->h[b];
+                    n++;
+                }
+
+                int hits = narrow_phase(world, n, left, top, right, bottom);
+                for (int h = 0; h < hits; h++) {
+                    int b = world->candidates[h];
+                    // Bodies sharing several cells are reported only from the cell
+                    // holding the top left corner of their overlap
+                    if (cell_of(world, fmaxf(left, world->x[b])) != cx || cell_of(world, fmaxf(top, world->y[b])) != cy)
+                        continue;
+                    fn(world->id[a], world->id[b], data);
+                    pairs++;
+                }
+            }
+        }
+    }
+    return pairs;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static UserdataType WorldType = {"CollisionWorld"};
+
+static CollisionWorld *check_world(lua_State *L) {
+    CollisionWorld *world = udata_check(L, 1, &WorldType);
+    if (world->cell_size <= 0)
+        luaL_argerror(L, 1, "released world");
+    return world;
+}
+
+static int check_body(lua_State *L, CollisionWorld *world, int idx) {
+    lua_Integer body = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, body >= 1 && body <= world->count && world->mask[body - 1] != 0, idx, "invalid body");
+    return (int) body - 1;
+}
+
+// Collision.world(cell_size) creates a world with an empty spatial hash
+int api_collision_world(lua_State *L) {
+    float cell_size = (float) luaL_optnumber(L, 1, 64);
+    luaL_argcheck(L, cell_size > 0, 1, "cell size must be positive");
+
+    CollisionWorld *world = udata_new(L, sizeof(CollisionWorld), &WorldType);
+    collision_world_init(world, cell_size);
+    return 1;
+}
+
+// world:add(rect, mask, id) or world:add(x, y, w, h, mask, id) returns the body,
+// id defaults to the body itself
+int api_collision_add(lua_State *L) {
+    CollisionWorld *world = check_world(L);
+    Rect rect;
+    int arg = 3;
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        rect = *check_rect(L, 2);
+    } else {
+        rect = rect_new(luaL_checknumber(L, 2), luaL_checknumber(L, 3), luaL_checknumber(L, 4), luaL_checknumber(L, 5));
+        arg = 6;
+    }
+
+    Uint32 mask = (Uint32) luaL_checkinteger(L, arg);
+    luaL_argcheck(L, mask != 0, arg, "mask must have at least one layer");
+    // Arguments are all checked first, an error after the insert would leave
+    // a body nothing can remove
+    bool has_id = !lua_isnoneornil(L, arg + 1);
+    lua_Integer id = has_id ? luaL_checkinteger(L, arg + 1) : 0;
+    int body = collision_add(world, rect, mask, id);
+    if (!has_id)
+        world->id[body] = body + 1;
+    lua_pushinteger(L, body + 1);
+    return 1;
+}
+
+// world:move(body, x, y)
+int api_collision_move(lua_State *L) {
+    CollisionWorld *world = check_world(L);
+    int body = check_body(L, world, 2);
+    collision_move(world, body, (float) luaL_checknumber(L, 3), (float) luaL_checknumber(L, 4));
+    return 0;
+}
+
+int api_collision_remove(lua_State *L) {
+    CollisionWorld *world = check_world(L);
+    collision_remove(world, check_body(L, world, 2));
+    return 0;
+}
+
+typedef struct {
+    lua_State *L;
+    int table;
+    int index;
+} PairOutput;
+
+static void push_pair(lua_Integer a, lua_Integer b, void *data) {
+    PairOutput *out = data;
+    lua_pushinteger(out->L, a);
+    lua_rawseti(out->L, out->table, ++out->index);
+    lua_pushinteger(out->L, b);
+    lua_rawseti(out->L, out->table, ++out->index);
+}
+
+// world:query_pairs(layer_a, layer_b, out) fills out with the ids of every
+// overlapping pair as {a1, b1, a2, b2, ...} and returns the pair count.
+// out is reused between frames, entries past the last pair are left as they are.
+int api_collision_query_pairs(lua_State *L) {
+    CollisionWorld *world = check_world(L);
+    Uint32 layer_a = (Uint32) luaL_checkinteger(L, 2);
+    Uint32 layer_b = (Uint32) luaL_checkinteger(L, 3);
+    luaL_checktype(L, 4, LUA_TTABLE);
+
+    PairOutput out = {L, 4, 0};
+    lua_pushinteger(L, collision_query_pairs(world, layer_a, layer_b, push_pair, &out));
+    return 1;
+}
+
+int api_collision_count(lua_State *L) {
+    CollisionWorld *world = check_world(L);
+    lua_pushinteger(L, world->live);
+    return 1;
+}
+
+int api_collision_gc(lua_State *L) {
+    CollisionWorld *world = udata_check(L, 1, &WorldType);
+    collision_world_free(world);
+    return 0;
+}
+
+int api_collision_tostring(lua_State *L) {
+    CollisionWorld *world = udata_check(L, 1, &WorldType);
+    lua_pushfstring(L, "CollisionWorld<bodies: %d, cell: %f>", world->live, (lua_Number) world->cell_size);
+    return 1;
+}
+
+static const struct luaL_Reg world_methods[] = {
+        {"add",         api_collision_add},
+        {"move",        api_collision_move},
+        {"remove",      api_collision_remove},
+        {"query_pairs", api_collision_query_pairs},
+        {"count",       api_collision_count},
+        {"__gc",        api_collision_gc},
+        {"__tostring",  api_collision_tostring},
+        {NULL, NULL}
+};
+
+static const struct luaL_Reg collision_funcs[] = {
+        {"world", api_collision_world},
+        {NULL, NULL}
+};
+
+int module_collision(lua_State *L) {
+    udata_register(L, &WorldType);
+    luaL_setfuncs(L, world_methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    luaL_setfuncs(L, collision_funcs, 0);
+    return 1;
+}
+
+void api_collision_open(lua_State *L) {
+    luaL_requiref(L, "core.collision", module_collision, 0);
+    lua_pop(L, 1);
+}
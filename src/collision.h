@@ -0,0 +1,69 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "core.h"
+#include "game_math.h"
+
+// Cells are hashed into a fixed number of buckets, a power of two
+#define COLLISION_BUCKETS 1024
+#define COLLISION_INITIAL_CAPACITY 64
+
+// One body in one cell of the spatial hash
+typedef struct {
+    int body;
+    int cx;
+    int cy;
+} CollisionEntry;
+
+// Bodies are stored as structure of arrays and referred to by slot index.
+// The spatial hash is rebuilt lazily on the first query after any change.
+typedef struct {
+    float cell_size;
+    int count;                  // Slots in use or released, never shrinks
+    int capacity;
+    int live;
+    float *x;
+    float *y;
+    float *w;
+    float *h;
+    Uint32 *mask;               // Layers the body belongs to, 0 for free slots
+    lua_Integer *id;            // User id reported by queries
+    int *free_list;
+    int free_count;
+
+    bool dirty;
+    int bucket_start[COLLISION_BUCKETS + 1];
+    CollisionEntry *entries;
+    int entry_count;
+    int entry_capacity;
+
+    // Narrow phase scratch, one row per candidate of the current cell
+    int *candidates;
+    float *candidate_x;
+    float *candidate_y;
+    float *candidate_right;
+    float *candidate_bottom;
+    int candidate_capacity;
+} CollisionWorld;
+
+typedef void (*CollisionPairFunction)(lua_Integer a, lua_Integer b, void *data);
+
+void collision_world_init(CollisionWorld *world, float cell_size);
+
+void collision_world_free(CollisionWorld *world);
+
+int collision_add(CollisionWorld *world, Rect rect, Uint32 mask, lua_Integer id);
+
+void collision_move(CollisionWorld *world, int body, float x, float y);
+
+void collision_remove(CollisionWorld *world, int body);
+
+// Calls fn once for every overlapping pair of a body in layer_a and a body
+// in layer_b, touching edges included. Returns the number of pairs.
+int collision_query_pairs(CollisionWorld *world, Uint32 layer_a, Uint32 layer_b, CollisionPairFunction fn, void *data);
+
+void api_collision_open(lua_State *L);
+
+#endif // COLLISION_H
@@ -1,30 +1,159 @@
 // Copyright 2023 Lucas Klassmann
 // License: Apache License 2.0
 #include "fonts.h"
+#include "archive.h"
 
+UserdataType FontType = {"Font"};
 
-Font *font_load(const char *filename, int size) {
-    Font *f = malloc(sizeof(Font));
-    f->font = TTF_OpenFont(filename, size);
+
+static Font *font_new(TTF_Font *font) {
+    if (font == NULL) {
+        printf("error on loading font: %s\n", TTF_GetError());
+        return NULL;
+    }
+
+    Font *f = calloc(1, sizeof(Font));
+    f->font = font;
     f->height = TTF_FontHeight(f->font);
     return f;
 }
 
-SDL_Surface *font_render_shaded(Font *f, const char *text, SDL_Color fg, SDL_Color bg) {
-    return TTF_RenderText_Shaded(f->font, text, fg, bg);
+Font *font_load(const char *filename, int size) {
+    return font_new(TTF_OpenFontRW(archive_rw(filename), 1, size));
+}
+
+Font *font_load_memory(void *data, size_t data_size, int size) {
+    Font *f = font_new(TTF_OpenFontRW(SDL_RWFromConstMem(data, (int) data_size), 1, size));
+    if (f == NULL) {
+        SDL_free(data);
+        return NULL;
+    }
+
+    // The font reads glyphs from the buffer for as long as it is open
+    f->data = data;
+    return f;
+}
+
+void font_free(Font *f) {
+    if (f->atlas != NULL)
+        SDL_DestroyTexture(f->atlas);
+    TTF_CloseFont(f->font);
+    SDL_free(f->data);
+    free(f);
 }
 
-SDL_Surface *font_render_solid(Font *f, const char *text, SDL_Color fg) {
-    return TTF_RenderText_Solid(f->font, text, fg);
+static int next_power_of_two(int v) {
+    int p = 1;
+    while (p < v)
+        p <<= 1;
+    return p;
+}
+
+static bool font_create_atlas(Font *f, SDL_Renderer *renderer) {
+    // Room for a 16x16 grid of glyphs as tall as the font
+    f->atlas_size = next_power_of_two(f->height * 16);
+    f->atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                 f->atlas_size, f->atlas_size);
+    if (f->atlas == NULL) {
+        printf("error on creating font atlas: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(f->atlas, SDL_BLENDMODE_BLEND);
+    f->pen_x = 0;
+    f->pen_y = 0;
+    f->row_height = 0;
+    return true;
+}
+
+Glyph *font_glyph(Font *f, SDL_Renderer *renderer, unsigned char ch) {
+    Glyph *g = &f->glyphs[ch];
+    if (g->cached)
+        return g->missing ? NULL : g;
+
+    g->cached = true;
+    g->missing = true;
+
+    if (f->atlas == NULL && !font_create_atlas(f, renderer))
+        return NULL;
+
+    int min_x, max_x, min_y, max_y, advance;
+    if (TTF_GlyphMetrics(f->font, ch, &min_x, &max_x, &min_y, &max_y, &advance) == -1)
+        return NULL;
+
+    g->advance = advance;
+    g->offset_x = min_x < 0 ? min_x : 0;
+
+    // Rendered white so the vertex color tints it to the requested color
+    SDL_Color white = {255, 255, 255, SDL_ALPHA_OPAQUE};
+    SDL_Surface *sur = TTF_RenderGlyph_Blended(f->font, ch, white);
+    if (sur == NULL)
+        return NULL;
+
+    // Shelf packing, a new row starts when the current one is full
+    if (f->pen_x + sur->w > f->atlas_size) {
+        f->pen_x = 0;
+        f->pen_y += f->row_height;
+        f->row_height = 0;
+    }
+
+    if (f->pen_y + sur->h > f->atlas_size || sur->w > f->atlas_size) {
+        printf("font atlas is full, glyph %d skipped\n", ch);
+        SDL_FreeSurface(sur);
+        return NULL;
+    }
+
+    SDL_Rect rect = {f->pen_x, f->pen_y, sur->w, sur->h};
+    SDL_UpdateTexture(f->atlas, &rect, sur->pixels, sur->pitch);
+    SDL_FreeSurface(sur);
+
+    f->pen_x += rect.w;
+    if (rect.h > f->row_height)
+        f->row_height = rect.h;
+
+    g->rect = rect;
+    g->missing = false;
+    return g;
+}
+
+int font_kerning(Font *f, unsigned char prev, unsigned char ch) {
+    if (prev >= FONT_KERNING_GLYPHS || ch >= FONT_KERNING_GLYPHS)
+        return 0;
+
+    Uint8 bit = 1 << (ch & 7);
+    if ((f->kerning_known[prev][ch >> 3] & bit) == 0) {
+        f->kerning[prev][ch] = prev < ' ' || ch < ' ' ? 0 : TTF_GetFontKerningSizeGlyphs(f->font, prev, ch);
+        f->kerning_known[prev][ch >> 3] |= bit;
+    }
+
+    return f->kerning[prev][ch];
+}
+
+static void destroy_font(void *data) {
+    font_free(data);
+}
+
+Asset *font_register(const char *key, Font *f) {
+    return asset_add(ASSET_FONT, key, f, sizeof(Font), destroy_font);
 }
 
 int api_font_load(lua_State *L) {
     const char *filename = luaL_checklstring(L, 1, NULL);
     int font_size = luaL_checkinteger(L, 2);
 
-    Font *font = font_load(filename, font_size);
+    const char *key = lua_pushfstring(L, ASSET_KEY_FONT, filename, font_size);
+    Asset *asset = asset_find(key);
 
-    lua_pushlightuserdata(L, font);
+    if (asset == NULL) {
+        Font *font = font_load(filename, font_size);
+        if (font == NULL) {
+            lua_pushnil(L);
+            return 1;
+        }
+        asset = font_register(key, font);
+    }
+
+    asset_push_handle(L, asset, asset->data, &FontType);
     return 1;
 }
 
@@ -40,6 +169,8 @@ int module_font(lua_State *L) {
 }
 
 void api_font_open(lua_State *L) {
+    asset_new_metatable(L, &FontType);
+
     luaL_requiref(L, "core.font", module_font, 0);
     lua_pop(L, 1);
 }
\ No newline at end of file
@@ -4,18 +4,54 @@
 #define FONTS_H
 
 #include "core.h"
+#include "assets.h"
+
+#define FONT_GLYPHS 256
+#define FONT_KERNING_GLYPHS 128
+
+typedef struct {
+    bool cached;
+    bool missing;
+    SDL_Rect rect;      // Region in the atlas texture
+    int offset_x;       // Where the rect starts relative to the pen position
+    int advance;
+} Glyph;
 
 typedef struct {
     TTF_Font *font;
     int height;
+    void *data;         // File contents when loaded from memory, freed with the font
+
+    // Glyph atlas, created and filled on demand by font_glyph
+    SDL_Texture *atlas;
+    int atlas_size;
+    int pen_x;
+    int pen_y;
+    int row_height;
+    Glyph glyphs[FONT_GLYPHS];
+
+    // Filled a pair at a time on first use, a bit per pair tells it is known
+    Uint8 kerning_known[FONT_KERNING_GLYPHS][FONT_KERNING_GLYPHS / 8];
+    Sint16 kerning[FONT_KERNING_GLYPHS][FONT_KERNING_GLYPHS];
 } Font;
 
 
 Font *font_load(const char *filename, int size);
 
-SDL_Surface *font_render_shaded(Font *f, const char *text, SDL_Color fg, SDL_Color bg);
+// Opens a font from file contents read elsewhere (SDL_LoadFile), the font takes
+// ownership of data
+Font *font_load_memory(void *data, size_t data_size, int size);
+
+void font_free(Font *f);
+
+// Registers a loaded font in the asset list under key
+Asset *font_register(const char *key, Font *f);
+
+Glyph *font_glyph(Font *f, SDL_Renderer *renderer, unsigned char ch);
+
+int font_kerning(Font *f, unsigned char prev, unsigned char ch);
 
-SDL_Surface *font_render_solid(Font *f, const char *text, SDL_Color fg);
+extern UserdataType FontType;
 
 void api_font_open(lua_State *L);
 
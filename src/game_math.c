@@ -115,181 +115,267 @@ Vector rect_center(Rect r) {
 ///// LUA API
 ///////////////////////////////////////////////////////////////////////////////
 
+UserdataType VectorType = {"Vector"};
+UserdataType RectType = {"Rect"};
+
+void push_vector(lua_State *L, Vector v) {
+    Vector *ptr = udata_new(L, sizeof(Vector), &VectorType);
+    *ptr = v;
+}
+
+void push_rect(lua_State *L, Rect r) {
+    Rect *ptr = udata_new(L, sizeof(Rect), &RectType);
+    *ptr = r;
+}
+
+Vector *check_vector(lua_State *L, int idx) {
+    return udata_check(L, idx, &VectorType);
+}
+
+Rect *check_rect(lua_State *L, int idx) {
+    return udata_check(L, idx, &RectType);
+}
+
 int api_vector_new(lua_State *L) {
     double a = luaL_checknumber(L, 1);
     double b = luaL_checknumber(L, 2);
-    Vector v = vector_new(a, b);
-
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    push_vector(L, vector_new(a, b));
     return 1;
 }
 
+// Arithmetic metamethods take vector op vector, vector op number or number op vector.
+// Only one operand needs its type checked, Lua calls them with at least one vector.
 int api_vector_add(lua_State *L) {
-    Vector v;
-
-    if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TUSERDATA) {
-        lua_Number scalar = luaL_checknumber(L, 1);
-        Vector *a = luaL_checkudata(L, 2, "Vector");
-        v = vector_add_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TNUMBER) {
-        Vector *a = luaL_checkudata(L, 1, "Vector");
-        lua_Number scalar = luaL_checknumber(L, 2);
-        v = vector_add_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TUSERDATA) {
-        Vector *v1 = luaL_checkudata(L, 1, "Vector");
-        Vector *v2 = luaL_checkudata(L, 2, "Vector");
-        v = vector_add(*v1, *v2);
-    } else {
-        v = vector_new(0.0, 0.0);
-    }
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Vector *a = udata_test(L, 1, &VectorType);
+    if (a == NULL)
+        push_vector(L, vector_add_scalar(*check_vector(L, 2), luaL_checknumber(L, 1)));
+    else if (lua_type(L, 2) == LUA_TNUMBER)
+        push_vector(L, vector_add_scalar(*a, lua_tonumber(L, 2)));
+    else
+        push_vector(L, vector_add(*a, *check_vector(L, 2)));
     return 1;
 }
 
 int api_vector_sub(lua_State *L) {
-    Vector v;
-
-    if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TUSERDATA) {
-        lua_Number scalar = luaL_checknumber(L, 1);
-        Vector *a = luaL_checkudata(L, 2, "Vector");
-        v = vector_sub_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TNUMBER) {
-        Vector *a = luaL_checkudata(L, 1, "Vector");
-        lua_Number scalar = luaL_checknumber(L, 2);
-        v = vector_sub_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TUSERDATA) {
-        Vector *v1 = luaL_checkudata(L, 1, "Vector");
-        Vector *v2 = luaL_checkudata(L, 2, "Vector");
-        v = vector_sub(*v1, *v2);
-    } else {
-        v = vector_new(0.0, 0.0);
-    }
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Vector *a = udata_test(L, 1, &VectorType);
+    if (a == NULL)
+        push_vector(L, vector_sub_scalar(*check_vector(L, 2), luaL_checknumber(L, 1)));
+    else if (lua_type(L, 2) == LUA_TNUMBER)
+        push_vector(L, vector_sub_scalar(*a, lua_tonumber(L, 2)));
+    else
+        push_vector(L, vector_sub(*a, *check_vector(L, 2)));
     return 1;
 }
 
 int api_vector_mul(lua_State *L) {
-    Vector v;
-
-    if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TUSERDATA) {
-        lua_Number scalar = luaL_checknumber(L, 1);
-        Vector *a = luaL_checkudata(L, 2, "Vector");
-        v = vector_mul_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TNUMBER) {
-        Vector *a = luaL_checkudata(L, 1, "Vector");
-        lua_Number scalar = luaL_checknumber(L, 2);
-        v = vector_mul_scalar(*a, scalar);
-    } else {
-        v = vector_new(0.0, 0.0);
-    }
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Vector *a = udata_test(L, 1, &VectorType);
+    if (a == NULL)
+        push_vector(L, vector_mul_scalar(*check_vector(L, 2), luaL_checknumber(L, 1)));
+    else
+        push_vector(L, vector_mul_scalar(*a, luaL_checknumber(L, 2)));
     return 1;
 }
 
 int api_vector_div(lua_State *L) {
-    Vector v;
-
-    if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TUSERDATA) {
-        lua_Number scalar = luaL_checknumber(L, 1);
-        Vector *a = luaL_checkudata(L, 2, "Vector");
-        v = vector_div_scalar(*a, scalar);
-    } else if (lua_type(L, 1) == LUA_TUSERDATA && lua_type(L, 2) == LUA_TNUMBER) {
-        Vector *a = luaL_checkudata(L, 1, "Vector");
-        lua_Number scalar = luaL_checknumber(L, 2);
-        v = vector_div_scalar(*a, scalar);
-    } else {
-        v = vector_new(0.0, 0.0);
-    }
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Vector *a = udata_test(L, 1, &VectorType);
+    if (a == NULL)
+        push_vector(L, vector_div_scalar(*check_vector(L, 2), luaL_checknumber(L, 1)));
+    else
+        push_vector(L, vector_div_scalar(*a, luaL_checknumber(L, 2)));
     return 1;
 }
 
 int api_vector_lerp(lua_State *L) {
-    Vector *a = luaL_checkudata(L, 1, "Vector");
-    Vector *b = luaL_checkudata(L, 2, "Vector");
+    Vector *a = check_vector(L, 1);
+    Vector *b = check_vector(L, 2);
     lua_Number t = luaL_checknumber(L, 3);
-
-    Vector v = vector_lerp(*a, *b, t);
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = v;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    push_vector(L, vector_lerp(*a, *b, t));
     return 1;
 }
 
 
 int api_vector_magnitude(lua_State *L) {
-    Vector *a = luaL_checkudata(L, 1, "Vector");
+    Vector *a = check_vector(L, 1);
     lua_Number m = vector_magnitude(*a);
     lua_pushnumber(L, m);
     return 1;
 }
 
 int api_vector_distance(lua_State *L) {
-    Vector *a = luaL_checkudata(L, 1, "Vector");
-    Vector *b = luaL_checkudata(L, 2, "Vector");
+    Vector *a = check_vector(L, 1);
+    Vector *b = check_vector(L, 2);
 
     lua_Number d = vector_distance(*a, *b);
     lua_pushnumber(L, d);
     return 1;
 }
 
-int api_vector_access_x(lua_State *L) {
-    Vector *v = luaL_checkudata(L, 1, "Vector");
+int api_vector_xy(lua_State *L) {
+    Vector *v = check_vector(L, 1);
     lua_pushnumber(L, v->x);
+    lua_pushnumber(L, v->y);
+    return 2;
+}
+
+// The methods ending in _ and set change the vector in place and return it,
+// so steady state code can reuse vectors instead of allocating new ones
+
+int api_vector_set(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        *v = *check_vector(L, 2);
+    } else {
+        v->x = luaL_checknumber(L, 2);
+        v->y = luaL_checknumber(L, 3);
+    }
+    lua_settop(L, 1);
     return 1;
 }
 
-int api_vector_access_y(lua_State *L) {
-    Vector *v = luaL_checkudata(L, 1, "Vector");
-    lua_pushnumber(L, v->y);
+int api_vector_add_inplace(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    if (lua_type(L, 2) == LUA_TNUMBER)
+        *v = vector_add_scalar(*v, lua_tonumber(L, 2));
+    else
+        *v = vector_add(*v, *check_vector(L, 2));
+    lua_settop(L, 1);
+    return 1;
+}
+
+int api_vector_sub_inplace(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    if (lua_type(L, 2) == LUA_TNUMBER)
+        *v = vector_sub_scalar(*v, lua_tonumber(L, 2));
+    else
+        *v = vector_sub(*v, *check_vector(L, 2));
+    lua_settop(L, 1);
+    return 1;
+}
+
+int api_vector_mul_inplace(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    *v = vector_mul_scalar(*v, luaL_checknumber(L, 2));
+    lua_settop(L, 1);
+    return 1;
+}
+
+int api_vector_div_inplace(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    *v = vector_div_scalar(*v, luaL_checknumber(L, 2));
+    lua_settop(L, 1);
+    return 1;
+}
+
+int api_vector_lerp_inplace(lua_State *L) {
+    Vector *v = check_vector(L, 1);
+    Vector *b = check_vector(L, 2);
+    *v = vector_lerp(*v, *b, luaL_checknumber(L, 3));
+    lua_settop(L, 1);
     return 1;
 }
 
 int api_vector_tostring(lua_State *L) {
-    Vector *v = luaL_checkudata(L, 1, "Vector");
+    Vector *v = check_vector(L, 1);
     lua_pushfstring(L, "Vector<x: %f, y: %f>", v->x, v->y);
     return 1;
 }
 
+// The field a one letter key names, NULL for anything else. Vectors answer
+// to w and h as well, like the C union.
+static double *vector_field(Vector *v, lua_State *L, int key) {
+    size_t len;
+    const char *name = lua_tolstring(L, key, &len);
+    if (name == NULL || len != 1)
+        return NULL;
+    switch (name[0]) {
+        case 'x':
+        case 'w':
+            return &v->x;
+        case 'y':
+        case 'h':
+            return &v->y;
+        default:
+            return NULL;
+    }
+}
+
+static double *rect_field(Rect *r, lua_State *L, int key) {
+    size_t len;
+    const char *name = lua_tolstring(L, key, &len);
+    if (name == NULL || len != 1)
+        return NULL;
+    switch (name[0]) {
+        case 'x':
+            return &r->x;
+        case 'y':
+            return &r->y;
+        case 'w':
+            return &r->w;
+        case 'h':
+            return &r->h;
+        default:
+            return NULL;
+    }
+}
+
+// v.x and friends are read without a method call, anything else is looked
+// up in the methods table held as upvalue
+int api_vector_index(lua_State *L) {
+    double *field = vector_field(lua_touserdata(L, 1), L, 2);
+    if (field != NULL) {
+        lua_pushnumber(L, *field);
+        return 1;
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+int api_vector_newindex(lua_State *L) {
+    double *field = vector_field(lua_touserdata(L, 1), L, 2);
+    if (field == NULL)
+        return luaL_error(L, "Vector has no field '%s'", luaL_tolstring(L, 2, NULL));
+    *field = luaL_checknumber(L, 3);
+    return 0;
+}
+
+int api_rect_index(lua_State *L) {
+    double *field = rect_field(lua_touserdata(L, 1), L, 2);
+    if (field != NULL) {
+        lua_pushnumber(L, *field);
+        return 1;
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+int api_rect_newindex(lua_State *L) {
+    double *field = rect_field(lua_touserdata(L, 1), L, 2);
+    if (field == NULL)
+        return luaL_error(L, "Rect has no field '%s'", luaL_tolstring(L, 2, NULL));
+    *field = luaL_checknumber(L, 3);
+    return 0;
+}
+
 int api_rect_new(lua_State *L) {
     double x = luaL_checknumber(L, 1);
     double y = luaL_checknumber(L, 2);
     double w = luaL_checknumber(L, 3);
     double h = luaL_checknumber(L, 4);
-    Rect r = rect_new(x, y, w, h);
-
-    Rect *ptr = lua_newuserdata(L, sizeof(Rect));
-    *ptr = r;
-    luaL_getmetatable(L, "Rect");
-    lua_setmetatable(L, -2);
+    push_rect(L, rect_new(x, y, w, h));
     return 1;
 }
 
 int api_rect_tostring(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
+    Rect *r = check_rect(L, 1);
     lua_pushfstring(L, "Rect<x: %f, y:%f, w:%f, h: %f>", r->x, r->y, r->w, r->h);
     return 1;
 }
 
 int api_rect_overlaps(lua_State *L) {
-    Rect *a = luaL_checkudata(L, 1, "Rect");
-    Rect *b = luaL_checkudata(L, 2, "Rect");
+    Rect *a = check_rect(L, 1);
+    Rect *b = check_rect(L, 2);
 
     Vector side;
     bool overlaps = rect_overlaps(*a, *b, &side);
@@ -298,112 +384,144 @@ int api_rect_overlaps(lua_State *L) {
     lua_pushboolean(L, overlaps);
 
     // Side
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = side;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
-
+    push_vector(L, side);
     return 2;
 }
 
-int api_rect_access_x(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    lua_pushnumber(L, r->x);
+int api_rect_access_position(lua_State *L) {
+    int pos = lua_gettop(L);
+    if (pos > 1) {
+        // SET
+        Rect *r = check_rect(L, 1);
+        Vector *v = check_vector(L, 2);
+        r->position = *v;
+        return 0;
+    }
+
+    // GET
+    Rect *r = check_rect(L, 1);
+    push_vector(L, r->position);
     return 1;
 }
 
-int api_rect_access_y(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
+
+int api_rect_xy(lua_State *L) {
+    Rect *r = check_rect(L, 1);
+    lua_pushnumber(L, r->x);
     lua_pushnumber(L, r->y);
-    return 1;
+    return 2;
 }
 
-int api_rect_access_w(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    lua_pushnumber(L, r->w);
-    return 1;
+int api_rect_center_xy(lua_State *L) {
+    Rect *r = check_rect(L, 1);
+    Vector center = rect_center(*r);
+    lua_pushnumber(L, center.x);
+    lua_pushnumber(L, center.y);
+    return 2;
 }
 
-int api_rect_access_h(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    lua_pushnumber(L, r->h);
+int api_rect_set_position(lua_State *L) {
+    Rect *r = check_rect(L, 1);
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        r->position = *check_vector(L, 2);
+    } else {
+        r->x = luaL_checknumber(L, 2);
+        r->y = luaL_checknumber(L, 3);
+    }
+    lua_settop(L, 1);
     return 1;
 }
 
-int api_rect_access_position(lua_State *L) {
-    int pos = lua_gettop(L);
-    if (pos > 1) {
-        // SET
-        Rect *r = luaL_checkudata(L, 1, "Rect");
-        Vector *v = luaL_checkudata(L, 2, "Vector");
-        r->position = *v;
-        return 0;
-    }
-
-    // GET
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = r->position;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+int api_rect_translate_inplace(lua_State *L) {
+    Rect *r = check_rect(L, 1);
+    r->x += luaL_checknumber(L, 2);
+    r->y += luaL_checknumber(L, 3);
+    lua_settop(L, 1);
     return 1;
 }
 
+// Same test as overlaps without building the side vector
+int api_rect_intersects(lua_State *L) {
+    Rect *a = check_rect(L, 1);
+    Rect *b = check_rect(L, 2);
+    Vector side;
+    lua_pushboolean(L, rect_overlaps(*a, *b, &side));
+    return 1;
+}
 
 int api_rect_access_dimension(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = r->dimension;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Rect *r = check_rect(L, 1);
+    push_vector(L, r->dimension);
     return 1;
 }
 
 int api_rect_access_center(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
-    Vector center = rect_center(*r);
-    Vector *ptr = lua_newuserdata(L, sizeof(Vector));
-    *ptr = center;
-    luaL_getmetatable(L, "Vector");
-    lua_setmetatable(L, -2);
+    Rect *r = check_rect(L, 1);
+    push_vector(L, rect_center(*r));
     return 1;
 }
 
 
-static const struct luaL_Reg vector_methods[] = {
+// The x/y/w/h methods from before the properties. v.x is already the number,
+// so numbers get a __call returning themselves when called with their vector
+// or rect: v:x() keeps working and calling a number anywhere else still fails.
+static int api_field_call(lua_State *L) {
+    if (udata_test(L, 2, &VectorType) == NULL && udata_test(L, 2, &RectType) == NULL)
+        return luaL_error(L, "attempt to call a number value");
+    lua_settop(L, 1);
+    return 1;
+}
+
+static const struct luaL_Reg vector_metamethods[] = {
         {"__add",      api_vector_add},
         {"__sub",      api_vector_sub},
         {"__mul",      api_vector_mul},
         {"__div",      api_vector_div},
-        {"lerp",       api_vector_lerp},
-        {"x",          api_vector_access_x},
-        {"y",          api_vector_access_y},
+        {"__newindex", api_vector_newindex},
         {"__tostring", api_vector_tostring},
         {NULL, NULL}
 };
 
+static const struct luaL_Reg vector_methods[] = {
+        {"lerp",  api_vector_lerp},
+        {"xy",    api_vector_xy},
+        {"set",   api_vector_set},
+        {"add_",  api_vector_add_inplace},
+        {"sub_",  api_vector_sub_inplace},
+        {"mul_",  api_vector_mul_inplace},
+        {"div_",  api_vector_div_inplace},
+        {"lerp_", api_vector_lerp_inplace},
+        {NULL, NULL}
+};
 
-static const struct luaL_Reg rect_methods[] = {
-        {"overlaps",   api_rect_overlaps},
-        {"x",          api_rect_access_x},
-        {"y",          api_rect_access_y},
-        {"w",          api_rect_access_w},
-        {"h",          api_rect_access_h},
-        {"position",   api_rect_access_position},
-        {"dimension",  api_rect_access_dimension},
-        {"center",     api_rect_access_center},
+static const struct luaL_Reg rect_metamethods[] = {
+        {"__newindex", api_rect_newindex},
         {"__tostring", api_rect_tostring},
         {NULL, NULL}
 };
 
+static const struct luaL_Reg rect_methods[] = {
+        {"overlaps",     api_rect_overlaps},
+        {"position",     api_rect_access_position},
+        {"dimension",    api_rect_access_dimension},
+        {"center",       api_rect_access_center},
+        {"xy",           api_rect_xy},
+        {"center_xy",    api_rect_center_xy},
+        {"set_position", api_rect_set_position},
+        {"translate_",   api_rect_translate_inplace},
+        {"intersects",   api_rect_intersects},
+        {NULL, NULL}
+};
+
 int module_vector(lua_State *L) {
     int pos = lua_gettop(L);
 
     // VECTOR
-    luaL_newmetatable(L, "Vector");
-    luaL_setfuncs(L, vector_methods, 0);
+    udata_register(L, &VectorType);
+    luaL_setfuncs(L, vector_metamethods, 0);
 
-    lua_pushvalue(L, -1);
+    luaL_newlib(L, vector_methods);
+    lua_pushcclosure(L, api_vector_index, 1);
     lua_setfield(L, -2, "__index");
 
     lua_newtable(L);
@@ -421,10 +539,11 @@ int module_vector(lua_State *L) {
 
 int module_rect(lua_State *L) {
     int pos = lua_gettop(L);
-    luaL_newmetatable(L, "Rect");
-    luaL_setfuncs(L, rect_methods, 0);
+    udata_register(L, &RectType);
+    luaL_setfuncs(L, rect_metamethods, 0);
 
-    lua_pushvalue(L, -1);
+    luaL_newlib(L, rect_methods);
+    lua_pushcclosure(L, api_rect_index, 1);
     lua_setfield(L, -2, "__index");
 
     lua_newtable(L);
@@ -442,4 +561,11 @@ void api_math_open(lua_State *L) {
 
     luaL_requiref(L, "core.rect", module_rect, 0);
     lua_pop(L, 1);
+
+    lua_pushinteger(L, 0);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, api_field_call);
+    lua_setfield(L, -2, "__call");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
 }
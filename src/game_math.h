@@ -4,6 +4,7 @@
 #define GAME_MATH_H
 
 #include "core.h"
+#include "udata.h"
 
 
 typedef struct {
@@ -59,7 +60,24 @@ double vector_magnitude(Vector v);
 
 double vector_distance(Vector a, Vector b);
 
+Rect rect_new(double x, double y, double w, double h);
+
+bool rect_overlaps(Rect a, Rect b, Vector *side);
+
+Vector rect_center(Rect r);
+
 // LUA API
+extern UserdataType VectorType;
+extern UserdataType RectType;
+
+void push_vector(lua_State *L, Vector v);
+
+void push_rect(lua_State *L, Rect r);
+
+Vector *check_vector(lua_State *L, int idx);
+
+Rect *check_rect(lua_State *L, int idx);
+
 void api_math_open(lua_State *L);
 
 #endif // GAME_MATH_H
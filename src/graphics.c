@@ -3,16 +3,113 @@
 #include "graphics.h"
 #include "scripting.h"
 #include "fonts.h"
+#include "atlas.h"
+#include "assets.h"
+#include "archive.h"
+#include "trace.h"
 
 static Graphics *graphics;
 
+UserdataType SpriteSetType = {"SpriteSet"};
+UserdataType SpriteType = {"Sprite"};
+
 void graphics_init(SDL_Renderer *renderer, int screen_width, int screen_height) {
     if (graphics == NULL) {
         graphics = malloc(sizeof(Graphics));
+        graphics->batch = batch_new();
     }
     graphics->screen_width = screen_width;
     graphics->screen_height = screen_height;
     graphics->renderer = renderer;
+    graphics->frame_queued = 0;
+    graphics->frame_batches = 0;
+    graphics->frame_switches = 0;
+    graphics->frame_drawn = 0;
+    graphics->frame_culled = 0;
+    graphics->frame_texts = 0;
+    graphics->drawn = 0;
+    graphics->culled = 0;
+    graphics->texts = 0;
+
+    Camera *camera = &graphics->camera;
+    camera->x = 0;
+    camera->y = 0;
+    camera->zoom = 1;
+    camera->viewport.x = 0;
+    camera->viewport.y = 0;
+    camera->viewport.w = screen_width;
+    camera->viewport.h = screen_height;
+    camera->enabled = true;
+}
+
+// Part of the world visible through the camera
+Rect graphics_view_rect() {
+    Camera *camera = &graphics->camera;
+    if (!camera->enabled)
+        return rect_new(0, 0, graphics->screen_width, graphics->screen_height);
+
+    return rect_new(camera->x, camera->y, camera->viewport.w / camera->zoom, camera->viewport.h / camera->zoom);
+}
+
+static void camera_to_screen(Vector *v) {
+    Camera *camera = &graphics->camera;
+    if (!camera->enabled)
+        return;
+
+    v->x = camera->viewport.x + (v->x - camera->x) * camera->zoom;
+    v->y = camera->viewport.y + (v->y - camera->y) * camera->zoom;
+}
+
+// Moves dst to screen coordinates and tells if any of it is visible
+static bool camera_transform(SDL_FRect *dst) {
+    Camera *camera = &graphics->camera;
+    SDL_Rect bounds = {0, 0, graphics->screen_width, graphics->screen_height};
+
+    if (camera->enabled) {
+        dst->x = camera->viewport.x + (dst->x - camera->x) * camera->zoom;
+        dst->y = camera->viewport.y + (dst->y - camera->y) * camera->zoom;
+        dst->w *= camera->zoom;
+        dst->h *= camera->zoom;
+        bounds = camera->viewport;
+    }
+
+    if (dst->x + dst->w <= bounds.x || dst->x >= bounds.x + bounds.w ||
+        dst->y + dst->h <= bounds.y || dst->y >= bounds.y + bounds.h) {
+        graphics->culled++;
+        return false;
+    }
+
+    graphics->drawn++;
+    return true;
+}
+
+void graphics_flush() {
+    trace_begin("graphics_flush");
+    batch_flush(graphics->batch, graphics->renderer);
+    trace_end();
+}
+
+const Graphics *graphics_get() {
+    return graphics;
+}
+
+void graphics_present() {
+    graphics_flush();
+    trace_begin("SDL_RenderPresent");
+    SDL_RenderPresent(graphics->renderer);
+    trace_end();
+
+    graphics->frame_queued = graphics->batch->queued;
+    graphics->frame_batches = graphics->batch->batches;
+    graphics->frame_switches = graphics->batch->switches;
+    graphics->frame_drawn = graphics->drawn;
+    graphics->frame_culled = graphics->culled;
+    graphics->frame_texts = graphics->texts;
+    graphics->drawn = 0;
+    graphics->culled = 0;
+    graphics->texts = 0;
+    batch_reset_stats(graphics->batch);
+    batch_set_layer(graphics->batch, 0);
 }
 
 
@@ -20,6 +117,8 @@ void graphics_draw_line(Vector start, Vector end, SDL_Color color) {
     if (graphics == NULL)
         panic("graphics: not initialized");
 
+    // Lines can't be batched, draw whatever is queued below them first
+    graphics_flush();
     SDL_SetRenderDrawColor(
             graphics->renderer,
             color.r,
@@ -28,13 +127,20 @@ void graphics_draw_line(Vector start, Vector end, SDL_Color color) {
             SDL_ALPHA_OPAQUE
     );
 
-    SDL_RenderDrawLineF(graphics->renderer, start.x, start.y, end.w, end.h);
+    camera_to_screen(&start);
+    camera_to_screen(&end);
+    SDL_RenderDrawLineF(graphics->renderer, start.x, start.y, end.x, end.y);
 }
 
 void graphics_draw_rect(Rect rect, SDL_Color color) {
     if (graphics == NULL)
         panic("graphics: not initialized");
 
+    SDL_FRect r = {rect.x, rect.y, rect.w, rect.h};
+    if (!camera_transform(&r))
+        return;
+
+    graphics_flush();
     SDL_SetRenderDrawColor(
             graphics->renderer,
             color.r,
@@ -42,7 +148,6 @@ void graphics_draw_rect(Rect rect, SDL_Color color) {
             color.b,
             SDL_ALPHA_OPAQUE
     );
-    SDL_FRect r = {rect.x, rect.y, rect.w, rect.h};;
     SDL_RenderDrawRectF(graphics->renderer, &r);
 }
 
@@ -50,28 +155,18 @@ void graphics_draw_fill_rect(Rect rect, SDL_Color color) {
     if (graphics == NULL)
         panic("graphics: not initialized");
 
-    SDL_SetRenderDrawColor(
-            graphics->renderer,
-            color.r,
-            color.g,
-            color.b,
-            SDL_ALPHA_OPAQUE
-    );
-    SDL_FRect r = {rect.x, rect.y, rect.w, rect.h};;
-    SDL_RenderFillRectF(graphics->renderer, &r);
+    color.a = SDL_ALPHA_OPAQUE;
+    SDL_FRect r = {rect.x, rect.y, rect.w, rect.h};
+    if (camera_transform(&r))
+        batch_push_rect(graphics->batch, r, color);
 }
 
-SpriteSet *graphics_load_sprite_set(const char *filename, int sprite_w, int sprite_h) {
+static SpriteSet *graphics_new_sprite_set(SDL_Texture *texture, int sprite_w, int sprite_h) {
     SpriteSet *atlas = malloc(sizeof(SpriteSet));
     atlas->sprite_width = sprite_w;
     atlas->sprite_height = sprite_h;
-    atlas->texture = IMG_LoadTexture(graphics->renderer, filename);
-
-    if (atlas->texture == NULL) {
-        printf("error on loading sprite atlas: %s\n", IMG_GetError());
-        free(atlas);
-        return NULL;
-    }
+    atlas->cells = NULL;
+    atlas->texture = texture;
 
     SDL_QueryTexture(atlas->texture, &atlas->format, &atlas->access, &atlas->w, &atlas->h);
     atlas->cols = atlas->w / atlas->sprite_width;
@@ -79,15 +174,77 @@ SpriteSet *graphics_load_sprite_set(const char *filename, int sprite_w, int spri
     return atlas;
 }
 
+SpriteSet *graphics_load_sprite_set(const char *filename, int sprite_w, int sprite_h) {
+    SDL_Surface *surface = archive_load_image(filename);
+
+    if (surface == NULL) {
+        printf("error on loading sprite atlas: %s\n", IMG_GetError());
+        return NULL;
+    }
+
+    SpriteSet *set = graphics_sprite_set_from_surface(surface, sprite_w, sprite_h);
+    SDL_FreeSurface(surface);
+    return set;
+}
+
+SpriteSet *graphics_sprite_set_from_surface(SDL_Surface *surface, int sprite_w, int sprite_h) {
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(graphics->renderer, surface);
+
+    if (texture == NULL) {
+        printf("error on uploading sprite atlas: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    return graphics_new_sprite_set(texture, sprite_w, sprite_h);
+}
+
+void graphics_free_sprite_set(SpriteSet *set) {
+    SDL_DestroyTexture(set->texture);
+    free(set);
+}
+
 void graphics_free_sprite(Sprite *sprite) {
     free(sprite);
 }
 
 
+bool graphics_sprite_source(SpriteSet *atlas, int col, int row, bool flip_h, bool flip_v,
+                            SDL_Texture **texture, SDL_Rect *src, int *offset_x, int *offset_y) {
+    if (atlas->cells == NULL) {
+        *texture = atlas->texture;
+        src->x = col * atlas->sprite_width;
+        src->y = row * atlas->sprite_height;
+        src->w = atlas->sprite_width;
+        src->h = atlas->sprite_height;
+        *offset_x = 0;
+        *offset_y = 0;
+        return true;
+    }
+
+    if (col < 0 || col >= atlas->cols || row < 0 || row >= atlas->rows)
+        return false;
+
+    SpriteCell *cell = &atlas->cells[row * atlas->cols + col];
+    if (cell->texture == NULL)
+        return false;
+
+    *texture = cell->texture;
+    *src = cell->src;
+
+    // Trimmed borders move to the other side when the sprite is flipped
+    *offset_x = flip_h ? atlas->sprite_width - cell->offset_x - src->w : cell->offset_x;
+    *offset_y = flip_v ? atlas->sprite_height - cell->offset_y - src->h : cell->offset_y;
+    return true;
+}
+
 void graphics_draw_sprite_set(SpriteSet *atlas, Vector pos, int col, int row, float scale, bool flip_h, bool flip_v) {
-    int src_col = col * atlas->sprite_width;
-    int src_row = row * atlas->sprite_height;
-    SDL_Rect src = {src_col, src_row, atlas->sprite_width, atlas->sprite_height};
+    SDL_Texture *texture;
+    SDL_Rect src;
+    int offset_x;
+    int offset_y;
+
+    if (!graphics_sprite_source(atlas, col, row, flip_h, flip_v, &texture, &src, &offset_x, &offset_y))
+        return;
 
     SDL_RendererFlip flip = SDL_FLIP_NONE;
 
@@ -97,31 +254,81 @@ void graphics_draw_sprite_set(SpriteSet *atlas, Vector pos, int col, int row, fl
     if (flip_v)
         flip |= SDL_FLIP_VERTICAL;
 
-    SDL_FRect dst = {pos.x, pos.y, atlas->sprite_width * scale, atlas->sprite_height * scale};
-    SDL_RenderCopyExF(graphics->renderer, atlas->texture, &src, &dst, 0, NULL, flip);
+    SDL_FRect dst = {pos.x + offset_x * scale, pos.y + offset_y * scale, src.w * scale, src.h * scale};
+    if (!camera_transform(&dst))
+        return;
+
+    SDL_Color white = {255, 255, 255, SDL_ALPHA_OPAQUE};
+    batch_push(graphics->batch, texture, atlas->w, atlas->h, src, dst, flip, white);
 }
 
-void graphics_draw_text(Font *f, const char *text, Vector pos, SDL_Color fg, bool shaded, SDL_Color bg) {
-    SDL_Surface *sur;
-    SDL_Texture *texture;
-    if (shaded) {
-        sur = font_render_shaded(f, text, fg, bg);
-        texture = SDL_CreateTextureFromSurface(graphics->renderer, sur);
+void graphics_draw_quads(SDL_Texture *texture, const SDL_Vertex *vertices, int quads, Rect bounds) {
+    SDL_FRect area = {bounds.x, bounds.y, bounds.w, bounds.h};
+    if (quads == 0 || !camera_transform(&area))
+        return;
+
+    Camera *camera = &graphics->camera;
+    SDL_Vertex *out = batch_begin_quads(graphics->batch, graphics->renderer, quads);
+    int count = quads * 4;
+
+    if (!camera->enabled) {
+        memcpy(out, vertices, sizeof(SDL_Vertex) * count);
     } else {
-        sur = font_render_solid(f, text, fg);
-        texture = SDL_CreateTextureFromSurface(graphics->renderer, sur);
+        float zoom = camera->zoom;
+        float dx = camera->viewport.x - camera->x * zoom;
+        float dy = camera->viewport.y - camera->y * zoom;
+        for (int i = 0; i < count; i++) {
+            out[i] = vertices[i];
+            out[i].position.x = vertices[i].position.x * zoom + dx;
+            out[i].position.y = vertices[i].position.y * zoom + dy;
+        }
     }
 
-    SDL_Rect dst = {pos.x, pos.y, sur->w, sur->h};
-    SDL_FreeSurface(sur);
+    batch_end_quads(graphics->batch, graphics->renderer, texture, quads);
+}
+
+void graphics_draw_text(Font *f, const char *text, Vector pos, SDL_Color fg, bool shaded, SDL_Color bg) {
+    if (f == NULL || text == NULL)
+        return;
+    graphics->texts++;
+
+    // Background goes first, untextured quads sort before the atlas in the same layer
+    if (shaded) {
+        int width = 0;
+        unsigned char prev = 0;
+        for (const unsigned char *c = (const unsigned char *) text; *c != '\0'; c++) {
+            Glyph *g = font_glyph(f, graphics->renderer, *c);
+            if (g == NULL)
+                continue;
+            width += font_kerning(f, prev, *c) + g->advance;
+            prev = *c;
+        }
+
+        bg.a = SDL_ALPHA_OPAQUE;
+        SDL_FRect back = {pos.x, pos.y, width, f->height};
+        if (camera_transform(&back))
+            batch_push_rect(graphics->batch, back, bg);
+    }
 
-    if (texture != NULL && sur != NULL) {
-        SDL_RenderCopy(graphics->renderer, texture, NULL, &dst);
-        SDL_DestroyTexture(texture);
+    fg.a = SDL_ALPHA_OPAQUE;
+    double pen_x = pos.x;
+    unsigned char prev = 0;
+    for (const unsigned char *c = (const unsigned char *) text; *c != '\0'; c++) {
+        Glyph *g = font_glyph(f, graphics->renderer, *c);
+        if (g == NULL)
+            continue;
+
+        pen_x += font_kerning(f, prev, *c);
+        SDL_FRect dst = {pen_x + g->offset_x, pos.y, g->rect.w, g->rect.h};
+        if (camera_transform(&dst))
+            batch_push(graphics->batch, f->atlas, f->atlas_size, f->atlas_size, g->rect, dst, SDL_FLIP_NONE, fg);
+        pen_x += g->advance;
+        prev = *c;
     }
 }
 
 void graphics_quit() {
+    batch_free(graphics->batch);
     free(graphics);
 }
 
@@ -140,15 +347,97 @@ static SDL_Color lua_read_color(lua_State *L, int idx) {
 }
 
 
+static void destroy_sprite_set(void *data) {
+    graphics_free_sprite_set(data);
+}
+
+static void destroy_atlas(void *data) {
+    atlas_free(data);
+}
+
+Asset *graphics_register_sprite_set(const char *key, SpriteSet *set) {
+    return asset_add(ASSET_SPRITE_SET, key, set, (size_t) set->w * set->h * 4, destroy_sprite_set);
+}
+
 int api_load_sprite_atlas(lua_State *L) {
     const char *filename = luaL_checklstring(L, 1, NULL);
     int sprite_width = luaL_checkinteger(L, 2);
     int sprite_height = luaL_checkinteger(L, 3);
-    SpriteSet *atlas = graphics_load_sprite_set(filename, sprite_width, sprite_height);
-    lua_pushlightuserdata(L, atlas);
+
+    const char *key = lua_pushfstring(L, ASSET_KEY_SPRITE_SET, filename, sprite_width, sprite_height);
+    Asset *asset = asset_find(key);
+
+    if (asset == NULL) {
+        SpriteSet *atlas = graphics_load_sprite_set(filename, sprite_width, sprite_height);
+        if (atlas == NULL) {
+            lua_pushnil(L);
+            return 1;
+        }
+        asset = graphics_register_sprite_set(key, atlas);
+    }
+
+    asset_push_handle(L, asset, asset->data, &SpriteSetType);
     return 1;
 }
 
+int api_build_atlas(lua_State *L) {
+    const char *cache = lua_isnoneornil(L, 1) ? NULL : luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int page_size = luaL_optinteger(L, 3, 2048);
+
+    int count = luaL_len(L, 2);
+    luaL_argcheck(L, count > 0, 2, "at least one sprite set expected");
+
+    AtlasInput inputs[count];
+    luaL_Buffer key;
+    luaL_buffinit(L, &key);
+
+    for (int i = 0; i < count; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        luaL_checktype(L, -1, LUA_TTABLE);
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        lua_rawgeti(L, -3, 3);
+        lua_rawgeti(L, -4, 4);
+        inputs[i].filename = luaL_checkstring(L, -4);
+        inputs[i].sprite_width = luaL_checkinteger(L, -3);
+        inputs[i].sprite_height = luaL_checkinteger(L, -2);
+        inputs[i].trim = lua_toboolean(L, -1);
+        // The filename string stays referenced by the table argument
+        lua_pop(L, 5);
+    }
+
+    // The atlas is shared by every build with the same inputs
+    lua_pushfstring(L, "atlas:%d", page_size);
+    luaL_addvalue(&key);
+    for (int i = 0; i < count; i++) {
+        lua_pushfstring(L, ":%s:%dx%d:%d", inputs[i].filename, inputs[i].sprite_width, inputs[i].sprite_height,
+                        (int) inputs[i].trim);
+        luaL_addvalue(&key);
+    }
+    luaL_pushresult(&key);
+
+    Asset *asset = asset_find(lua_tostring(L, -1));
+    if (asset == NULL) {
+        Atlas *atlas = atlas_build(graphics->renderer, cache, inputs, count, page_size);
+        if (atlas == NULL)
+            return luaL_error(L, "could not build sprite atlas");
+
+        size_t bytes = (size_t) atlas->page_count * page_size * page_size * 4;
+        asset = asset_add(ASSET_ATLAS, lua_tostring(L, -1), atlas, bytes, destroy_atlas);
+    }
+
+    // Every sprite set handle keeps the whole atlas alive
+    Atlas *atlas = asset->data;
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            asset_retain(asset);
+        asset_push_handle(L, asset, atlas->sets[i], &SpriteSetType);
+    }
+
+    return count;
+}
+
 int api_new_sprite(lua_State *L) {
     SpriteSet *set = NULL;
     int num_args = lua_gettop(L);
@@ -159,7 +448,7 @@ int api_new_sprite(lua_State *L) {
     bool flip_v = false;
 
     if (num_args > 0)
-        set = lua_touserdata(L, 1);
+        set = asset_check(L, 1, &SpriteSetType);
 
     if (num_args > 1)
         col = luaL_checkinteger(L, 2);
@@ -176,7 +465,7 @@ int api_new_sprite(lua_State *L) {
     if (num_args > 5)
         flip_v = lua_toboolean(L, 6);
 
-    Sprite *sprite = lua_newuserdata(L, sizeof(Sprite));
+    Sprite *sprite = udata_new(L, sizeof(Sprite), &SpriteType);
     sprite->sprite_set = set;
     sprite->col = col;
     sprite->row = row;
@@ -184,6 +473,12 @@ int api_new_sprite(lua_State *L) {
     sprite->flip_h = flip_h;
     sprite->flip_v = flip_v;
 
+    // The sprite keeps its sprite set loaded
+    if (num_args > 0) {
+        lua_pushvalue(L, 1);
+        lua_setuservalue(L, -2);
+    }
+
     return 1;
 }
 
@@ -198,10 +493,10 @@ int api_draw_sprite_set(lua_State *L) {
     bool flip_v = false;
 
     if (num_args > 0)
-        atlas = lua_touserdata(L, 1);
+        atlas = asset_check(L, 1, &SpriteSetType);
 
     if (num_args > 1)
-        position = luaL_checkudata(L, 2, "Vector");
+        position = check_vector(L, 2);
 
     if (num_args > 2)
         col = luaL_checkinteger(L, 3);
@@ -226,17 +521,20 @@ int api_draw_sprite_set(lua_State *L) {
 int api_draw_sprite(lua_State *L) {
     Sprite *sprite = NULL;
     int num_args = lua_gettop(L);
-    Vector *position;
+    Vector position;
 
     if (num_args > 0)
-        sprite = lua_touserdata(L, 1);
+        sprite = udata_check(L, 1, &SpriteType);
 
-    if (num_args > 1)
-        position = luaL_checkudata(L, 2, "Vector");
+    // Either a vector or plain x, y numbers
+    if (num_args > 2)
+        position = vector_new(luaL_checknumber(L, 2), luaL_checknumber(L, 3));
+    else if (num_args > 1)
+        position = *check_vector(L, 2);
 
     graphics_draw_sprite_set(
             sprite->sprite_set,
-            *position,
+            position,
             sprite->col,
             sprite->row,
             sprite->scale,
@@ -257,13 +555,13 @@ int api_draw_text(lua_State *L) {
     const char *text = NULL;
 
     if (num_args > 0)
-        font = lua_touserdata(L, 1);
+        font = asset_check(L, 1, &FontType);
 
     if (num_args > 1)
         text = luaL_checkstring(L, 2);
 
     if (num_args > 2)
-        position = luaL_checkudata(L, 3, "Vector");
+        position = check_vector(L, 3);
 
     if (num_args > 3)
         fg = lua_read_color(L, 4);
@@ -279,27 +577,62 @@ int api_draw_text(lua_State *L) {
 }
 
 int api_draw_rect(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
+    Rect *r = check_rect(L, 1);
     SDL_Color color = lua_read_color(L, 2);
     graphics_draw_rect(*r, color);
     return 0; // Successful
 }
 
 int api_draw_fill_rect(lua_State *L) {
-    Rect *r = luaL_checkudata(L, 1, "Rect");
+    Rect *r = check_rect(L, 1);
     SDL_Color color = lua_read_color(L, 2);
     graphics_draw_fill_rect(*r, color);
     return 0; // Successful
 }
 
+void graphics_set_layer(int layer) {
+    batch_set_layer(graphics->batch, layer);
+}
+
+int graphics_layer() {
+    return graphics->batch->layer;
+}
+
+int api_draw_set_layer(lua_State *L) {
+    int layer = luaL_checkinteger(L, 1);
+    graphics_set_layer(layer);
+    return 0;
+}
+
+int api_draw_stats(lua_State *L) {
+    lua_newtable(L);
+    int pos = lua_gettop(L);
+    lua_pushinteger(L, graphics->frame_queued);
+    lua_setfield(L, pos, "queued");
+    lua_pushinteger(L, graphics->frame_batches);
+    lua_setfield(L, pos, "batches");
+    lua_pushinteger(L, graphics->frame_switches);
+    lua_setfield(L, pos, "switches");
+    lua_pushinteger(L, graphics->frame_drawn);
+    lua_setfield(L, pos, "drawn");
+    lua_pushinteger(L, graphics->frame_culled);
+    lua_setfield(L, pos, "culled");
+    lua_pushinteger(L, graphics->frame_texts);
+    lua_setfield(L, pos, "texts");
+    return 1;
+}
+
 static const struct luaL_Reg drawing_funcs[] = {
         {"load_sprite_set", api_load_sprite_atlas},
+        {"build_atlas",     api_build_atlas},
         {"draw_sprite_set", api_draw_sprite_set},
         {"new_sprite",      api_new_sprite},
         {"draw_sprite",     api_draw_sprite},
         {"draw_text",       api_draw_text},
         {"draw_rect",       api_draw_rect},
         {"draw_fill_rect",  api_draw_fill_rect},
+        {"set_layer",       api_draw_set_layer},
+        {"stats",           api_draw_stats},
         {NULL, NULL}
 };
 
@@ -309,6 +642,102 @@ int module_draw(lua_State *L) {
     return 1;
 }
 
+int api_camera_position(lua_State *L) {
+    Camera *camera = &graphics->camera;
+    if (lua_gettop(L) > 0) {
+        // SET
+        camera->x = luaL_checknumber(L, 1);
+        camera->y = luaL_checknumber(L, 2);
+        return 0;
+    }
+
+    // GET
+    lua_pushnumber(L, camera->x);
+    lua_pushnumber(L, camera->y);
+    return 2;
+}
+
+int api_camera_zoom(lua_State *L) {
+    Camera *camera = &graphics->camera;
+    if (lua_gettop(L) > 0) {
+        lua_Number zoom = luaL_checknumber(L, 1);
+        luaL_argcheck(L, zoom > 0, 1, "zoom must be positive");
+        camera->zoom = zoom;
+        return 0;
+    }
+
+    lua_pushnumber(L, camera->zoom);
+    return 1;
+}
+
+int api_camera_viewport(lua_State *L) {
+    Camera *camera = &graphics->camera;
+    if (lua_gettop(L) > 0) {
+        camera->viewport.x = luaL_checkinteger(L, 1);
+        camera->viewport.y = luaL_checkinteger(L, 2);
+        camera->viewport.w = luaL_checkinteger(L, 3);
+        camera->viewport.h = luaL_checkinteger(L, 4);
+
+        // Sprites crossing the viewport border must not draw outside of it
+        graphics_flush();
+        SDL_RenderSetClipRect(graphics->renderer, &camera->viewport);
+        return 0;
+    }
+
+    lua_pushinteger(L, camera->viewport.x);
+    lua_pushinteger(L, camera->viewport.y);
+    lua_pushinteger(L, camera->viewport.w);
+    lua_pushinteger(L, camera->viewport.h);
+    return 4;
+}
+
+int api_camera_enable(lua_State *L) {
+    Camera *camera = &graphics->camera;
+    bool enabled = lua_toboolean(L, 1);
+    if (enabled == camera->enabled)
+        return 0;
+
+    // Draws queued so far are clipped to the state they were made in, and
+    // screen space drawing is not limited to the viewport
+    graphics_flush();
+    camera->enabled = enabled;
+    SDL_RenderSetClipRect(graphics->renderer, enabled ? &camera->viewport : NULL);
+    return 0;
+}
+
+int api_camera_to_world(lua_State *L) {
+    Camera *camera = &graphics->camera;
+    lua_Number x = luaL_checknumber(L, 1);
+    lua_Number y = luaL_checknumber(L, 2);
+    lua_pushnumber(L, camera->x + (x - camera->viewport.x) / camera->zoom);
+    lua_pushnumber(L, camera->y + (y - camera->viewport.y) / camera->zoom);
+    return 2;
+}
+
+int api_camera_to_screen(lua_State *L) {
+    Vector v = vector_new(luaL_checknumber(L, 1), luaL_checknumber(L, 2));
+    camera_to_screen(&v);
+    lua_pushnumber(L, v.x);
+    lua_pushnumber(L, v.y);
+    return 2;
+}
+
+static const struct luaL_Reg camera_funcs[] = {
+        {"position",  api_camera_position},
+        {"zoom",      api_camera_zoom},
+        {"viewport",  api_camera_viewport},
+        {"enable",    api_camera_enable},
+        {"to_world",  api_camera_to_world},
+        {"to_screen", api_camera_to_screen},
+        {NULL, NULL}
+};
+
+int module_camera(lua_State *L) {
+    lua_newtable(L);
+    luaL_setfuncs(L, camera_funcs, 0);
+    return 1;
+}
+
 int module_screen(lua_State *L) {
     lua_newtable(L);
     int pos = lua_gettop(L);
@@ -321,10 +750,17 @@ int module_screen(lua_State *L) {
 }
 
 void api_graphics_open(lua_State *L) {
+    asset_new_metatable(L, &SpriteSetType);
+    udata_register(L, &SpriteType);
+    lua_pop(L, 1);
+
     luaL_requiref(L, "core.draw", module_draw, 0);
     lua_pop(L, 1);
 
     luaL_requiref(L, "core.screen", module_screen, 0);
     lua_pop(L, 1);
+
+    luaL_requiref(L, "core.camera", module_camera, 0);
+    lua_pop(L, 1);
 }
 
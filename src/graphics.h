@@ -4,14 +4,50 @@
 #define GRAPHICS_H
 
 #include "core.h"
+#include "batch.h"
+#include "game_math.h"
+#include "assets.h"
+
+// Maps world coordinates into the viewport: a world point at (x, y) is drawn
+// at the top-left of the viewport, and sizes are scaled by zoom.
+typedef struct {
+    double x;
+    double y;
+    double zoom;
+    SDL_Rect viewport;
+    bool enabled;       // When false draws are in screen coordinates
+} Camera;
 
 typedef struct {
     int screen_width;
     int screen_height;
     SDL_Renderer *renderer;
     SDL_Surface *surface;
+    SpriteBatch *batch;
+    Camera camera;
+
+    // Counters for the current frame
+    int drawn;
+    int culled;
+    int texts;
+
+    // Counters of the last presented frame
+    int frame_queued;
+    int frame_batches;
+    int frame_switches;
+    int frame_drawn;
+    int frame_culled;
+    int frame_texts;
 } Graphics;
 
+// Where one cell of a packed sprite set lives inside an atlas page
+typedef struct {
+    SDL_Texture *texture;
+    SDL_Rect src;       // Empty when the cell is fully transparent
+    int offset_x;       // Transparent border trimmed on the left
+    int offset_y;       // Transparent border trimmed on the top
+} SpriteCell;
+
 typedef struct {
     SDL_Texture *texture;
     Uint32 format;
@@ -22,6 +58,7 @@ typedef struct {
     int sprite_height;
     int cols;
     int rows;
+    SpriteCell *cells;  // cols * rows when packed in an atlas, NULL otherwise
 } SpriteSet;
 
 typedef struct {
@@ -36,8 +73,43 @@ typedef struct {
 
 void graphics_init(SDL_Renderer *renderer, int screen_width, int screen_height);
 
+Rect graphics_view_rect();
+
+SpriteSet *graphics_load_sprite_set(const char *filename, int sprite_w, int sprite_h);
+
+// Uploads an image decoded elsewhere, the surface stays owned by the caller
+SpriteSet *graphics_sprite_set_from_surface(SDL_Surface *surface, int sprite_w, int sprite_h);
+
+void graphics_free_sprite_set(SpriteSet *set);
+
+// Registers a loaded sprite set in the asset list under key
+Asset *graphics_register_sprite_set(const char *key, SpriteSet *set);
+
+bool graphics_sprite_source(SpriteSet *atlas, int col, int row, bool flip_h, bool flip_v,
+                            SDL_Texture **texture, SDL_Rect *src, int *offset_x, int *offset_y);
+
+// Draws quads given in world coordinates with one submit, bounds is used to cull them
+void graphics_draw_quads(SDL_Texture *texture, const SDL_Vertex *vertices, int quads, Rect bounds);
+
+void graphics_draw_sprite_set(SpriteSet *atlas, Vector pos, int col, int row, float scale, bool flip_h, bool flip_v);
+
+// Draw layer of everything queued next, lower layers are drawn first
+void graphics_set_layer(int layer);
+
+int graphics_layer();
+
+void graphics_flush();
+
+// For reading the counters of the last presented frame
+const Graphics *graphics_get();
+
+void graphics_present();
+
 void graphics_quit();
 
+extern UserdataType SpriteSetType;
+extern UserdataType SpriteType;
+
 void api_graphics_open(lua_State *L);
 
 #endif // GRAPHICS_H
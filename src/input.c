@@ -0,0 +1,24 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "input.h"
+
+int module_keys(lua_State *L) {
+    lua_createtable(L, SDL_NUM_SCANCODES, SDL_NUM_SCANCODES);
+    for (int code = 0; code < SDL_NUM_SCANCODES; code++) {
+        const char *name = SDL_GetScancodeName(code);
+        if (name == NULL || name[0] == '\0')
+            continue;
+
+        lua_pushstring(L, name);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, code);
+        lua_pushinteger(L, code);
+        lua_rawset(L, -3);
+    }
+    return 1;
+}
+
+void api_input_open(lua_State *L) {
+    luaL_requiref(L, "core.keys", module_keys, 0);
+    lua_pop(L, 1);
+}
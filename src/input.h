@@ -0,0 +1,12 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "core.h"
+
+// core.keys maps scancode names to the integer codes key callbacks receive
+// and back, Keys.Space == 44 and Keys[44] == "Space"
+void api_input_open(lua_State *L);
+
+#endif // INPUT_H
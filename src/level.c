@@ -1,78 +1,319 @@
 // Copyright 2023 Lucas Klassmann
 // License: Apache License 2.0
 #include "level.h"
+#include "trace.h"
+#include "pacing.h"
+
+static const char *const callback_names[LEVEL_CALLBACKS] = {
+        [LEVEL_LOAD] = "_load",
+        [LEVEL_UPDATE] = "_update",
+        [LEVEL_DRAW] = "_draw",
+        [LEVEL_KEYUP] = "_keyup",
+        [LEVEL_KEYDOWN] = "_keydown",
+        [LEVEL_MOUSEUP] = "_mouseup",
+        [LEVEL_MOUSEDOWN] = "_mousedown",
+        [LEVEL_MOUSEMOVE] = "_mousemove",
+        [LEVEL_EVENTS] = "_events",
+};
+
+static const char *const event_names[] = {
+        [LEVEL_EVENT_KEYUP] = "keyup",
+        [LEVEL_EVENT_KEYDOWN] = "keydown",
+        [LEVEL_EVENT_MOUSEUP] = "mouseup",
+        [LEVEL_EVENT_MOUSEDOWN] = "mousedown",
+        [LEVEL_EVENT_MOUSEMOVE] = "mousemove",
+};
+
+static int traceback(lua_State *L) {
+    luaL_traceback(L, L, lua_tostring(L, 1), 1);
+    return 1;
+}
 
 Level *level_new(Script *script) {
     Level *l = malloc(sizeof(Level));
+    lua_State *L = script->L;
     l->script = script;
+
+    for (int i = 0; i < LEVEL_CALLBACKS; i++) {
+        l->callbacks[i] = LUA_NOREF;
+        l->errors[i] = 0;
+        if (lua_getglobal(L, callback_names[i]) == LUA_TFUNCTION)
+            l->callbacks[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+        else
+            lua_pop(L, 1);
+    }
+
+    l->batched = l->callbacks[LEVEL_EVENTS] != LUA_NOREF;
+    l->event_count = 0;
+    lua_createtable(L, LEVEL_MAX_EVENTS, 1);
+    l->batch_ref = luaL_ref(L, LUA_REGISTRYINDEX);
     return l;
 }
 
 
 void level_free(Level *level) {
+    lua_State *L = level->script->L;
+    for (int i = 0; i < LEVEL_CALLBACKS; i++)
+        luaL_unref(L, LUA_REGISTRYINDEX, level->callbacks[i]);
+    luaL_unref(L, LUA_REGISTRYINDEX, level->batch_ref);
     free(level);
 }
 
-void level_load(Level *level) {
+// Pushes the message handler and the callback, false when the script does not define it
+static bool level_begin(Level *level, LevelCallback callback) {
+    if (level->callbacks[callback] == LUA_NOREF)
+        return false;
+
     lua_State *L = level->script->L;
-    lua_getglobal(L, "_load");
-    lua_pcall(L, 0, 0, 0);
+    lua_pushcfunction(L, traceback);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, level->callbacks[callback]);
+    return true;
 }
 
-void level_update(Level *level, double dt) {
+static void level_call(Level *level, LevelCallback callback, int args) {
     lua_State *L = level->script->L;
-    lua_getglobal(L, "_update");
+    int handler = lua_gettop(L) - args - 1;
+
+    trace_begin(callback_names[callback]);
+    int status = lua_pcall(L, args, 0, handler);
+    trace_end();
+
+    if (status != LUA_OK) {
+        int errors = ++level->errors[callback];
+        if (errors <= LEVEL_MAX_REPORTS)
+            printf("level: %s failed: %s\n", callback_names[callback], lua_tostring(L, -1));
+        if (errors == LEVEL_MAX_REPORTS)
+            printf("level: further %s errors are not reported\n", callback_names[callback]);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+void level_load(Level *level) {
+    if (level_begin(level, LEVEL_LOAD))
+        level_call(level, LEVEL_LOAD, 0);
+}
+
+void level_update(Level *level, double dt) {
+    if (!level_begin(level, LEVEL_UPDATE))
+        return;
     lua_pushnumber(level->script->L, dt);
-    lua_pcall(L, 1, 0, 0);
+    level_call(level, LEVEL_UPDATE, 1);
 }
 
-void level_draw(Level *level) {
-    lua_State *L = level->script->L;
-    lua_getglobal(L, "_draw");
-    lua_pcall(L, 0, 0, 0);
+void level_draw(Level *level, double alpha) {
+    if (!level_begin(level, LEVEL_DRAW))
+        return;
+    lua_pushnumber(level->script->L, alpha);
+    level_call(level, LEVEL_DRAW, 1);
 }
 
-void level_keyup(Level *level, const char *key) {
-    lua_State *L = level->script->L;
-    lua_getglobal(L, "_keyup");
-    lua_pushstring(level->script->L, key);
-    lua_pcall(L, 1, 0, 0);
+static LevelEvent *level_queue(Level *level, LevelEventType type) {
+    if (level->event_count == LEVEL_MAX_EVENTS)
+        level_flush_events(level);
+
+    LevelEvent *ev = &level->events[level->event_count++];
+    memset(ev, 0, sizeof(LevelEvent));
+    ev->type = type;
+    return ev;
+}
+
+static void level_key(Level *level, LevelCallback callback, LevelEventType type, int key) {
+    if (level->batched) {
+        level_queue(level, type)->key = key;
+        return;
+    }
+
+    if (!level_begin(level, callback))
+        return;
+    lua_pushinteger(level->script->L, key);
+    level_call(level, callback, 1);
+}
+
+void level_keyup(Level *level, int key) {
+    level_key(level, LEVEL_KEYUP, LEVEL_EVENT_KEYUP, key);
+}
+
+void level_keydown(Level *level, int key) {
+    level_key(level, LEVEL_KEYDOWN, LEVEL_EVENT_KEYDOWN, key);
 }
 
-void level_keydown(Level *level, const char *key) {
+static void level_button(Level *level, LevelCallback callback, LevelEventType type,
+                         const char *button, const char *state, int x, int y) {
+    if (level->batched) {
+        LevelEvent *ev = level_queue(level, type);
+        ev->button = button;
+        ev->state = state;
+        ev->x = x;
+        ev->y = y;
+        return;
+    }
+
+    if (!level_begin(level, callback))
+        return;
     lua_State *L = level->script->L;
-    lua_getglobal(L, "_keydown");
-    lua_pushstring(level->script->L, key);
-    lua_pcall(L, 1, 0, 0);
+    lua_pushstring(L, button);
+    lua_pushstring(L, state);
+    lua_pushinteger(L, x);
+    lua_pushinteger(L, y);
+    level_call(level, callback, 4);
 }
 
 void level_mouseup(Level *level, const char *button, const char *state, int x, int y) {
-    lua_State *L = level->script->L;
-    lua_getglobal(L, "_mouseup");
-    lua_pushstring(level->script->L, button);
-    lua_pushstring(level->script->L, state);
-    lua_pushinteger(level->script->L, x);
-    lua_pushinteger(level->script->L, y);
-    lua_pcall(L, 4, 0, 0);
+    level_button(level, LEVEL_MOUSEUP, LEVEL_EVENT_MOUSEUP, button, state, x, y);
 }
 
 void level_mousedown(Level *level, const char *button, const char *state, int x, int y) {
-    lua_State *L = level->script->L;
-    lua_getglobal(L, "_mousedown");
-    lua_pushstring(level->script->L, button);
-    lua_pushstring(level->script->L, state);
-    lua_pushinteger(level->script->L, x);
-    lua_pushinteger(level->script->L, y);
-    lua_pcall(L, 4, 0, 0);
+    level_button(level, LEVEL_MOUSEDOWN, LEVEL_EVENT_MOUSEDOWN, button, state, x, y);
 }
 
 void level_mousemove(Level *level, const char *state, int x, int y, int relx, int rely) {
+    if (level->batched) {
+        // Motion right after motion becomes one event at the last position
+        LevelEvent *ev = NULL;
+        if (level->event_count > 0 && level->events[level->event_count - 1].type == LEVEL_EVENT_MOUSEMOVE)
+            ev = &level->events[level->event_count - 1];
+        else
+            ev = level_queue(level, LEVEL_EVENT_MOUSEMOVE);
+        ev->state = state;
+        ev->x = x;
+        ev->y = y;
+        ev->relx += relx;
+        ev->rely += rely;
+        return;
+    }
+
+    if (!level_begin(level, LEVEL_MOUSEMOVE))
+        return;
+    lua_State *L = level->script->L;
+    lua_pushstring(L, state);
+    lua_pushinteger(L, x);
+    lua_pushinteger(L, y);
+    lua_pushinteger(L, relx);
+    lua_pushinteger(L, rely);
+    level_call(level, LEVEL_MOUSEMOVE, 5);
+}
+
+static void set_string_field(lua_State *L, const char *field, const char *value) {
+    if (value != NULL)
+        lua_pushstring(L, value);
+    else
+        lua_pushnil(L);
+    lua_setfield(L, -2, field);
+}
+
+static void clear_field(lua_State *L, const char *field) {
+    lua_pushnil(L);
+    lua_setfield(L, -2, field);
+}
+
+static void set_integer_field(lua_State *L, const char *field, lua_Integer value) {
+    lua_pushinteger(L, value);
+    lua_setfield(L, -2, field);
+}
+
+// batch = {count = n, {type = "keydown", key = 4}, {type = "mousemove", x = 10, ...}, ...}
+// The batch and its event tables are reused every frame, entries past count
+// are stale and every event table has all fields, nil when they do not apply.
+void level_flush_events(Level *level) {
+    if (!level->batched || level->event_count == 0)
+        return;
+
+    int count = level->event_count;
+    level->event_count = 0;
+    if (!level_begin(level, LEVEL_EVENTS))
+        return;
+
+    lua_State *L = level->script->L;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, level->batch_ref);
+    set_integer_field(L, "count", count);
+
+    for (int i = 0; i < count; i++) {
+        const LevelEvent *ev = &level->events[i];
+        if (lua_rawgeti(L, -1, i + 1) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_createtable(L, 0, 8);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, i + 1);
+        }
+
+        bool key = ev->type == LEVEL_EVENT_KEYUP || ev->type == LEVEL_EVENT_KEYDOWN;
+        set_string_field(L, "type", event_names[ev->type]);
+        if (key)
+            set_integer_field(L, "key", ev->key);
+        else
+            clear_field(L, "key");
+        set_string_field(L, "button", ev->button);
+        set_string_field(L, "state", ev->state);
+        if (key) {
+            clear_field(L, "x");
+            clear_field(L, "y");
+        } else {
+            set_integer_field(L, "x", ev->x);
+            set_integer_field(L, "y", ev->y);
+        }
+        if (ev->type == LEVEL_EVENT_MOUSEMOVE) {
+            set_integer_field(L, "relx", ev->relx);
+            set_integer_field(L, "rely", ev->rely);
+        } else {
+            clear_field(L, "relx");
+            clear_field(L, "rely");
+        }
+        lua_pop(L, 1);
+    }
+
+    level_call(level, LEVEL_EVENTS, 1);
+}
+
+void level_gc_control(Level *level, LevelGC *gc, double budget, int ceiling_kb) {
+    memset(gc, 0, sizeof(LevelGC));
+    gc->budget = budget > 0 ? budget : 0;
+    gc->ceiling_kb = ceiling_kb > 0 ? ceiling_kb : 0;
+    if (gc->budget > 0)
+        lua_gc(level->script->L, LUA_GCSTOP, 0);
+    gc->threshold_kb = lua_gc(level->script->L, LUA_GCCOUNT, 0) * LEVEL_GC_PAUSE / 100;
+}
+
+void level_collect(Level *level, LevelGC *gc) {
     lua_State *L = level->script->L;
-    lua_getglobal(L, "_mousemove");
-    lua_pushstring(level->script->L, state);
-    lua_pushinteger(level->script->L, x);
-    lua_pushinteger(level->script->L, y);
-    lua_pushinteger(level->script->L, relx);
-    lua_pushinteger(level->script->L, rely);
-    lua_pcall(L, 5, 0, 0);
-}
\ No newline at end of file
+    double start = pacing_now();
+
+    if (gc->budget > 0) {
+        int heap = lua_gc(L, LUA_GCCOUNT, 0);
+        if (gc->ceiling_kb > 0 && heap >= gc->ceiling_kb) {
+            // Slices fell behind the allocation, take the spike once
+            lua_gc(L, LUA_GCCOLLECT, 0);
+            gc->full_cycles++;
+            gc->collecting = false;
+            gc->threshold_kb = lua_gc(L, LUA_GCCOUNT, 0) * LEVEL_GC_PAUSE / 100;
+        } else if (gc->collecting || heap >= gc->threshold_kb) {
+            // A step returns 1 when it ends a cycle, then the collector pauses
+            gc->collecting = true;
+            while (pacing_now() - start < gc->budget) {
+                if (lua_gc(L, LUA_GCSTEP, LEVEL_GC_STEP_KB) != 0) {
+                    gc->collecting = false;
+                    gc->threshold_kb = lua_gc(L, LUA_GCCOUNT, 0) * LEVEL_GC_PAUSE / 100;
+                    break;
+                }
+            }
+        }
+    }
+
+    gc->last_time = pacing_now() - start;
+    gc->heap_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    gc->frames++;
+    gc->total_time += gc->last_time;
+    if (gc->last_time > gc->max_time)
+        gc->max_time = gc->last_time;
+}
+
+void level_gc_report(LevelGC *gc) {
+    if (gc->frames == 0)
+        return;
+    printf("gc: %.3f ms/frame, %.3f ms max, heap %d KB, %d full cycles\n",
+           gc->total_time * 1000.0 / gc->frames, gc->max_time * 1000.0, gc->heap_kb, gc->full_cycles);
+    gc->frames = 0;
+    gc->total_time = 0;
+    gc->max_time = 0;
+    gc->full_cycles = 0;
+}
@@ -6,11 +6,70 @@
 #include "core.h"
 #include "scripting.h"
 
+#define LEVEL_MAX_EVENTS 256
+#define LEVEL_MAX_REPORTS 10    // Errors printed per callback before going quiet
+#define LEVEL_GC_STEP_KB 8      // Work of one collector slice, in KB of allocation
+#define LEVEL_GC_PAUSE 200      // Heap growth in percent after a cycle before the next starts, as setpause
+
+typedef enum {
+    LEVEL_LOAD,
+    LEVEL_UPDATE,
+    LEVEL_DRAW,
+    LEVEL_KEYUP,
+    LEVEL_KEYDOWN,
+    LEVEL_MOUSEUP,
+    LEVEL_MOUSEDOWN,
+    LEVEL_MOUSEMOVE,
+    LEVEL_EVENTS,
+    LEVEL_CALLBACKS
+} LevelCallback;
+
+typedef enum {
+    LEVEL_EVENT_KEYUP,
+    LEVEL_EVENT_KEYDOWN,
+    LEVEL_EVENT_MOUSEUP,
+    LEVEL_EVENT_MOUSEDOWN,
+    LEVEL_EVENT_MOUSEMOVE
+} LevelEventType;
 
+typedef struct {
+    LevelEventType type;
+    int key;                // Scancode, for key events
+    const char *button;     // For mouse button events
+    const char *state;
+    int x;
+    int y;
+    int relx;               // Summed over the coalesced motion events
+    int rely;
+} LevelEvent;
+
+// Script callbacks are looked up once, when the level is created. When the
+// script defines _events, input is queued and delivered once per frame in a
+// single _events(batch) call instead of one call per event.
 typedef struct {
     Script *script;
+    int callbacks[LEVEL_CALLBACKS];     // Registry refs, LUA_NOREF when not defined
+    int errors[LEVEL_CALLBACKS];
+    bool batched;
+    LevelEvent events[LEVEL_MAX_EVENTS];
+    int event_count;
+    int batch_ref;                      // Table reused for every batch
 } Level;
 
+// Collector statistics, summed until the next report
+typedef struct {
+    double budget;          // Seconds of collection per frame, 0 leaves the collector automatic
+    int ceiling_kb;         // Heap size forcing a full cycle, 0 for none
+    bool collecting;        // A cycle is in progress, slices run until it ends
+    int threshold_kb;       // Heap size starting the next cycle
+    double last_time;       // Collection time of the last frame
+    int heap_kb;            // Heap size after the last frame
+    int frames;
+    double total_time;
+    double max_time;
+    int full_cycles;
+} LevelGC;
+
 
 Level *level_new(Script *script);
 
@@ -20,11 +79,12 @@ void level_load(Level *level);
 
 void level_update(Level *level, double dt);
 
-void level_draw(Level *level);
+// alpha is how far the frame is between the last update and the next one
+void level_draw(Level *level, double alpha);
 
-void level_keyup(Level *level, const char *key);
+void level_keyup(Level *level, int key);
 
-void level_keydown(Level *level, const char *key);
+void level_keydown(Level *level, int key);
 
 void level_mouseup(Level *level, const char *button, const char *state, int x, int y);
 
@@ -32,4 +92,19 @@ void level_mousedown(Level *level, const char *button, const char *state, int x,
 
 void level_mousemove(Level *level, const char *state, int x, int y, int relx, int rely);
 
+// Stops the automatic collector, the work is then done by level_collect
+// within budget seconds per frame, with a full cycle past ceiling_kb
+void level_gc_control(Level *level, LevelGC *gc, double budget, int ceiling_kb);
+
+// Runs collector slices until the frame budget is used, after present. Between
+// cycles nothing runs until the heap grows past the pause, as the automatic
+// collector does.
+void level_collect(Level *level, LevelGC *gc);
+
+// Prints and resets the statistics
+void level_gc_report(LevelGC *gc);
+
+// Delivers the queued input in batched mode, called once per frame before update
+void level_flush_events(Level *level);
+
 #endif // LEVEL_H
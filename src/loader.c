@@ -0,0 +1,419 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "loader.h"
+#include "trace.h"
+#include "graphics.h"
+#include "fonts.h"
+#include "sound.h"
+#include "archive.h"
+
+typedef struct {
+    SDL_Thread *threads[LOADER_MAX_THREADS];
+    int thread_count;
+    bool quit;
+
+    SDL_mutex *mutex;
+    SDL_cond *work;         // Signaled when a job is queued
+    SDL_cond *finished;     // Signaled when a worker finishes a job
+
+    // Both lists are FIFO and guarded by mutex
+    LoadJob *queue;
+    LoadJob *queue_tail;
+    LoadJob *done;
+    LoadJob *done_tail;
+
+    int outstanding;        // Queued or being decoded
+
+    // Progress of the current loading round, main thread only
+    int requested;
+    int completed;
+} Loader;
+
+static Loader *loader = NULL;
+
+static UserdataType RequestType = {"AssetRequest"};
+
+static UserdataType *const request_types[ASSET_TYPES] = {
+        [ASSET_SPRITE_SET] = &SpriteSetType,
+        [ASSET_FONT] = &FontType,
+        [ASSET_SOUND_EFFECT] = &SoundEffectType,
+        [ASSET_MUSIC] = &SoundMusicType,
+};
+
+static void job_append(LoadJob **head, LoadJob **tail, LoadJob *job) {
+    job->next = NULL;
+    if (*tail == NULL)
+        *head = job;
+    else
+        (*tail)->next = job;
+    *tail = job;
+}
+
+// Runs on a worker: everything but the parts that need the renderer
+static void loader_decode(LoadJob *job) {
+    switch (job->type) {
+        case ASSET_SPRITE_SET: {
+            SDL_Surface *loaded = archive_load_image(job->filename);
+            if (loaded == NULL) {
+                printf("error on loading sprite atlas: %s\n", IMG_GetError());
+                break;
+            }
+            // Converted here so the upload is a plain copy, packed images already are
+            if (loaded->format->format == SDL_PIXELFORMAT_ARGB8888) {
+                job->surface = loaded;
+                break;
+            }
+            job->surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+            SDL_FreeSurface(loaded);
+            break;
+        }
+        case ASSET_FONT:
+            // Packed fonts are read in place when the font is opened
+            if (archive_find(job->filename) != NULL) {
+                job->packed = true;
+                break;
+            }
+            job->file_data = SDL_LoadFile(job->filename, &job->file_size);
+            if (job->file_data == NULL)
+                printf("error on loading font: %s\n", SDL_GetError());
+            break;
+        case ASSET_SOUND_EFFECT:
+            job->sound = sound_load_effect(job->filename);
+            break;
+        case ASSET_MUSIC:
+            job->sound = sound_load_music(job->filename);
+            break;
+        default:
+            break;
+    }
+
+    job->failed = job->surface == NULL && job->file_data == NULL && job->sound == NULL && !job->packed;
+}
+
+static int loader_worker(void *data) {
+    trace_thread_name("loader");
+    SDL_LockMutex(loader->mutex);
+    while (true) {
+        while (loader->queue == NULL && !loader->quit)
+            SDL_CondWait(loader->work, loader->mutex);
+
+        if (loader->quit)
+            break;
+
+        LoadJob *job = loader->queue;
+        loader->queue = job->next;
+        if (loader->queue == NULL)
+            loader->queue_tail = NULL;
+
+        SDL_UnlockMutex(loader->mutex);
+        trace_begin("loader_decode");
+        loader_decode(job);
+        trace_end();
+        SDL_LockMutex(loader->mutex);
+
+        job_append(&loader->done, &loader->done_tail, job);
+        loader->outstanding--;
+        SDL_CondBroadcast(loader->finished);
+    }
+    SDL_UnlockMutex(loader->mutex);
+    return 0;
+}
+
+static void loader_start() {
+    if (loader != NULL)
+        return;
+
+    loader = calloc(1, sizeof(Loader));
+    loader->mutex = SDL_CreateMutex();
+    loader->work = SDL_CreateCond();
+    loader->finished = SDL_CreateCond();
+
+    // Leave a core to the main thread
+    int threads = SDL_GetCPUCount() - 1;
+    if (threads < 1)
+        threads = 1;
+    if (threads > LOADER_MAX_THREADS)
+        threads = LOADER_MAX_THREADS;
+
+    for (int i = 0; i < threads; i++) {
+        SDL_Thread *thread = SDL_CreateThread(loader_worker, "loader", NULL);
+        if (thread == NULL)
+            panic("loader: could not create thread: %s\n", SDL_GetError());
+        loader->threads[loader->thread_count++] = thread;
+    }
+}
+
+// Frees whatever the worker decoded and nobody took
+static void loader_discard(LoadJob *job) {
+    if (job->surface != NULL)
+        SDL_FreeSurface(job->surface);
+    if (job->sound != NULL && job->type == ASSET_SOUND_EFFECT)
+        sound_free_effect(job->sound);
+    if (job->sound != NULL && job->type == ASSET_MUSIC)
+        sound_free_music(job->sound);
+    SDL_free(job->file_data);
+    if (job->asset != NULL)
+        asset_release(job->asset);
+
+    free(job->key);
+    free(job->filename);
+    free(job);
+}
+
+// Returns the asset with a reference for the caller, or NULL when it failed
+static Asset *loader_finish(LoadJob *job) {
+    Asset *asset = job->asset;
+    job->asset = NULL;
+    if (asset != NULL)
+        return asset;
+
+    // Someone loaded it in the meantime, the decoded copy is dropped
+    asset = asset_find(job->key);
+    if (asset != NULL || job->failed)
+        return asset;
+
+    switch (job->type) {
+        case ASSET_SPRITE_SET: {
+            SpriteSet *set = graphics_sprite_set_from_surface(job->surface, job->width, job->height);
+            return set != NULL ? graphics_register_sprite_set(job->key, set) : NULL;
+        }
+        case ASSET_FONT: {
+            Font *font = job->packed ? font_load(job->filename, job->width)
+                                     : font_load_memory(job->file_data, job->file_size, job->width);
+            job->file_data = NULL;
+            return font != NULL ? font_register(job->key, font) : NULL;
+        }
+        case ASSET_SOUND_EFFECT:
+            asset = sound_register_effect(job->key, job->sound);
+            job->sound = NULL;
+            return asset;
+        case ASSET_MUSIC:
+            asset = sound_register_music(job->key, job->sound);
+            job->sound = NULL;
+            return asset;
+        default:
+            return NULL;
+    }
+}
+
+void loader_update(lua_State *L) {
+    if (loader == NULL)
+        return;
+
+    SDL_LockMutex(loader->mutex);
+    LoadJob *job = loader->done;
+    loader->done = NULL;
+    loader->done_tail = NULL;
+    SDL_UnlockMutex(loader->mutex);
+
+    while (job != NULL) {
+        LoadJob *next = job->next;
+        Asset *asset = loader_finish(job);
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, job->request_ref);
+        AssetRequest *request = lua_touserdata(L, -1);
+
+        if (asset != NULL) {
+            asset_push_handle(L, asset, asset->data, request_types[job->type]);
+            lua_setuservalue(L, -2);
+            request->state = REQUEST_READY;
+        } else {
+            request->state = REQUEST_FAILED;
+        }
+        loader->completed++;
+
+        if (job->callback_ref != LUA_NOREF) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, job->callback_ref);
+            lua_getuservalue(L, -2);
+            if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+                printf("loader: %s callback failed: %s\n", job->filename, lua_tostring(L, -1));
+                lua_pop(L, 1);
+            }
+            luaL_unref(L, LUA_REGISTRYINDEX, job->callback_ref);
+        }
+
+        lua_pop(L, 1);
+        luaL_unref(L, LUA_REGISTRYINDEX, job->request_ref);
+        loader_discard(job);
+        job = next;
+    }
+}
+
+void loader_quit() {
+    if (loader == NULL)
+        return;
+
+    SDL_LockMutex(loader->mutex);
+    loader->quit = true;
+    SDL_CondBroadcast(loader->work);
+    SDL_UnlockMutex(loader->mutex);
+
+    for (int i = 0; i < loader->thread_count; i++)
+        SDL_WaitThread(loader->threads[i], NULL);
+
+    LoadJob *lists[] = {loader->queue, loader->done};
+    for (int i = 0; i < 2; i++) {
+        LoadJob *job = lists[i];
+        while (job != NULL) {
+            LoadJob *next = job->next;
+            loader_discard(job);
+            job = next;
+        }
+    }
+
+    SDL_DestroyCond(loader->work);
+    SDL_DestroyCond(loader->finished);
+    SDL_DestroyMutex(loader->mutex);
+    free(loader);
+    loader = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static int loader_request(lua_State *L, AssetType type, const char *key, const char *filename,
+                          int width, int height, int callback) {
+    loader_start();
+
+    AssetRequest *request = udata_new(L, sizeof(AssetRequest), &RequestType);
+    request->state = REQUEST_PENDING;
+
+    LoadJob *job = calloc(1, sizeof(LoadJob));
+    job->type = type;
+    job->key = strdup(key);
+    job->filename = strdup(filename);
+    job->width = width;
+    job->height = height;
+
+    lua_pushvalue(L, -1);
+    job->request_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    job->callback_ref = LUA_NOREF;
+    if (lua_isfunction(L, callback)) {
+        lua_pushvalue(L, callback);
+        job->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    // A new round starts once everything requested before is done
+    if (loader->completed == loader->requested) {
+        loader->requested = 0;
+        loader->completed = 0;
+    }
+    loader->requested++;
+
+    // Loaded assets skip the workers but still complete in loader_update
+    job->asset = asset_find(key);
+
+    SDL_LockMutex(loader->mutex);
+    if (job->asset != NULL) {
+        job_append(&loader->done, &loader->done_tail, job);
+    } else {
+        job_append(&loader->queue, &loader->queue_tail, job);
+        loader->outstanding++;
+        SDL_CondSignal(loader->work);
+    }
+    SDL_UnlockMutex(loader->mutex);
+    return 1;
+}
+
+int api_loader_sprite_set(lua_State *L) {
+    const char *filename = luaL_checkstring(L, 1);
+    int sprite_width = luaL_checkinteger(L, 2);
+    int sprite_height = luaL_checkinteger(L, 3);
+    const char *key = lua_pushfstring(L, ASSET_KEY_SPRITE_SET, filename, sprite_width, sprite_height);
+    return loader_request(L, ASSET_SPRITE_SET, key, filename, sprite_width, sprite_height, 4);
+}
+
+int api_loader_font(lua_State *L) {
+    const char *filename = luaL_checkstring(L, 1);
+    int font_size = luaL_checkinteger(L, 2);
+    const char *key = lua_pushfstring(L, ASSET_KEY_FONT, filename, font_size);
+    return loader_request(L, ASSET_FONT, key, filename, font_size, 0, 3);
+}
+
+int api_loader_sfx(lua_State *L) {
+    const char *filename = luaL_checkstring(L, 1);
+    const char *key = lua_pushfstring(L, ASSET_KEY_SOUND_EFFECT, filename);
+    return loader_request(L, ASSET_SOUND_EFFECT, key, filename, 0, 0, 2);
+}
+
+int api_loader_music(lua_State *L) {
+    const char *filename = luaL_checkstring(L, 1);
+    const char *key = lua_pushfstring(L, ASSET_KEY_MUSIC, filename);
+    return loader_request(L, ASSET_MUSIC, key, filename, 0, 0, 2);
+}
+
+int api_loader_progress(lua_State *L) {
+    int requested = loader != NULL ? loader->requested : 0;
+    int completed = loader != NULL ? loader->completed : 0;
+    lua_pushnumber(L, requested > 0 ? (double) completed / requested : 1.0);
+    lua_pushinteger(L, completed);
+    lua_pushinteger(L, requested);
+    return 3;
+}
+
+// Blocks until every queued job is decoded and completes them
+int api_loader_wait(lua_State *L) {
+    if (loader == NULL)
+        return 0;
+
+    SDL_LockMutex(loader->mutex);
+    while (loader->outstanding > 0)
+        SDL_CondWait(loader->finished, loader->mutex);
+    SDL_UnlockMutex(loader->mutex);
+
+    loader_update(L);
+    return 0;
+}
+
+int api_request_ready(lua_State *L) {
+    AssetRequest *request = udata_check(L, 1, &RequestType);
+    lua_pushboolean(L, request->state != REQUEST_PENDING);
+    return 1;
+}
+
+int api_request_failed(lua_State *L) {
+    AssetRequest *request = udata_check(L, 1, &RequestType);
+    lua_pushboolean(L, request->state == REQUEST_FAILED);
+    return 1;
+}
+
+int api_request_get(lua_State *L) {
+    udata_check(L, 1, &RequestType);
+    lua_getuservalue(L, 1);
+    return 1;
+}
+
+static const struct luaL_Reg request_methods[] = {
+        {"ready",  api_request_ready},
+        {"failed", api_request_failed},
+        {"get",    api_request_get},
+        {NULL, NULL}
+};
+
+static const struct luaL_Reg loader_funcs[] = {
+        {"load_sprite_set", api_loader_sprite_set},
+        {"load_font",       api_loader_font},
+        {"load_sfx",        api_loader_sfx},
+        {"load_music",      api_loader_music},
+        {"progress",        api_loader_progress},
+        {"wait",            api_loader_wait},
+        {NULL, NULL}
+};
+
+int module_loader(lua_State *L) {
+    lua_newtable(L);
+    luaL_setfuncs(L, loader_funcs, 0);
+    return 1;
+}
+
+void api_loader_open(lua_State *L) {
+    udata_register(L, &RequestType);
+    lua_newtable(L);
+    luaL_setfuncs(L, request_methods, 0);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_requiref(L, "core.loader", module_loader, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,54 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "core.h"
+#include "assets.h"
+
+#define LOADER_MAX_THREADS 4
+
+// An asset requested in background. Workers read and decode the file into
+// CPU side buffers, the main thread turns them into assets in loader_update.
+typedef struct LoadJob {
+    AssetType type;
+    char *key;
+    char *filename;
+    int width;          // Sprite width or font size
+    int height;         // Sprite height
+
+    // Filled by the worker
+    SDL_Surface *surface;
+    void *sound;        // SoundEffect or SoundMusic
+    void *file_data;
+    size_t file_size;
+    bool packed;        // Read in place from the asset archive
+    bool failed;
+
+    // Already loaded asset, when the job was only queued to finish later
+    Asset *asset;
+
+    int request_ref;    // The AssetRequest userdata
+    int callback_ref;
+    struct LoadJob *next;
+} LoadJob;
+
+typedef enum {
+    REQUEST_PENDING, REQUEST_READY, REQUEST_FAILED
+} RequestState;
+
+// What Lua holds while waiting, the asset handle goes in its user value
+typedef struct {
+    RequestState state;
+} AssetRequest;
+
+
+// Turns finished jobs into assets and runs the completion callbacks
+void loader_update(lua_State *L);
+
+// Stops the workers and drops jobs that did not finish
+void loader_quit();
+
+void api_loader_open(lua_State *L);
+
+#endif // LOADER_H
@@ -3,6 +3,11 @@
 #include "core.h"
 #include "scripting.h"
 #include "level.h"
+#include "pacing.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+#include "replay.h"
 
 SDL_Window *window;
 SDL_Renderer *renderer;
@@ -14,11 +19,162 @@ typedef enum {
 } GameState;
 
 GameState state = GAME_RUNNING;
+bool focused = true;
+FrameStats frame_stats;
+Replay replay;
+
+// Headless runs render into an offscreen surface with a fixed dt and quit
+// after a fixed number of frames, optionally saving some of them as PNG.
+typedef struct {
+    bool enabled;
+    int frames;
+    double dt;
+    int seed;
+    const char *dump_dir;
+    int *dump_frames;
+    int dump_count;
+} Headless;
+
+// Input recordings, see replay.h
+typedef struct {
+    const char *record;
+    const char *play;
+    double dt;
+} ReplayOptions;
+
+static void parse_dump_frames(Headless *headless, const char *list) {
+    char *copy = strdup(list);
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        headless->dump_frames = realloc(headless->dump_frames, sizeof(int) * (headless->dump_count + 1));
+        headless->dump_frames[headless->dump_count++] = atoi(tok);
+    }
+    free(copy);
+}
+
+static void parse_arguments(Headless *headless, ReplayOptions *options, int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(arg, "--headless") == 0) {
+            headless->enabled = true;
+        } else if (strcmp(arg, "--frames") == 0 && has_value) {
+            headless->frames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--dt") == 0 && has_value) {
+            headless->dt = atof(argv[++i]);
+        } else if (strcmp(arg, "--seed") == 0 && has_value) {
+            headless->seed = atoi(argv[++i]);
+        } else if (strcmp(arg, "--dump") == 0 && has_value) {
+            parse_dump_frames(headless, argv[++i]);
+        } else if (strcmp(arg, "--dump-dir") == 0 && has_value) {
+            headless->dump_dir = argv[++i];
+        } else if (strcmp(arg, "--record") == 0 && has_value) {
+            options->record = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && has_value) {
+            options->play = argv[++i];
+        } else if (strcmp(arg, "--replay-dt") == 0 && has_value) {
+            options->dt = atof(argv[++i]);
+        } else {
+            panic("Unknown argument: %s\n", arg);
+        }
+    }
+}
+
+static bool should_dump(Headless *headless, int frame) {
+    for (int i = 0; i < headless->dump_count; i++) {
+        if (headless->dump_frames[i] == frame)
+            return true;
+    }
+    return false;
+}
+
+static void dump_frame(Headless *headless, SDL_Surface *target, int frame) {
+    char *filename = NULL;
+    asprintf(&filename, "%s/frame_%05d.png", headless->dump_dir, frame);
+    if (IMG_SavePNG(target, filename) != 0)
+        printf("error on saving frame %s: %s\n", filename, IMG_GetError());
+    free(filename);
+}
+
+static void handle_event(Level *level, SDL_Event *ev) {
+    if (ev->type == SDL_QUIT) {
+        state = GAME_QUIT;
+    } else if (ev->type == SDL_KEYUP) {
+        if (state == GAME_RUNNING)
+            replay_keyup(&replay, level, ev->key.keysym.scancode);
+    } else if (ev->type == SDL_KEYDOWN) {
+        if (ev->key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
+            state = GAME_QUIT;
+            return;
+        } else if (ev->key.keysym.scancode == SDL_SCANCODE_F5) {
+            if (state == GAME_RUNNING)
+                state = GAME_PAUSE;
+            else
+                state = GAME_RUNNING;
+        } else if (ev->key.keysym.scancode == SDL_SCANCODE_F6) {
+            profiler_toggle(level->script->L);
+            return;
+        } else if (ev->key.keysym.scancode == SDL_SCANCODE_F7) {
+            frame_stats.overlay = !frame_stats.overlay;
+            return;
+        } else if (ev->key.keysym.scancode == SDL_SCANCODE_F8) {
+            trace_capture(0);
+            return;
+        }
+
+        if (state == GAME_RUNNING)
+            replay_keydown(&replay, level, ev->key.keysym.scancode);
+    } else if (ev->type == SDL_MOUSEBUTTONDOWN) {
+        int x = ev->button.x;
+        int y = ev->button.y;
+
+        if (state == GAME_RUNNING)
+            replay_mousedown(&replay, level, get_mouse_button(ev->button), get_mouse_state(ev->button), x, y);
+    } else if (ev->type == SDL_MOUSEBUTTONUP) {
+        int x = ev->button.x;
+        int y = ev->button.y;
+
+        if (state == GAME_RUNNING)
+            replay_mouseup(&replay, level, get_mouse_button(ev->button), get_mouse_state(ev->button), x, y);
+    } else if (ev->type == SDL_MOUSEMOTION) {
+        int x = ev->motion.x;
+        int y = ev->motion.y;
+        int relx = ev->motion.xrel;
+        int rely = ev->motion.yrel;
+
+        if (state == GAME_RUNNING)
+            replay_mousemove(&replay, level, get_mouse_state(ev->button), x, y, relx, rely);
+    } else if (ev->type == SDL_WINDOWEVENT) {
+        if (ev->window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+            focused = false;
+        else if (ev->window.event == SDL_WINDOWEVENT_FOCUS_GAINED)
+            focused = true;
+    }
+}
 
 int main(int argc, char **argv) {
     Script *settings = script_new();
     script_load(settings, "scripts/settings.lua");
 
+    Headless headless;
+    headless.enabled = script_get_bool(settings, "headless", false);
+    headless.frames = script_get_integer(settings, "headless_frames");
+    headless.dt = script_get_number(settings, "headless_dt", 1.0 / 60.0);
+    headless.seed = script_get_integer(settings, "headless_seed");
+    headless.dump_dir = ".";
+    headless.dump_frames = NULL;
+    headless.dump_count = 0;
+    ReplayOptions replay_options = {NULL, NULL, 0};
+    parse_arguments(&headless, &replay_options, argc, argv);
+
+    if (headless.frames <= 0)
+        headless.frames = 600;
+
+    // Loose files are used for whatever the archive does not have
+    const char *archive_file = script_get_string(settings, "archive");
+    if (archive_file != NULL && !archive_open(archive_file))
+        printf("archive: %s not found, loading loose files\n", archive_file);
+
     const char *title = script_get_string(settings, "title");
     screen_width = script_get_integer(settings, "screen_width");
     screen_height = script_get_integer(settings, "screen_height");
@@ -27,28 +183,67 @@ int main(int argc, char **argv) {
     const bool full_screen = script_get_bool(settings, "full_screen", false);
     const bool mouse_grab = script_get_bool(settings, "mouse_grab", false);
     SDL_Color background = script_get_color(settings, "background");
+    const bool vsync = script_get_bool(settings, "vsync", true);
+    const int max_fps = script_get_integer(settings, "max_fps");
+    const double fixed_dt = script_get_number(settings, "fixed_dt", 1.0 / 60.0);
+    const int max_steps = script_get_integer(settings, "max_steps");
+    const bool idle_unfocused = script_get_bool(settings, "idle_unfocused", true);
+    const double gc_budget = script_get_number(settings, "gc_budget_ms", 1.0) / 1000.0;
+    const int gc_ceiling = script_get_integer(settings, "gc_ceiling_mb") * 1024;
+    const bool gc_report = script_get_bool(settings, "gc_report", false);
+    const bool stats_overlay = script_get_bool(settings, "stats_overlay", false);
+    const int stats_frames = script_get_integer(settings, "stats_frames");
+    const char *stats_csv = script_get_string(settings, "stats_csv");
+    const char *stats_font = script_get_string(settings, "stats_font");
+    const int stats_font_size = script_get_integer(settings, "stats_font_size");
+    trace_configure(script_get_integer(settings, "trace_frames"), script_get_string(settings, "trace_output"));
+    profiler_configure(script_get_integer(settings, "profiler_interval"), script_get_string(settings, "profiler_output"));
 
     ////////////// INIT
 
+    SDL_Surface *target = NULL;
+
+    if (headless.enabled) {
+        // No display or sound card is needed, SDL still needs drivers to init
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         panic("Could not initialize SDL_Init: %s\n", SDL_GetError());
     }
 
-    Uint32 window_flags = full_screen ? SDL_WINDOW_FULLSCREEN_DESKTOP : SDL_WINDOW_SHOWN;
-    window = SDL_CreateWindow(title,
-                              SDL_WINDOWPOS_UNDEFINED,
-                              SDL_WINDOWPOS_UNDEFINED,
-                              screen_width,
-                              screen_height,
-                              window_flags);
+    if (headless.enabled) {
+        target = SDL_CreateRGBSurfaceWithFormat(0, screen_width, screen_height, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (target == NULL) {
+            panic("Could not create offscreen target: %s\n", SDL_GetError());
+        }
 
-    if (window == NULL) {
-        panic("Could not initialize Window: %s\n", SDL_GetError());
-    }
+        renderer = SDL_CreateSoftwareRenderer(target);
+        if (renderer == NULL) {
+            panic("Could not initialize Renderer: %s\n", SDL_GetError());
+        }
+    } else {
+        Uint32 window_flags = full_screen ? SDL_WINDOW_FULLSCREEN_DESKTOP : SDL_WINDOW_SHOWN;
+        window = SDL_CreateWindow(title,
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  screen_width,
+                                  screen_height,
+                                  window_flags);
+
+        if (window == NULL) {
+            panic("Could not initialize Window: %s\n", SDL_GetError());
+        }
+
+        Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+        if (vsync)
+            renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (renderer == NULL) {
-        panic("Could not initialize Renderer: %s\n", SDL_GetError());
+        renderer = SDL_CreateRenderer(window, -1, renderer_flags);
+        if (renderer == NULL) {
+            panic("Could not initialize Renderer: %s\n", SDL_GetError());
+        }
     }
 
     if (quality_linear)
@@ -66,16 +261,38 @@ int main(int argc, char **argv) {
         panic("SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError());
     }
 
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
+    if (Mix_OpenAudio(SOUND_FREQUENCY, SOUND_FORMAT, SOUND_CHANNELS, SOUND_CHUNK_SIZE) < 0) {
         panic("SDL_mixer could not initialize! SDL_mixer Error: %s\n", Mix_GetError());
     }
 
-    SDL_ShowCursor(show_cursor ? 1 : 0);
-    SDL_SetWindowMouseGrab(window, mouse_grab ? SDL_TRUE : SDL_FALSE);
+    if (!headless.enabled) {
+        SDL_ShowCursor(show_cursor ? 1 : 0);
+        SDL_SetWindowMouseGrab(window, mouse_grab ? SDL_TRUE : SDL_FALSE);
+    }
 
     Script *level1 = script_new();
     script_open_libraries(level1);
 
+    // Recordings keep the seed they were made with
+    replay_init(&replay);
+    if (replay_options.play != NULL) {
+        if (!replay_play(&replay, replay_options.play, replay_options.dt))
+            panic("Could not replay %s\n", replay_options.play);
+    } else if (replay_options.record != NULL) {
+        int seed = headless.enabled ? headless.seed : (int) (SDL_GetPerformanceCounter() & 0x7FFFFFFF);
+        if (!replay_record(&replay, replay_options.record, seed))
+            panic("Could not record %s\n", replay_options.record);
+    }
+
+    // Scripts seed their random generator with it, so headless runs and
+    // recordings repeat. Deterministic runs do not depend on loading times.
+    if (replay.mode != REPLAY_OFF)
+        script_set_integer(level1, "RANDOM_SEED", replay.seed);
+    else if (headless.enabled)
+        script_set_integer(level1, "RANDOM_SEED", headless.seed);
+    script_set_bool(level1, "HEADLESS", headless.enabled);
+    script_set_bool(level1, "DETERMINISTIC", headless.enabled || replay.mode != REPLAY_OFF);
+
     script_load(level1, "scripts/game.lua");
 
     Level *level = NULL;
@@ -83,62 +300,89 @@ int main(int argc, char **argv) {
 
     SDL_Event ev;
 
-    double deltaTime = 0.0;
-    double lastTime = (double) SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
-    double currentTime;
-
     level_load(level);
 
+    stats_init(&frame_stats, stats_frames, stats_font != NULL ? font_load(stats_font, stats_font_size) : NULL);
+    frame_stats.overlay = stats_overlay;
+
+    LevelGC gc;
+    level_gc_control(level, &gc, gc_budget, gc_ceiling);
+
+    Pacing pacing;
+    pacing_init(&pacing, fixed_dt, max_steps, headless.enabled ? 0 : max_fps);
+
+    trace_thread_name("main");
+
+    int frame = 0;
+    double headless_start = pacing_now();
+    double gc_report_time = headless_start;
+    bool was_idle = false;
+
     while (state != GAME_QUIT) {
-        while (SDL_PollEvent(&ev) != 0) {
-            if (ev.type == SDL_QUIT) {
+        stats_begin_frame(&frame_stats);
+
+        // Nothing to simulate or show, sleep until something happens
+        bool idle = !headless.enabled && (state == GAME_PAUSE || (!focused && idle_unfocused));
+        if (idle && SDL_WaitEventTimeout(&ev, PACING_IDLE_WAIT_MS) != 0)
+            handle_event(level, &ev);
+
+        // Every frame zone holds the events it handled
+        trace_frame_begin();
+        trace_begin("events");
+        while (SDL_PollEvent(&ev) != 0)
+            handle_event(level, &ev);
+        trace_end();
+        stats_end(&frame_stats, STATS_EVENTS);
+
+        if (idle) {
+            was_idle = true;
+            trace_frame_end();
+            continue;
+        }
+
+        if (state == GAME_RUNNING) {
+            // The time spent idle is not simulated
+            if (was_idle) {
+                pacing_reset(&pacing);
+                was_idle = false;
+            }
+
+            // The end of a replay ends the run
+            if (!replay_begin_frame(&replay, level)) {
                 state = GAME_QUIT;
+                trace_frame_end();
                 continue;
-            } else if (ev.type == SDL_KEYUP) {
-                if (state == GAME_RUNNING)
-                    level_keyup(level, SDL_GetScancodeName(ev.key.keysym.scancode));
-            } else if (ev.type == SDL_KEYDOWN) {
-                if (ev.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
-                    state = GAME_QUIT;
-                    continue;
-                } else if (ev.key.keysym.scancode == SDL_SCANCODE_F5) {
-                    if (state == GAME_RUNNING)
-                        state = GAME_PAUSE;
-                    else
-                        state = GAME_RUNNING;
-                }
-
-                if (state == GAME_RUNNING)
-                    level_keydown(level, SDL_GetScancodeName(ev.key.keysym.scancode));
-            } else if (ev.type == SDL_MOUSEBUTTONDOWN) {
-                int x = ev.button.x;
-                int y = ev.button.y;
-
-                if (state == GAME_RUNNING)
-                    level_mousedown(level, get_mouse_button(ev.button), get_mouse_state(ev.button), x, y);
-            } else if (ev.type == SDL_MOUSEBUTTONUP) {
-                int x = ev.button.x;
-                int y = ev.button.y;
-
-                if (state == GAME_RUNNING)
-                    level_mouseup(level, get_mouse_button(ev.button), get_mouse_state(ev.button), x, y);
-            } else if (ev.type == SDL_MOUSEMOTION) {
-                int x = ev.motion.x;
-                int y = ev.motion.y;
-                int relx = ev.motion.xrel;
-                int rely = ev.motion.yrel;
-
-                if (state == GAME_RUNNING)
-                    level_mousemove(level, get_mouse_state(ev.button), x, y, relx, rely);
             }
-        }
 
-        if (state == GAME_RUNNING) {
-            currentTime = (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
-            deltaTime = currentTime - lastTime;
-            lastTime = currentTime;
-            level_update(level, deltaTime);
+            stats_begin(&frame_stats);
+            trace_begin("update");
+            loader_update(level1->L);
+            level_flush_events(level);
+
+            double alpha = 1.0;
+            double dt;
+            if (replay.mode == REPLAY_PLAY) {
+                pacing_reset(&pacing);
+                while (replay_next_update(&replay, &dt))
+                    level_update(level, dt);
+            } else if (headless.enabled) {
+                level_update(level, headless.dt);
+                replay_update(&replay, headless.dt);
+            } else {
+                pacing_begin_frame(&pacing);
+                while (pacing_step(&pacing)) {
+                    dt = pacing_dt(&pacing);
+                    level_update(level, dt);
+                    replay_update(&replay, dt);
+                }
+                alpha = pacing_alpha(&pacing);
+            }
+            replay_end_frame(&replay);
+            trace_end();
+            stats_end(&frame_stats, STATS_UPDATE);
 
+            stats_begin(&frame_stats);
+            trace_begin("draw");
             SDL_SetRenderDrawColor(
                     renderer,
                     background.r,
@@ -148,19 +392,80 @@ int main(int argc, char **argv) {
             );
 
             SDL_RenderClear(renderer);
-            level_draw(level);
-            SDL_RenderPresent(renderer);
+            level_draw(level, alpha);
+            graphics_flush();
+            if (frame_stats.overlay)
+                stats_draw_overlay(&frame_stats, renderer);
+            trace_end();
+            stats_end(&frame_stats, STATS_DRAW);
+
+            stats_begin(&frame_stats);
+            trace_begin("present");
+            graphics_present();
+            trace_end();
+            stats_end(&frame_stats, STATS_PRESENT);
+
+            stats_begin(&frame_stats);
+            trace_begin("gc");
+            level_collect(level, &gc);
+            trace_end();
+            stats_end(&frame_stats, STATS_GC);
+            stats_end_frame(&frame_stats, level1->L);
+            trace_frame_end();
+            frame++;
+
+            if (gc_report && pacing_now() - gc_report_time >= 1.0) {
+                level_gc_report(&gc);
+                gc_report_time = pacing_now();
+            }
+
+            if (headless.enabled) {
+                if (should_dump(&headless, frame))
+                    dump_frame(&headless, target, frame);
+
+                // Replays run to the end of the recording
+                if (frame >= headless.frames && replay.mode != REPLAY_PLAY)
+                    state = GAME_QUIT;
+            }
+
+            pacing_end_frame(&pacing);
+        } else {
+            trace_frame_end();
         }
     }
 
+    if (headless.enabled) {
+        double elapsed = pacing_now() - headless_start;
+        printf("headless: %d frames in %.3f s, %.3f ms/frame\n", frame, elapsed, elapsed * 1000.0 / frame);
+        level_gc_report(&gc);
+    }
+
+    // A capture cut short by quitting is still written
+    trace_stop();
+    replay_close(&replay);
+
+    stats_report(&frame_stats);
+    if (stats_csv != NULL)
+        stats_save_csv(&frame_stats, stats_csv);
+    stats_free(&frame_stats);
+
+    if (profiler_running())
+        profiler_toggle(level1->L);
+
+    loader_quit();
     level_free(level);
     script_free(level1);
     SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (window != NULL)
+        SDL_DestroyWindow(window);
+    if (target != NULL)
+        SDL_FreeSurface(target);
+    free(headless.dump_frames);
     graphics_quit();
     Mix_Quit();
     TTF_Quit();
     IMG_Quit();
+    archive_close();
     SDL_Quit();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,78 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "pacing.h"
+
+double pacing_now() {
+    return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+}
+
+void pacing_init(Pacing *pacing, double fixed_dt, int max_steps, int max_fps) {
+    pacing->fixed_dt = fixed_dt > 0 ? fixed_dt : 0;
+    pacing->max_steps = max_steps > 0 ? max_steps : PACING_MAX_STEPS;
+    pacing->max_fps = max_fps > 0 ? max_fps : 0;
+    pacing_reset(pacing);
+}
+
+void pacing_reset(Pacing *pacing) {
+    pacing->accumulator = 0;
+    pacing->frame_start = pacing_now();
+    pacing->frame_time = 0;
+    pacing->steps = 0;
+}
+
+void pacing_begin_frame(Pacing *pacing) {
+    double now = pacing_now();
+    double elapsed = now - pacing->frame_start;
+    pacing->frame_start = now;
+    pacing->frame_time = elapsed < PACING_MAX_FRAME_TIME ? elapsed : PACING_MAX_FRAME_TIME;
+    pacing->accumulator += pacing->frame_time;
+    pacing->steps = 0;
+}
+
+bool pacing_step(Pacing *pacing) {
+    if (pacing->fixed_dt == 0) {
+        // Variable time step, the whole frame is one update
+        if (pacing->steps > 0)
+            return false;
+        pacing->accumulator = 0;
+        pacing->steps++;
+        return true;
+    }
+
+    if (pacing->accumulator < pacing->fixed_dt)
+        return false;
+
+    if (pacing->steps == pacing->max_steps) {
+        // Too far behind to catch up, slow down instead of spiralling
+        pacing->accumulator = fmod(pacing->accumulator, pacing->fixed_dt);
+        return false;
+    }
+
+    pacing->accumulator -= pacing->fixed_dt;
+    pacing->steps++;
+    return true;
+}
+
+double pacing_dt(Pacing *pacing) {
+    return pacing->fixed_dt > 0 ? pacing->fixed_dt : pacing->frame_time;
+}
+
+double pacing_alpha(Pacing *pacing) {
+    if (pacing->fixed_dt == 0)
+        return 1.0;
+    return pacing->accumulator / pacing->fixed_dt;
+}
+
+void pacing_end_frame(Pacing *pacing) {
+    if (pacing->max_fps == 0)
+        return;
+
+    double target = pacing->frame_start + 1.0 / pacing->max_fps;
+    double remaining = target - pacing_now();
+
+    // SDL_Delay may oversleep by a millisecond or more, the last part is spun
+    if (remaining > PACING_SPIN_TIME)
+        SDL_Delay((Uint32) ((remaining - PACING_SPIN_TIME) * 1000.0));
+
+    while (pacing_now() < target) {}
+}
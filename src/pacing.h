@@ -0,0 +1,49 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef PACING_H
+#define PACING_H
+
+#include "core.h"
+
+#define PACING_MAX_FRAME_TIME 0.25  // Longer frames (a breakpoint, a drag) are clamped
+#define PACING_SPIN_TIME 0.002      // The end of a capped frame is waited by spinning
+#define PACING_IDLE_WAIT_MS 100     // Event wait while paused or unfocused
+#define PACING_MAX_STEPS 5          // Default for max_steps
+
+// Frame timing of the main loop. The simulation runs at fixed_dt steps taken
+// from an accumulator of real time, and rendering happens once per frame,
+// optionally capped at max_fps. fixed_dt 0 runs one update per frame with
+// the measured time instead.
+typedef struct {
+    double fixed_dt;
+    int max_steps;          // Updates per frame at most, the rest of the time is dropped
+    int max_fps;            // 0 leaves it to vsync or runs uncapped
+    double accumulator;
+    double frame_start;
+    double frame_time;      // Measured time of the last frame
+    int steps;              // Updates taken this frame so far
+} Pacing;
+
+double pacing_now();
+
+void pacing_init(Pacing *pacing, double fixed_dt, int max_steps, int max_fps);
+
+// Starts the timing over, after waiting for events or loading
+void pacing_reset(Pacing *pacing);
+
+// Measures the last frame and adds it to the accumulator
+void pacing_begin_frame(Pacing *pacing);
+
+// True while another fixed update is due this frame
+bool pacing_step(Pacing *pacing);
+
+// Time of one update, fixed_dt or the measured frame time
+double pacing_dt(Pacing *pacing);
+
+// How far the time left in the accumulator is into the next step, from 0 to 1
+double pacing_alpha(Pacing *pacing);
+
+// Sleeps, then spins, until the frame cap is reached
+void pacing_end_frame(Pacing *pacing);
+
+#endif // PACING_H
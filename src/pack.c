@@ -0,0 +1,193 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+//
+// Builds the asset archive read by archive_open:
+//
+//   wars_pack assets.pak [--strip] --image assets/ships_packed.png --sound assets/sfx/explosion.wav --script scripts/game.lua
+//
+// Images are decoded to ARGB8888, sounds to PCM in the format the game opens
+// the mixer with, scripts are compiled to bytecode and raw files are copied
+// as they are. Scripts keep their debug information unless --strip is given,
+// tracebacks and the profiler need it for line numbers.
+#include "core.h"
+#include "archive.h"
+#include "sound.h"
+
+typedef struct {
+    ArchiveEntry entry;
+    void *data;
+} PackItem;
+
+static void pack_image(PackItem *item, const char *path) {
+    SDL_Surface *loaded = IMG_Load(path);
+    if (loaded == NULL)
+        panic("pack: could not load image %s: %s\n", path, IMG_GetError());
+
+    SDL_Surface *sur = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+    if (sur == NULL)
+        panic("pack: could not convert image %s: %s\n", path, SDL_GetError());
+
+    // Rows are stored tightly packed
+    int pitch = sur->w * 4;
+    item->entry.kind = ARCHIVE_IMAGE;
+    item->entry.format = SDL_PIXELFORMAT_ARGB8888;
+    item->entry.width = sur->w;
+    item->entry.height = sur->h;
+    item->entry.pitch = pitch;
+    item->entry.size = (Uint64) pitch * sur->h;
+    item->data = malloc(item->entry.size);
+    for (int y = 0; y < sur->h; y++)
+        memcpy((Uint8 *) item->data + y * pitch, (Uint8 *) sur->pixels + y * sur->pitch, pitch);
+    SDL_FreeSurface(sur);
+}
+
+static void pack_sound(PackItem *item, const char *path) {
+    // The mixer converts to its output format while loading
+    Mix_Chunk *chunk = Mix_LoadWAV(path);
+    if (chunk == NULL)
+        panic("pack: could not load sound %s: %s\n", path, Mix_GetError());
+
+    // The device may have opened with another format than the one asked for
+    int frequency;
+    Uint16 format;
+    int channels;
+    Mix_QuerySpec(&frequency, &format, &channels);
+
+    item->entry.kind = ARCHIVE_PCM;
+    item->entry.format = format;
+    item->entry.width = frequency;
+    item->entry.height = channels;
+    item->entry.size = chunk->alen;
+    item->data = malloc(chunk->alen);
+    memcpy(item->data, chunk->abuf, chunk->alen);
+    Mix_FreeChunk(chunk);
+}
+
+static void pack_raw(PackItem *item, const char *path) {
+    size_t size;
+    void *data = SDL_LoadFile(path, &size);
+    if (data == NULL)
+        panic("pack: could not read %s: %s\n", path, SDL_GetError());
+
+    item->entry.kind = ARCHIVE_RAW;
+    item->entry.size = size;
+    item->data = malloc(size);
+    memcpy(item->data, data, size);
+    SDL_free(data);
+}
+
+static int write_bytecode(lua_State *L, const void *p, size_t size, void *ud) {
+    PackItem *item = ud;
+    item->data = realloc(item->data, item->entry.size + size);
+    memcpy((Uint8 *) item->data + item->entry.size, p, size);
+    item->entry.size += size;
+    return 0;
+}
+
+static void pack_script(PackItem *item, const char *path, bool strip) {
+    size_t size;
+    void *data = SDL_LoadFile(path, &size);
+    if (data == NULL)
+        panic("pack: could not read %s: %s\n", path, SDL_GetError());
+
+    // Compiled the same way the game would
+    lua_State *L = luaL_newstate();
+    lua_pushfstring(L, "@%s", path);
+    if (luaL_loadbuffer(L, data, size, lua_tostring(L, -1)) != LUA_OK)
+        panic("pack: could not compile %s: %s\n", path, lua_tostring(L, -1));
+
+    item->entry.kind = ARCHIVE_BYTECODE;
+    item->entry.size = 0;
+    item->data = NULL;
+    lua_dump(L, write_bytecode, item, strip);
+    lua_close(L);
+    SDL_free(data);
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const PackItem *) a)->entry.path, ((const PackItem *) b)->entry.path);
+}
+
+static Uint64 align(Uint64 offset) {
+    return (offset + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN;
+}
+
+int main(int argc, char **argv) {
+    int first = 2;
+    bool strip = argc > 2 && strcmp(argv[2], "--strip") == 0;
+    if (strip)
+        first++;
+    if (argc < 2 || (argc - first) % 2 != 0)
+        panic("usage: %s <archive> [--strip] [--image|--sound|--script|--raw <file>]...\n", argv[0]);
+
+    // Sounds are converted by the mixer, it needs a device even if nothing plays
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    if (SDL_Init(SDL_INIT_AUDIO) < 0)
+        panic("pack: could not initialize SDL: %s\n", SDL_GetError());
+    if (Mix_OpenAudio(SOUND_FREQUENCY, SOUND_FORMAT, SOUND_CHANNELS, SOUND_CHUNK_SIZE) < 0)
+        panic("pack: could not open audio: %s\n", Mix_GetError());
+
+    int count = (argc - first) / 2;
+    PackItem *items = calloc(count, sizeof(PackItem));
+
+    for (int i = 0; i < count; i++) {
+        const char *kind = argv[first + i * 2];
+        const char *path = argv[first + 1 + i * 2];
+        PackItem *item = &items[i];
+
+        if (strlen(path) >= ARCHIVE_PATH_SIZE)
+            panic("pack: path too long: %s\n", path);
+        strcpy(item->entry.path, path);
+
+        if (strcmp(kind, "--image") == 0)
+            pack_image(item, path);
+        else if (strcmp(kind, "--sound") == 0)
+            pack_sound(item, path);
+        else if (strcmp(kind, "--script") == 0)
+            pack_script(item, path, strip);
+        else if (strcmp(kind, "--raw") == 0)
+            pack_raw(item, path);
+        else
+            panic("pack: unknown kind %s\n", kind);
+    }
+
+    // Sorted so the game can binary search the index in place
+    qsort(items, count, sizeof(PackItem), compare_items);
+    for (int i = 1; i < count; i++) {
+        if (strcmp(items[i - 1].entry.path, items[i].entry.path) == 0)
+            panic("pack: %s is listed twice\n", items[i].entry.path);
+    }
+
+    Uint64 offset = align(sizeof(ArchiveHeader) + sizeof(ArchiveEntry) * count);
+    for (int i = 0; i < count; i++) {
+        items[i].entry.offset = offset;
+        offset = align(offset + items[i].entry.size);
+    }
+
+    FILE *file = fopen(argv[1], "wb");
+    if (file == NULL)
+        panic("pack: could not create %s\n", argv[1]);
+
+    ArchiveHeader header = {ARCHIVE_MAGIC, ARCHIVE_VERSION, count, 0};
+    bool ok = fwrite(&header, sizeof(ArchiveHeader), 1, file) == 1;
+    for (int i = 0; ok && i < count; i++)
+        ok = fwrite(&items[i].entry, sizeof(ArchiveEntry), 1, file) == 1;
+
+    for (int i = 0; ok && i < count; i++) {
+        ok = fseek(file, (long) items[i].entry.offset, SEEK_SET) == 0 &&
+             fwrite(items[i].data, 1, items[i].entry.size, file) == items[i].entry.size;
+    }
+
+    if (fclose(file) != 0 || !ok)
+        panic("pack: could not write %s\n", argv[1]);
+
+    printf("pack: %d files in %s\n", count, argv[1]);
+
+    for (int i = 0; i < count; i++)
+        free(items[i].data);
+    free(items);
+    Mix_CloseAudio();
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,305 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "particles.h"
+#include "assets.h"
+
+#define PARTICLE_FIELDS 6
+
+static Emitter *emitters = NULL;
+
+// Own generator so runs with the same inputs spawn the same particles
+static Uint32 random_state = 0x9E3779B9u;
+
+static float random_range(float min, float max) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return min + (max - min) * (float) (random_state >> 8) / (float) (1u << 24);
+}
+
+static void emitter_spawn(Emitter *e, float x, float y) {
+    if (e->count == e->capacity)
+        return;
+
+    float direction = e->angle + random_range(-e->spread / 2, e->spread / 2);
+    float speed = random_range(e->speed_min, e->speed_max);
+
+    int i = e->count++;
+    e->x[i] = x;
+    e->y[i] = y;
+    e->vx[i] = cosf(direction) * speed;
+    e->vy[i] = sinf(direction) * speed;
+    e->age[i] = 0;
+    e->life[i] = e->lifetime + random_range(0, e->lifetime_jitter);
+}
+
+void emitter_burst(Emitter *emitter, float x, float y, int count) {
+    for (int i = 0; i < count; i++)
+        emitter_spawn(emitter, x, y);
+}
+
+static void emitter_update(Emitter *e, float dt) {
+    if (e->rate > 0) {
+        e->pending += e->rate * dt;
+        while (e->pending >= 1) {
+            emitter_spawn(e, e->emit_x, e->emit_y);
+            e->pending -= 1;
+        }
+    }
+
+    float damping = e->drag > 0 ? fmaxf(0, 1 - e->drag * dt) : 1;
+    float *x = e->x, *y = e->y, *vx = e->vx, *vy = e->vy, *age = e->age, *life = e->life;
+
+    int i = 0;
+    while (i < e->count) {
+        age[i] += dt;
+        if (age[i] >= life[i]) {
+            // The last particle takes the slot, order is not kept
+            int last = --e->count;
+            x[i] = x[last];
+            y[i] = y[last];
+            vx[i] = vx[last];
+            vy[i] = vy[last];
+            age[i] = age[last];
+            life[i] = life[last];
+            continue;
+        }
+
+        vx[i] = (vx[i] + e->gravity_x * dt) * damping;
+        vy[i] = (vy[i] + e->gravity_y * dt) * damping;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        i++;
+    }
+}
+
+static void emitter_draw(Emitter *e) {
+    if (e->frame_count == 0)
+        return;
+
+    float half_w = e->set->sprite_width * e->scale / 2;
+    float half_h = e->set->sprite_height * e->scale / 2;
+
+    for (int i = 0; i < e->count; i++) {
+        int frame = (int) (e->age[i] / e->life[i] * e->frame_count);
+        if (frame >= e->frame_count)
+            frame = e->frame_count - 1;
+
+        Vector pos = {e->x[i] - half_w, e->y[i] - half_h};
+        graphics_draw_sprite_set(e->set, pos, e->frame_cols[frame], e->frame_rows[frame], e->scale, false, false);
+    }
+}
+
+void particles_update(double dt) {
+    for (Emitter *e = emitters; e != NULL; e = e->next)
+        emitter_update(e, (float) dt);
+}
+
+void particles_draw() {
+    for (Emitter *e = emitters; e != NULL; e = e->next)
+        emitter_draw(e);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static UserdataType EmitterType = {"Emitter"};
+
+static float get_number_field(lua_State *L, int idx, const char *field, float def) {
+    lua_getfield(L, idx, field);
+    float value = (float) luaL_optnumber(L, -1, def);
+    lua_pop(L, 1);
+    return value;
+}
+
+// Reads a {min, max} pair, or a single number used for both
+static void get_range_field(lua_State *L, int idx, const char *field, float *min, float *max) {
+    if (lua_getfield(L, idx, field) == LUA_TTABLE) {
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        *min = (float) lua_tonumber(L, -2);
+        *max = (float) lua_tonumber(L, -1);
+        lua_pop(L, 2);
+    } else if (lua_isnumber(L, -1)) {
+        *min = *max = (float) lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+}
+
+// Particles.new{sprite_set = set, frames = {{col, row}, ...}, capacity = 256, scale = 1,
+//               life = 1, life_jitter = 0, speed = {min, max}, angle = 0, spread = 0,
+//               gravity = {x, y}, drag = 0, rate = 0}
+int api_particles_new(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    lua_getfield(L, 1, "sprite_set");
+    SpriteSet *set = asset_check(L, -1, &SpriteSetType);
+
+    lua_getfield(L, 1, "capacity");
+    int capacity = (int) luaL_optinteger(L, -1, 256);
+    lua_pop(L, 1);
+    luaL_argcheck(L, capacity > 0, 1, "capacity must be positive");
+
+    Emitter *e = udata_new(L, sizeof(Emitter), &EmitterType);
+    memset(e, 0, sizeof(Emitter));
+
+    // The emitter keeps its sprite set loaded
+    lua_pushvalue(L, -2);
+    lua_setuservalue(L, -2);
+
+    float *fields = malloc(sizeof(float) * PARTICLE_FIELDS * capacity);
+    if (fields == NULL)
+        return luaL_error(L, "particles: out of memory");
+    e->x = fields;
+    e->y = fields + capacity;
+    e->vx = fields + capacity * 2;
+    e->vy = fields + capacity * 3;
+    e->age = fields + capacity * 4;
+    e->life = fields + capacity * 5;
+    e->capacity = capacity;
+    e->set = set;
+
+    if (lua_getfield(L, 1, "frames") == LUA_TTABLE) {
+        int frames = (int) luaL_len(L, -1);
+        luaL_argcheck(L, frames <= PARTICLES_MAX_FRAMES, 1, "too many frames");
+        for (int i = 0; i < frames; i++) {
+            luaL_argcheck(L, lua_rawgeti(L, -1, i + 1) == LUA_TTABLE, 1, "frames must be {col, row} tables");
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            luaL_argcheck(L, lua_isinteger(L, -2) && lua_isinteger(L, -1), 1, "frame col and row must be integers");
+            e->frame_cols[i] = (int) lua_tointeger(L, -2);
+            e->frame_rows[i] = (int) lua_tointeger(L, -1);
+            lua_pop(L, 3);
+        }
+        e->frame_count = frames;
+    }
+    lua_pop(L, 1);
+
+    e->scale = get_number_field(L, 1, "scale", 1);
+    e->lifetime = get_number_field(L, 1, "life", 1);
+    e->lifetime_jitter = get_number_field(L, 1, "life_jitter", 0);
+    e->angle = get_number_field(L, 1, "angle", 0);
+    e->spread = get_number_field(L, 1, "spread", 0);
+    e->drag = get_number_field(L, 1, "drag", 0);
+    e->rate = get_number_field(L, 1, "rate", 0);
+    get_range_field(L, 1, "speed", &e->speed_min, &e->speed_max);
+
+    float gravity_y = 0;
+    get_range_field(L, 1, "gravity", &e->gravity_x, &gravity_y);
+    e->gravity_y = gravity_y;
+
+    e->next = emitters;
+    emitters = e;
+    return 1;
+}
+
+int api_emitter_burst(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    float x = (float) luaL_checknumber(L, 2);
+    float y = (float) luaL_checknumber(L, 3);
+    int count = (int) luaL_optinteger(L, 4, 1);
+    emitter_burst(e, x, y, count);
+    return 0;
+}
+
+int api_emitter_move(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    e->emit_x = (float) luaL_checknumber(L, 2);
+    e->emit_y = (float) luaL_checknumber(L, 3);
+    return 0;
+}
+
+int api_emitter_set_rate(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    e->rate = (float) luaL_checknumber(L, 2);
+    if (e->rate <= 0)
+        e->pending = 0;
+    return 0;
+}
+
+int api_emitter_count(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    lua_pushinteger(L, e->count);
+    return 1;
+}
+
+int api_emitter_clear(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    e->count = 0;
+    e->pending = 0;
+    return 0;
+}
+
+int api_emitter_gc(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    for (Emitter **it = &emitters; *it != NULL; it = &(*it)->next) {
+        if (*it == e) {
+            *it = e->next;
+            break;
+        }
+    }
+    free(e->x);
+    e->x = NULL;
+    return 0;
+}
+
+int api_emitter_tostring(lua_State *L) {
+    Emitter *e = udata_check(L, 1, &EmitterType);
+    lua_pushfstring(L, "Emitter<count: %d, capacity: %d>", e->count, e->capacity);
+    return 1;
+}
+
+int api_particles_update(lua_State *L) {
+    particles_update(luaL_checknumber(L, 1));
+    return 0;
+}
+
+int api_particles_draw(lua_State *L) {
+    particles_draw();
+    return 0;
+}
+
+int api_particles_count(lua_State *L) {
+    int count = 0;
+    for (Emitter *e = emitters; e != NULL; e = e->next)
+        count += e->count;
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+static const struct luaL_Reg emitter_methods[] = {
+        {"burst",      api_emitter_burst},
+        {"move",       api_emitter_move},
+        {"set_rate",   api_emitter_set_rate},
+        {"count",      api_emitter_count},
+        {"clear",      api_emitter_clear},
+        {"__gc",       api_emitter_gc},
+        {"__tostring", api_emitter_tostring},
+        {NULL, NULL}
+};
+
+static const struct luaL_Reg particles_funcs[] = {
+        {"new",    api_particles_new},
+        {"update", api_particles_update},
+        {"draw",   api_particles_draw},
+        {"count",  api_particles_count},
+        {NULL, NULL}
+};
+
+int module_particles(lua_State *L) {
+    udata_register(L, &EmitterType);
+    luaL_setfuncs(L, emitter_methods, 0);
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    luaL_setfuncs(L, particles_funcs, 0);
+    return 1;
+}
+
+void api_particles_open(lua_State *L) {
+    luaL_requiref(L, "core.particles", module_particles, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,59 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "core.h"
+#include "graphics.h"
+
+#define PARTICLES_MAX_FRAMES 32
+
+// A fixed pool of particles sharing one look. Particles are stored as
+// structure of arrays, the first `count` slots are alive and a dead particle
+// is replaced by the last one. Frames are played once over the lifetime.
+typedef struct Emitter {
+    float *x;           // Center in world coordinates
+    float *y;
+    float *vx;
+    float *vy;
+    float *age;
+    float *life;
+    int count;
+    int capacity;
+
+    SpriteSet *set;
+    int frame_cols[PARTICLES_MAX_FRAMES];
+    int frame_rows[PARTICLES_MAX_FRAMES];
+    int frame_count;
+    float scale;
+
+    float lifetime;
+    float lifetime_jitter;
+    float speed_min;
+    float speed_max;
+    float angle;        // Direction of the velocity in radians
+    float spread;       // Velocity directions cover angle +- spread / 2
+    float gravity_x;
+    float gravity_y;
+    float drag;         // Fraction of the velocity lost per second
+
+    // Continuous emission for trails
+    float rate;         // Particles per second, 0 emits only on bursts
+    float pending;
+    float emit_x;
+    float emit_y;
+
+    struct Emitter *next;
+} Emitter;
+
+
+void emitter_burst(Emitter *emitter, float x, float y, int count);
+
+// Updates and draws every live emitter
+void particles_update(double dt);
+
+void particles_draw();
+
+void api_particles_open(lua_State *L);
+
+#endif // PARTICLES_H
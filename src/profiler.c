@@ -0,0 +1,312 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "profiler.h"
+
+static Profiler profiler = {
+        .interval = PROFILER_INTERVAL,
+        .output = PROFILER_OUTPUT
+};
+
+static char *function_label(lua_Debug *ar) {
+    char *label = NULL;
+    const char *name = ar->name != NULL ? ar->name : "?";
+
+    if (ar->what[0] == 'C')
+        asprintf(&label, "%s [C]", name);
+    else if (ar->what[0] == 'm')
+        asprintf(&label, "main %s", ar->short_src);
+    else
+        asprintf(&label, "%s %s:%d", name, ar->short_src, ar->linedefined);
+
+    // Frames are separated by semicolons in the output
+    for (char *c = label; *c != '\0'; c++) {
+        if (*c == ';')
+            *c = ':';
+    }
+    return label;
+}
+
+// Returns the id of the function running in the frame, -1 when the table is full
+static int profiler_intern(lua_Debug *ar) {
+    // Lua functions are told apart by where they are defined, C functions by name
+    const void *source = ar->source;
+    const void *name = ar->what[0] == 'C' ? ar->name : NULL;
+    int line = ar->linedefined;
+
+    uintptr_t hash = (uintptr_t) source * 31 + (uintptr_t) name * 17 + (uintptr_t) line;
+    hash ^= hash >> 15;
+
+    for (int probe = 0; probe < PROFILER_MAX_FUNCTIONS; probe++) {
+        int id = (int) ((hash + probe) & (PROFILER_MAX_FUNCTIONS - 1));
+        ProfilerFunction *fn = &profiler.functions[id];
+
+        if (fn->label == NULL) {
+            fn->source = source;
+            fn->name = name;
+            fn->line = line;
+            fn->label = function_label(ar);
+            return id;
+        }
+
+        if (fn->source == source && fn->name == name && fn->line == line)
+            return id;
+    }
+    return -1;
+}
+
+static Uint32 stack_hash(const int *frames, int depth) {
+    Uint32 hash = 2166136261u;
+    for (int i = 0; i < depth; i++)
+        hash = (hash ^ (Uint32) frames[i]) * 16777619u;
+    return hash;
+}
+
+static ProfilerStack *stack_slot(ProfilerStack *stacks, int capacity, const int *frames, int depth) {
+    Uint32 mask = (Uint32) capacity - 1;
+    for (Uint32 i = stack_hash(frames, depth) & mask;; i = (i + 1) & mask) {
+        ProfilerStack *stack = &stacks[i];
+        if (stack->frames == NULL)
+            return stack;
+        if (stack->depth == depth && memcmp(stack->frames, frames, sizeof(int) * depth) == 0)
+            return stack;
+    }
+}
+
+static void stacks_grow() {
+    int capacity = profiler.stack_capacity == 0 ? 256 : profiler.stack_capacity * 2;
+    ProfilerStack *stacks = calloc(capacity, sizeof(ProfilerStack));
+
+    for (int i = 0; i < profiler.stack_capacity; i++) {
+        ProfilerStack *old = &profiler.stacks[i];
+        if (old->frames != NULL)
+            *stack_slot(stacks, capacity, old->frames, old->depth) = *old;
+    }
+
+    free(profiler.stacks);
+    profiler.stacks = stacks;
+    profiler.stack_capacity = capacity;
+}
+
+// Moves the samples in the ring into the per function and per stack counts
+static void profiler_aggregate() {
+    for (int s = 0; s < profiler.ring_count; s++) {
+        const ProfilerSample *sample = &profiler.ring[s];
+
+        profiler.functions[sample->frames[0]].self++;
+        for (int i = 0; i < sample->depth; i++) {
+            // Recursive functions are counted once per sample
+            bool seen = false;
+            for (int j = 0; j < i && !seen; j++)
+                seen = sample->frames[j] == sample->frames[i];
+            if (!seen)
+                profiler.functions[sample->frames[i]].total++;
+        }
+
+        if ((profiler.stack_count + 1) * 2 > profiler.stack_capacity)
+            stacks_grow();
+
+        ProfilerStack *stack = stack_slot(profiler.stacks, profiler.stack_capacity, sample->frames, sample->depth);
+        if (stack->frames == NULL) {
+            stack->depth = sample->depth;
+            stack->frames = malloc(sizeof(int) * sample->depth);
+            memcpy(stack->frames, sample->frames, sizeof(int) * sample->depth);
+            profiler.stack_count++;
+        }
+        stack->count++;
+        profiler.samples++;
+    }
+    profiler.ring_count = 0;
+}
+
+static void profiler_hook(lua_State *L, lua_Debug *ar) {
+    if (profiler.ring_count == PROFILER_RING_SIZE)
+        profiler_aggregate();
+
+    ProfilerSample *sample = &profiler.ring[profiler.ring_count];
+    lua_Debug frame;
+    sample->depth = 0;
+
+    for (int level = 0; sample->depth < PROFILER_MAX_DEPTH && lua_getstack(L, level, &frame); level++) {
+        lua_getinfo(L, "Sn", &frame);
+        int id = profiler_intern(&frame);
+        if (id < 0) {
+            profiler.dropped++;
+            return;
+        }
+        sample->frames[sample->depth++] = id;
+    }
+
+    if (sample->depth > 0)
+        profiler.ring_count++;
+}
+
+void profiler_configure(int interval, const char *output) {
+    if (interval > 0)
+        profiler.interval = interval;
+    if (output != NULL)
+        profiler.output = output;
+}
+
+void profiler_start(lua_State *L, int interval) {
+    if (profiler.running)
+        profiler_stop();
+
+    profiler.L = L;
+    profiler.running = true;
+    lua_sethook(L, profiler_hook, LUA_MASKCOUNT, interval > 0 ? interval : profiler.interval);
+}
+
+void profiler_stop() {
+    if (!profiler.running)
+        return;
+
+    lua_sethook(profiler.L, NULL, 0, 0);
+    profiler.running = false;
+    profiler_aggregate();
+}
+
+bool profiler_running() {
+    return profiler.running;
+}
+
+static int compare_self(const void *a, const void *b) {
+    return profiler.functions[*(const int *) b].self - profiler.functions[*(const int *) a].self;
+}
+
+static void profiler_summary() {
+    int ids[PROFILER_MAX_FUNCTIONS];
+    int count = 0;
+    for (int i = 0; i < PROFILER_MAX_FUNCTIONS; i++) {
+        if (profiler.functions[i].label != NULL)
+            ids[count++] = i;
+    }
+    qsort(ids, count, sizeof(int), compare_self);
+
+    printf("profiler: %d samples, %d functions, %d stacks\n", profiler.samples, count, profiler.stack_count);
+    printf("profiler:   self%%  total%%  function\n");
+    for (int i = 0; i < count && i < 10; i++) {
+        const ProfilerFunction *fn = &profiler.functions[ids[i]];
+        printf("profiler: %6.1f %6.1f  %s\n",
+               100.0 * fn->self / profiler.samples, 100.0 * fn->total / profiler.samples, fn->label);
+    }
+}
+
+void profiler_toggle(lua_State *L) {
+    if (!profiler.running) {
+        profiler_reset();
+        profiler_start(L, 0);
+        printf("profiler: started, one sample every %d instructions\n", profiler.interval);
+        return;
+    }
+
+    profiler_stop();
+    if (profiler.samples == 0) {
+        printf("profiler: stopped without samples\n");
+        return;
+    }
+    profiler_summary();
+    profiler_save(profiler.output);
+}
+
+bool profiler_save(const char *filename) {
+    profiler_aggregate();
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("profiler: could not create %s\n", filename);
+        return false;
+    }
+
+    // Collapsed stacks start from the outermost frame
+    for (int i = 0; i < profiler.stack_capacity; i++) {
+        const ProfilerStack *stack = &profiler.stacks[i];
+        if (stack->frames == NULL)
+            continue;
+        for (int f = stack->depth - 1; f >= 0; f--)
+            fprintf(file, f > 0 ? "%s;" : "%s", profiler.functions[stack->frames[f]].label);
+        fprintf(file, " %d\n", stack->count);
+    }
+
+    if (fclose(file) != 0) {
+        printf("profiler: could not write %s\n", filename);
+        return false;
+    }
+
+    printf("profiler: %d samples written to %s", profiler.samples, filename);
+    if (profiler.dropped > 0)
+        printf(", %d dropped past %d functions", profiler.dropped, PROFILER_MAX_FUNCTIONS);
+    printf("\n");
+    return true;
+}
+
+void profiler_reset() {
+    profiler.ring_count = 0;
+    profiler.samples = 0;
+    profiler.dropped = 0;
+
+    for (int i = 0; i < PROFILER_MAX_FUNCTIONS; i++) {
+        free(profiler.functions[i].label);
+        memset(&profiler.functions[i], 0, sizeof(ProfilerFunction));
+    }
+
+    for (int i = 0; i < profiler.stack_capacity; i++)
+        free(profiler.stacks[i].frames);
+    free(profiler.stacks);
+    profiler.stacks = NULL;
+    profiler.stack_count = 0;
+    profiler.stack_capacity = 0;
+}
+
+// The hook is set on the main thread, coroutines created later inherit it
+static lua_State *main_thread(lua_State *L) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    lua_State *main = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    return main;
+}
+
+static int api_profiler_start(lua_State *L) {
+    int interval = (int) luaL_optinteger(L, 1, 0);
+    profiler_start(main_thread(L), interval);
+    return 0;
+}
+
+static int api_profiler_stop(lua_State *L) {
+    profiler_stop();
+    return 0;
+}
+
+static int api_profiler_running(lua_State *L) {
+    lua_pushboolean(L, profiler.running);
+    return 1;
+}
+
+static int api_profiler_save(lua_State *L) {
+    lua_pushboolean(L, profiler_save(luaL_optstring(L, 1, profiler.output)));
+    return 1;
+}
+
+static int api_profiler_reset(lua_State *L) {
+    profiler_reset();
+    return 0;
+}
+
+static const struct luaL_Reg profiler_funcs[] = {
+        {"start",   api_profiler_start},
+        {"stop",    api_profiler_stop},
+        {"running", api_profiler_running},
+        {"save",    api_profiler_save},
+        {"reset",   api_profiler_reset},
+        {NULL, NULL}
+};
+
+int module_profiler(lua_State *L) {
+    lua_newtable(L);
+    luaL_setfuncs(L, profiler_funcs, 0);
+    return 1;
+}
+
+void api_profiler_open(lua_State *L) {
+    luaL_requiref(L, "core.profiler", module_profiler, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,74 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "core.h"
+
+#define PROFILER_INTERVAL 1000          // Default VM instructions between samples
+#define PROFILER_MAX_DEPTH 32           // Frames kept per sample, from the innermost
+#define PROFILER_RING_SIZE 4096         // Samples kept before they are aggregated
+#define PROFILER_MAX_FUNCTIONS 4096     // Distinct functions, a power of two
+#define PROFILER_OUTPUT "profile.folded"
+
+// One call stack, function ids from the innermost frame outwards
+typedef struct {
+    int depth;
+    int frames[PROFILER_MAX_DEPTH];
+} ProfilerSample;
+
+typedef struct {
+    const void *source;     // Interned strings from lua_getinfo, identify the function
+    const void *name;
+    int line;
+    char *label;            // NULL for a free slot
+    int self;               // Samples with the function innermost
+    int total;              // Samples with the function anywhere in the stack
+} ProfilerFunction;
+
+typedef struct {
+    int depth;
+    int *frames;
+    int count;
+} ProfilerStack;
+
+// Samples the Lua call stack every interval VM instructions with a count
+// hook. The hook is only installed while running, there is no cost otherwise.
+typedef struct {
+    lua_State *L;
+    bool running;
+    int interval;
+    const char *output;
+
+    ProfilerSample ring[PROFILER_RING_SIZE];
+    int ring_count;
+    int samples;
+    int dropped;            // Samples of functions past PROFILER_MAX_FUNCTIONS
+
+    ProfilerFunction functions[PROFILER_MAX_FUNCTIONS];
+    ProfilerStack *stacks;  // Open addressing, grown while aggregating
+    int stack_count;
+    int stack_capacity;
+} Profiler;
+
+// Sets the defaults used by the toggle key and core.profiler.start()
+void profiler_configure(int interval, const char *output);
+
+void profiler_start(lua_State *L, int interval);
+
+void profiler_stop();
+
+bool profiler_running();
+
+// Starts the profiler or stops it and writes the output file
+void profiler_toggle(lua_State *L);
+
+// Writes the samples so far as collapsed stacks, "outer;inner count" per line
+bool profiler_save(const char *filename);
+
+void profiler_reset();
+
+// core.profiler: start([interval]), stop(), running(), save([filename]), reset()
+void api_profiler_open(lua_State *L);
+
+#endif // PROFILER_H
@@ -0,0 +1,239 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "replay.h"
+
+static const char *const button_names[] = {"Left", "Middle", "Right"};
+
+void replay_init(Replay *replay) {
+    memset(replay, 0, sizeof(Replay));
+    replay->mode = REPLAY_OFF;
+}
+
+bool replay_record(Replay *replay, const char *filename, int seed) {
+    replay->file = fopen(filename, "wb");
+    if (replay->file == NULL) {
+        printf("replay: could not create %s\n", filename);
+        return false;
+    }
+
+    ReplayHeader header = {REPLAY_MAGIC, REPLAY_VERSION, seed, 0};
+    fwrite(&header, sizeof(ReplayHeader), 1, replay->file);
+    replay->mode = REPLAY_RECORD;
+    replay->filename = filename;
+    replay->seed = seed;
+    return true;
+}
+
+bool replay_play(Replay *replay, const char *filename, double fixed_dt) {
+    replay->file = fopen(filename, "rb");
+    if (replay->file == NULL) {
+        printf("replay: could not open %s\n", filename);
+        return false;
+    }
+
+    ReplayHeader header;
+    if (fread(&header, sizeof(ReplayHeader), 1, replay->file) != 1 ||
+        header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        printf("replay: %s is not a recording of this version\n", filename);
+        fclose(replay->file);
+        replay->file = NULL;
+        return false;
+    }
+
+    replay->mode = REPLAY_PLAY;
+    replay->filename = filename;
+    replay->seed = header.seed;
+    replay->fixed_dt = fixed_dt > 0 ? fixed_dt : 0;
+    return true;
+}
+
+void replay_close(Replay *replay) {
+    if (replay->file == NULL)
+        return;
+
+    if (replay->mode == REPLAY_RECORD) {
+        if (fclose(replay->file) != 0)
+            printf("replay: could not write %s\n", replay->filename);
+        else
+            printf("replay: %d frames recorded to %s, seed %d\n", replay->frames, replay->filename, replay->seed);
+        if (replay->dropped > 0)
+            printf("replay: %d events or updates past the frame limits were not recorded\n", replay->dropped);
+    } else {
+        fclose(replay->file);
+        printf("replay: %d frames played from %s, seed %d\n", replay->frames, replay->filename, replay->seed);
+    }
+    replay->file = NULL;
+    replay->mode = REPLAY_OFF;
+}
+
+static ReplayEvent *replay_append(Replay *replay, LevelEventType type) {
+    // Past the limit the event still reaches the level, the recording diverges
+    if (replay->event_count == LEVEL_MAX_EVENTS) {
+        replay->dropped++;
+        return NULL;
+    }
+
+    ReplayEvent *ev = &replay->events[replay->event_count++];
+    memset(ev, 0, sizeof(ReplayEvent));
+    ev->type = type;
+    return ev;
+}
+
+static Uint8 encode_button(const char *button) {
+    for (Uint8 i = 0; i < 3; i++) {
+        if (strcmp(button, button_names[i]) == 0)
+            return i;
+    }
+    return 0;
+}
+
+static const char *decode_state(Uint8 pressed) {
+    return pressed ? "Pressed" : "Released";
+}
+
+static void record_key(Replay *replay, LevelEventType type, int key) {
+    ReplayEvent *ev = replay_append(replay, type);
+    if (ev != NULL)
+        ev->key = key;
+}
+
+static void record_button(Replay *replay, LevelEventType type, const char *button, const char *state, int x, int y) {
+    ReplayEvent *ev = replay_append(replay, type);
+    if (ev == NULL)
+        return;
+    ev->button = encode_button(button);
+    ev->pressed = strcmp(state, "Pressed") == 0;
+    ev->x = x;
+    ev->y = y;
+}
+
+void replay_keyup(Replay *replay, Level *level, int key) {
+    if (replay->mode == REPLAY_PLAY)
+        return;
+    if (replay->mode == REPLAY_RECORD)
+        record_key(replay, LEVEL_EVENT_KEYUP, key);
+    level_keyup(level, key);
+}
+
+void replay_keydown(Replay *replay, Level *level, int key) {
+    if (replay->mode == REPLAY_PLAY)
+        return;
+    if (replay->mode == REPLAY_RECORD)
+        record_key(replay, LEVEL_EVENT_KEYDOWN, key);
+    level_keydown(level, key);
+}
+
+void replay_mouseup(Replay *replay, Level *level, const char *button, const char *state, int x, int y) {
+    if (replay->mode == REPLAY_PLAY)
+        return;
+    if (replay->mode == REPLAY_RECORD)
+        record_button(replay, LEVEL_EVENT_MOUSEUP, button, state, x, y);
+    level_mouseup(level, button, state, x, y);
+}
+
+void replay_mousedown(Replay *replay, Level *level, const char *button, const char *state, int x, int y) {
+    if (replay->mode == REPLAY_PLAY)
+        return;
+    if (replay->mode == REPLAY_RECORD)
+        record_button(replay, LEVEL_EVENT_MOUSEDOWN, button, state, x, y);
+    level_mousedown(level, button, state, x, y);
+}
+
+void replay_mousemove(Replay *replay, Level *level, const char *state, int x, int y, int relx, int rely) {
+    if (replay->mode == REPLAY_PLAY)
+        return;
+    if (replay->mode == REPLAY_RECORD) {
+        ReplayEvent *ev = replay_append(replay, LEVEL_EVENT_MOUSEMOVE);
+        if (ev != NULL) {
+            ev->pressed = strcmp(state, "Pressed") == 0;
+            ev->x = x;
+            ev->y = y;
+            ev->relx = relx;
+            ev->rely = rely;
+        }
+    }
+    level_mousemove(level, state, x, y, relx, rely);
+}
+
+static void replay_deliver(const ReplayEvent *ev, Level *level) {
+    const char *button = button_names[ev->button < 3 ? ev->button : 0];
+    const char *state = decode_state(ev->pressed);
+
+    switch (ev->type) {
+        case LEVEL_EVENT_KEYUP:
+            level_keyup(level, ev->key);
+            break;
+        case LEVEL_EVENT_KEYDOWN:
+            level_keydown(level, ev->key);
+            break;
+        case LEVEL_EVENT_MOUSEUP:
+            level_mouseup(level, button, state, ev->x, ev->y);
+            break;
+        case LEVEL_EVENT_MOUSEDOWN:
+            level_mousedown(level, button, state, ev->x, ev->y);
+            break;
+        case LEVEL_EVENT_MOUSEMOVE:
+            level_mousemove(level, state, ev->x, ev->y, ev->relx, ev->rely);
+            break;
+    }
+}
+
+bool replay_begin_frame(Replay *replay, Level *level) {
+    if (replay->mode != REPLAY_PLAY)
+        return true;
+
+    ReplayFrame frame;
+    if (fread(&frame, sizeof(ReplayFrame), 1, replay->file) != 1)
+        return false;
+
+    if (frame.events > LEVEL_MAX_EVENTS || frame.updates > REPLAY_MAX_UPDATES ||
+        fread(replay->events, sizeof(ReplayEvent), frame.events, replay->file) != frame.events ||
+        fread(replay->updates, sizeof(double), frame.updates, replay->file) != frame.updates) {
+        printf("replay: %s is truncated at frame %d\n", replay->filename, replay->frames);
+        return false;
+    }
+
+    for (int i = 0; i < frame.events; i++)
+        replay_deliver(&replay->events[i], level);
+
+    if (replay->fixed_dt > 0) {
+        replay->updates[0] = replay->fixed_dt;
+        replay->update_count = 1;
+    } else {
+        replay->update_count = frame.updates;
+    }
+    replay->next_update = 0;
+    replay->frames++;
+    return true;
+}
+
+bool replay_next_update(Replay *replay, double *dt) {
+    if (replay->next_update == replay->update_count)
+        return false;
+    *dt = replay->updates[replay->next_update++];
+    return true;
+}
+
+void replay_update(Replay *replay, double dt) {
+    if (replay->mode != REPLAY_RECORD)
+        return;
+    if (replay->update_count == REPLAY_MAX_UPDATES) {
+        replay->dropped++;
+        return;
+    }
+    replay->updates[replay->update_count++] = dt;
+}
+
+void replay_end_frame(Replay *replay) {
+    if (replay->mode != REPLAY_RECORD)
+        return;
+
+    ReplayFrame frame = {(Uint16) replay->event_count, (Uint16) replay->update_count};
+    fwrite(&frame, sizeof(ReplayFrame), 1, replay->file);
+    fwrite(replay->events, sizeof(ReplayEvent), replay->event_count, replay->file);
+    fwrite(replay->updates, sizeof(double), replay->update_count, replay->file);
+
+    replay->event_count = 0;
+    replay->update_count = 0;
+    replay->frames++;
+}
@@ -0,0 +1,95 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "core.h"
+#include "level.h"
+
+#define REPLAY_MAGIC 0x43455257u    // "WREC"
+#define REPLAY_VERSION 1
+#define REPLAY_MAX_UPDATES 64       // Updates of one frame
+
+typedef enum {
+    REPLAY_OFF,
+    REPLAY_RECORD,
+    REPLAY_PLAY
+} ReplayMode;
+
+// Layout of a recording, in the byte order of the machine that made it. The
+// header is followed by one record per frame: a ReplayFrame, its events,
+// then the dt of each update the frame ran.
+typedef struct {
+    Uint32 magic;
+    Uint32 version;
+    Sint32 seed;            // RANDOM_SEED of the recorded run
+    Uint32 reserved;
+} ReplayHeader;
+
+typedef struct {
+    Uint16 events;
+    Uint16 updates;
+} ReplayFrame;
+
+typedef struct {
+    Uint8 type;             // LevelEventType
+    Uint8 button;           // 0 left, 1 middle, 2 right
+    Uint8 pressed;
+    Uint8 reserved;
+    Sint32 key;
+    Sint32 x;
+    Sint32 y;
+    Sint32 relx;
+    Sint32 rely;
+} ReplayEvent;
+
+// Records the input a level receives and the dt of every update, or feeds a
+// recording back to the level. While playing, live input is ignored.
+typedef struct {
+    ReplayMode mode;
+    FILE *file;
+    const char *filename;
+    int seed;
+    int frames;
+    double fixed_dt;        // Played back with one update of this dt per frame, 0 for the recorded ones
+
+    ReplayEvent events[LEVEL_MAX_EVENTS];
+    int event_count;
+    double updates[REPLAY_MAX_UPDATES];
+    int update_count;
+    int next_update;
+    int dropped;            // Events and updates past the limits, the recording diverges
+} Replay;
+
+
+void replay_init(Replay *replay);
+
+bool replay_record(Replay *replay, const char *filename, int seed);
+
+bool replay_play(Replay *replay, const char *filename, double fixed_dt);
+
+void replay_close(Replay *replay);
+
+// Level input, recorded when recording and dropped when playing
+void replay_keyup(Replay *replay, Level *level, int key);
+
+void replay_keydown(Replay *replay, Level *level, int key);
+
+void replay_mouseup(Replay *replay, Level *level, const char *button, const char *state, int x, int y);
+
+void replay_mousedown(Replay *replay, Level *level, const char *button, const char *state, int x, int y);
+
+void replay_mousemove(Replay *replay, Level *level, const char *state, int x, int y, int relx, int rely);
+
+// Delivers the recorded input of the next frame, false at the end of the recording
+bool replay_begin_frame(Replay *replay, Level *level);
+
+// The dt of the next recorded update of the frame, false when there are no more
+bool replay_next_update(Replay *replay, double *dt);
+
+// Adds an update the frame ran to the recording
+void replay_update(Replay *replay, double dt);
+
+void replay_end_frame(Replay *replay);
+
+#endif // REPLAY_H
@@ -1,6 +1,7 @@
 // Copyright 2023 Lucas Klassmann
 // License: Apache License 2.0
 #include "scripting.h"
+#include <sys/stat.h>
 
 void debug_stack(lua_State *L) {
     int top = lua_gettop(L);
@@ -36,6 +37,91 @@ int get_integer_field(lua_State *L, const char *table, const char *field) {
 }
 
 
+static int write_file(lua_State *L, const void *p, size_t size, void *ud) {
+    return fwrite(p, 1, size, ud) == size ? 0 : 1;
+}
+
+// Creates the directories leading to path
+static void make_parents(const char *path) {
+    char *copy = strdup(path);
+    for (char *c = copy + 1; *c != '\0'; c++) {
+        if (*c != '/')
+            continue;
+        *c = '\0';
+        mkdir(copy, 0755);
+        *c = '/';
+    }
+    free(copy);
+}
+
+// Loads a loose script from its cached bytecode when the cache is newer than
+// the source, otherwise parses it and refreshes the cache. Debug information
+// is kept, errors still point to the source lines.
+static int load_cached(lua_State *L, const char *filename) {
+    char *cache = NULL;
+    asprintf(&cache, "%s/%sc", SCRIPT_CACHE_DIR, filename);
+
+    struct stat source;
+    struct stat cached;
+    bool fresh = stat(filename, &source) == 0 && stat(cache, &cached) == 0 && cached.st_mtime > source.st_mtime;
+
+    if (fresh) {
+        if (luaL_loadfilex(L, cache, "b") == LUA_OK) {
+            free(cache);
+            return LUA_OK;
+        }
+        lua_pop(L, 1);
+    }
+
+    int status = luaL_loadfile(L, filename);
+    if (status == LUA_OK) {
+        // The cache is only a shortcut, failing to write it is not an error
+        make_parents(cache);
+        FILE *file = fopen(cache, "wb");
+        if (file != NULL) {
+            bool ok = lua_dump(L, write_file, file, 0) == 0;
+            if (fclose(file) != 0 || !ok)
+                remove(cache);
+        }
+    }
+
+    free(cache);
+    return status;
+}
+
+// Pushes the compiled script from the asset archive or the loose file. A loose
+// script edited after the archive was built wins, changes show without a repack.
+static int load_script(lua_State *L, const char *filename) {
+    const ArchiveEntry *entry = archive_find(filename);
+    if (entry == NULL || (entry->kind != ARCHIVE_BYTECODE && entry->kind != ARCHIVE_RAW) ||
+        archive_outdated(filename))
+        return load_cached(L, filename);
+
+    lua_pushfstring(L, "@%s", filename);
+    int status = luaL_loadbuffer(L, archive_data(entry), entry->size, lua_tostring(L, -1));
+    lua_remove(L, -2);
+    return status;
+}
+
+// Finds modules in the asset archive or in ./scripts before package.path is
+// searched, both without parsing when compiled already
+static int script_searcher(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    const char *path = lua_pushfstring(L, "scripts/%s.lua", luaL_gsub(L, name, ".", "/"));
+
+    struct stat source;
+    if (archive_find(path) == NULL && stat(path, &source) != 0) {
+        lua_pushfstring(L, "\n\tno file '%s' in the asset archive or on disk", path);
+        return 1;
+    }
+
+    if (load_script(L, path) != LUA_OK)
+        return luaL_error(L, "error loading module '%s' from '%s':\n\t%s", name, path, lua_tostring(L, -1));
+
+    lua_pushstring(L, path);
+    return 2;
+}
+
 Script *script_new() {
     Script *script = malloc(sizeof(size_t));
     script->L = luaL_newstate();
@@ -50,7 +136,16 @@ Script *script_new() {
     lua_pop(script->L, 1);
     lua_pushstring(script->L, path);
     lua_setfield(script->L, -2, "path");
-    lua_pop(script->L, 1);
+
+    // Right after the preload searcher
+    lua_getfield(script->L, -1, "searchers");
+    for (int i = (int) luaL_len(script->L, -1); i >= 2; i--) {
+        lua_rawgeti(script->L, -1, i);
+        lua_rawseti(script->L, -2, i + 1);
+    }
+    lua_pushcfunction(script->L, script_searcher);
+    lua_rawseti(script->L, -2, 2);
+    lua_pop(script->L, 2);
     return script;
 }
 
@@ -59,10 +154,25 @@ void script_open_libraries(Script *script) {
     api_math_open(script->L);
     api_sound_open(script->L);
     api_font_open(script->L);
+    api_tilelayer_open(script->L);
+    api_tilemap_open(script->L);
+    api_assets_open(script->L);
+    api_loader_open(script->L);
+    api_particles_open(script->L);
+    api_animation_open(script->L);
+    api_vecarray_open(script->L);
+    api_collision_open(script->L);
+    api_input_open(script->L);
+    api_profiler_open(script->L);
+    api_trace_open(script->L);
 }
 
 void script_load(Script *script, const char *filename) {
-    if (luaL_dofile(script->L, filename) != LUA_OK) {
+    int status = load_script(script->L, filename);
+    if (status == LUA_OK)
+        status = lua_pcall(script->L, 0, LUA_MULTRET, 0);
+
+    if (status != LUA_OK) {
         panic(lua_tostring(script->L, lua_gettop(script->L)));
     }
 }
@@ -103,6 +213,28 @@ bool script_get_bool(Script *script, const char *var, bool def) {
     return def;
 }
 
+double script_get_number(Script *script, const char *var, double def) {
+    lua_getglobal(script->L, var);
+
+    if (lua_isnumber(script->L, -1)) {
+        double n = lua_tonumber(script->L, -1);
+        lua_pop(script->L, 1);
+        return n;
+    }
+
+    return def;
+}
+
+void script_set_integer(Script *script, const char *var, int value) {
+    lua_pushinteger(script->L, value);
+    lua_setglobal(script->L, var);
+}
+
+void script_set_bool(Script *script, const char *var, bool value) {
+    lua_pushboolean(script->L, value);
+    lua_setglobal(script->L, var);
+}
+
 SDL_Color script_get_color(Script *script, const char *var) {
     SDL_Color color;
     color.r = get_integer_field(script->L, var, "r");
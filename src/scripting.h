@@ -9,6 +9,22 @@
 #include "fonts.h"
 #include "sound.h"
 #include "game_math.h"
+#include "tilelayer.h"
+#include "tilemap.h"
+#include "assets.h"
+#include "loader.h"
+#include "archive.h"
+#include "particles.h"
+#include "animation.h"
+#include "vecarray.h"
+#include "collision.h"
+#include "input.h"
+#include "profiler.h"
+#include "trace.h"
+
+// Loose scripts are compiled once and kept here as bytecode, next to the
+// path they were loaded from, until the source is newer
+#define SCRIPT_CACHE_DIR ".cache"
 
 typedef struct {
     lua_State *L;
@@ -27,6 +43,12 @@ int script_get_integer(Script *script, const char *var);
 
 bool script_get_bool(Script *script, const char *var, bool def);
 
+double script_get_number(Script *script, const char *var, double def);
+
+void script_set_integer(Script *script, const char *var, int value);
+
+void script_set_bool(Script *script, const char *var, bool value);
+
 SDL_Color script_get_color(Script *script, const char *var);
 
 void script_free(Script *script);
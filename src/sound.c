@@ -1,20 +1,66 @@
 // Copyright 2023 Lucas Klassmann
 // License: Apache License 2.0
 #include "sound.h"
+#include "archive.h"
 
+UserdataType SoundEffectType = {"SoundEffect"};
+UserdataType SoundMusicType = {"SoundMusic"};
+
+// Packed samples are used in place when they match the mixer output
+static Mix_Chunk *sound_packed_chunk(const char *filename) {
+    const ArchiveEntry *entry = archive_find(filename);
+    if (entry == NULL || entry->kind != ARCHIVE_PCM)
+        return NULL;
+
+    int frequency;
+    Uint16 format;
+    int channels;
+    if (!Mix_QuerySpec(&frequency, &format, &channels) ||
+        entry->format != format || entry->width != frequency || entry->height != channels)
+        return NULL;
+
+    return Mix_QuickLoad_RAW((Uint8 *) archive_data(entry), (Uint32) entry->size);
+}
+
+// Both loaders only decode, they are safe to call from a loader thread
 SoundEffect *sound_load_effect(const char *filename) {
+    Mix_Chunk *chunk = sound_packed_chunk(filename);
+    if (chunk == NULL)
+        chunk = Mix_LoadWAV_RW(archive_rw(filename), 1);
+
+    if (chunk == NULL) {
+        printf("error on loading sound effect: %s\n", Mix_GetError());
+        return NULL;
+    }
+
     SoundEffect *sfx = malloc(sizeof(SoundEffect));
-    sfx->chunk = Mix_LoadWAV(filename);
+    sfx->chunk = chunk;
     return sfx;
 }
 
 
 SoundMusic *sound_load_music(const char *filename) {
+    Mix_Music *mus = Mix_LoadMUS_RW(archive_rw(filename), 1);
+    if (mus == NULL) {
+        printf("error on loading music: %s\n", Mix_GetError());
+        return NULL;
+    }
+
     SoundMusic *music = malloc(sizeof(SoundMusic));
-    music->music = Mix_LoadMUS(filename);
+    music->music = mus;
     return music;
 }
 
+void sound_free_effect(SoundEffect *sfx) {
+    Mix_FreeChunk(sfx->chunk);
+    free(sfx);
+}
+
+void sound_free_music(SoundMusic *music) {
+    Mix_FreeMusic(music->music);
+    free(music);
+}
+
 void sound_music_play(SoundMusic *music, bool loop) {
     Mix_PlayMusic(music->music, loop ? -1 : 0);
 }
@@ -24,10 +70,38 @@ void sound_sfx_play(SoundEffect *sfx, bool loop) {
 }
 
 
+static void destroy_effect(void *data) {
+    sound_free_effect(data);
+}
+
+static void destroy_music(void *data) {
+    sound_free_music(data);
+}
+
+Asset *sound_register_effect(const char *key, SoundEffect *sfx) {
+    return asset_add(ASSET_SOUND_EFFECT, key, sfx, sfx->chunk->alen, destroy_effect);
+}
+
+// Music is streamed, only the decoder state stays in memory
+Asset *sound_register_music(const char *key, SoundMusic *music) {
+    return asset_add(ASSET_MUSIC, key, music, sizeof(SoundMusic), destroy_music);
+}
+
 int api_load_effect(lua_State *L) {
     const char *filename = luaL_checklstring(L, 1, NULL);
-    SoundEffect *sfx = sound_load_effect(filename);
-    lua_pushlightuserdata(L, sfx);
+    const char *key = lua_pushfstring(L, ASSET_KEY_SOUND_EFFECT, filename);
+    Asset *asset = asset_find(key);
+
+    if (asset == NULL) {
+        SoundEffect *sfx = sound_load_effect(filename);
+        if (sfx == NULL) {
+            lua_pushnil(L);
+            return 1;
+        }
+        asset = sound_register_effect(key, sfx);
+    }
+
+    asset_push_handle(L, asset, asset->data, &SoundEffectType);
     return 1;
 }
 
@@ -36,11 +110,13 @@ int api_play_effect(lua_State *L) {
     int num_args = lua_gettop(L);
     bool loop = false;
 
-    if (num_args > 0)
-        sfx = lua_touserdata(L, 1);
+    // A sound that failed to load is nil, playing it does nothing
+    if (num_args == 0 || lua_isnil(L, 1))
+        return 0;
+    sfx = asset_check(L, 1, &SoundEffectType);
 
     if (num_args > 1)
-        loop = lua_toboolean(L, 8);
+        loop = lua_toboolean(L, 2);
 
     sound_sfx_play(sfx, loop);
     return 0;
@@ -48,8 +124,19 @@ int api_play_effect(lua_State *L) {
 
 int api_load_music(lua_State *L) {
     const char *filename = luaL_checklstring(L, 1, NULL);
-    SoundMusic *music = sound_load_music(filename);
-    lua_pushlightuserdata(L, music);
+    const char *key = lua_pushfstring(L, ASSET_KEY_MUSIC, filename);
+    Asset *asset = asset_find(key);
+
+    if (asset == NULL) {
+        SoundMusic *music = sound_load_music(filename);
+        if (music == NULL) {
+            lua_pushnil(L);
+            return 1;
+        }
+        asset = sound_register_music(key, music);
+    }
+
+    asset_push_handle(L, asset, asset->data, &SoundMusicType);
     return 1;
 }
 
@@ -58,8 +145,10 @@ int api_play_music(lua_State *L) {
     int num_args = lua_gettop(L);
     bool loop = false;
 
-    if (num_args > 0)
-        music = lua_touserdata(L, 1);
+    // A sound that failed to load is nil, playing it does nothing
+    if (num_args == 0 || lua_isnil(L, 1))
+        return 0;
+    music = asset_check(L, 1, &SoundMusicType);
 
     if (num_args > 1)
         loop = lua_toboolean(L, 2);
@@ -84,6 +173,9 @@ int module_sound(lua_State *L) {
 
 
 void api_sound_open(lua_State *L) {
+    asset_new_metatable(L, &SoundEffectType);
+    asset_new_metatable(L, &SoundMusicType);
+
     luaL_requiref(L, "core.sound", module_sound, 0);
     lua_pop(L, 1);
 }
\ No newline at end of file
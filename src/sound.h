@@ -4,6 +4,13 @@
 #define SOUND_H
 
 #include "core.h"
+#include "assets.h"
+
+// Mixer output, packed sound effects are stored already in this format
+#define SOUND_FREQUENCY 44100
+#define SOUND_FORMAT MIX_DEFAULT_FORMAT
+#define SOUND_CHANNELS 2
+#define SOUND_CHUNK_SIZE 2048
 
 typedef struct {
     Mix_Chunk *chunk;
@@ -14,6 +21,22 @@ typedef struct {
 } SoundMusic;
 
 
+SoundEffect *sound_load_effect(const char *filename);
+
+SoundMusic *sound_load_music(const char *filename);
+
+void sound_free_effect(SoundEffect *sfx);
+
+void sound_free_music(SoundMusic *music);
+
+// Register loaded sounds in the asset list under key
+Asset *sound_register_effect(const char *key, SoundEffect *sfx);
+
+Asset *sound_register_music(const char *key, SoundMusic *music);
+
+extern UserdataType SoundEffectType;
+extern UserdataType SoundMusicType;
+
 void api_sound_open(lua_State *L);
 
 #endif // SOUND_H
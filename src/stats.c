@@ -0,0 +1,265 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "stats.h"
+#include "graphics.h"
+#include "udata.h"
+#include "pacing.h"
+
+static const char *const phase_names[STATS_PHASES] = {
+        [STATS_EVENTS] = "events",
+        [STATS_UPDATE] = "update",
+        [STATS_DRAW] = "draw",
+        [STATS_PRESENT] = "present",
+        [STATS_GC] = "gc",
+};
+
+static const SDL_Color phase_colors[STATS_PHASES] = {
+        [STATS_EVENTS] = {160, 160, 160, 255},
+        [STATS_UPDATE] = {80, 140, 255, 255},
+        [STATS_DRAW] = {90, 210, 110, 255},
+        [STATS_PRESENT] = {240, 200, 60, 255},
+        [STATS_GC] = {240, 80, 70, 255},
+};
+
+void stats_init(FrameStats *stats, int frames, Font *font) {
+    memset(stats, 0, sizeof(FrameStats));
+    stats->size = frames > 0 ? frames : STATS_FRAMES;
+    stats->frames = calloc(stats->size, sizeof(FrameRecord));
+    stats->bars = malloc(sizeof(SDL_Rect) * stats->size * STATS_PHASES);
+    stats->sorted = malloc(sizeof(double) * stats->size);
+    stats->font = font;
+    stats->userdata_mark = udata_allocations;
+}
+
+void stats_free(FrameStats *stats) {
+    free(stats->frames);
+    free(stats->bars);
+    free(stats->sorted);
+    if (stats->font != NULL)
+        font_free(stats->font);
+}
+
+void stats_begin_frame(FrameStats *stats) {
+    memset(&stats->current, 0, sizeof(FrameRecord));
+    stats->frame_start = pacing_now();
+    stats->phase_start = stats->frame_start;
+}
+
+void stats_begin(FrameStats *stats) {
+    stats->phase_start = pacing_now();
+}
+
+void stats_end(FrameStats *stats, StatsPhase phase) {
+    stats->current.phases[phase] += pacing_now() - stats->phase_start;
+}
+
+void stats_end_frame(FrameStats *stats, lua_State *L) {
+    FrameRecord *record = &stats->current;
+    const Graphics *graphics = graphics_get();
+
+    record->frame = pacing_now() - stats->frame_start;
+    record->batches = graphics->frame_batches;
+    record->switches = graphics->frame_switches;
+    record->texts = graphics->frame_texts;
+    record->lua_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    record->userdata = (int) (udata_allocations - stats->userdata_mark);
+    stats->userdata_mark = udata_allocations;
+
+    stats->frames[stats->next] = *record;
+    stats->next = (stats->next + 1) % stats->size;
+    if (stats->count < stats->size)
+        stats->count++;
+    stats->total++;
+}
+
+// The i-th kept frame, from the oldest
+static const FrameRecord *stats_frame(FrameStats *stats, int i) {
+    return &stats->frames[(stats->next - stats->count + i + stats->size) % stats->size];
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+    return da < db ? -1 : da > db;
+}
+
+static void sort_frames(FrameStats *stats) {
+    for (int i = 0; i < stats->count; i++)
+        stats->sorted[i] = stats->frames[i].frame;
+    qsort(stats->sorted, stats->count, sizeof(double), compare_doubles);
+}
+
+// Percentile of the frame times sorted last
+static double sorted_percentile(FrameStats *stats, double p) {
+    int index = (int) ceil(p * stats->count) - 1;
+    if (index < 0)
+        index = 0;
+    if (index >= stats->count)
+        index = stats->count - 1;
+    return stats->sorted[index];
+}
+
+static void stats_averages(FrameStats *stats, FrameRecord *average) {
+    memset(average, 0, sizeof(FrameRecord));
+    if (stats->count == 0)
+        return;
+
+    for (int i = 0; i < stats->count; i++) {
+        const FrameRecord *record = &stats->frames[i];
+        for (int phase = 0; phase < STATS_PHASES; phase++)
+            average->phases[phase] += record->phases[phase] / stats->count;
+        average->frame += record->frame / stats->count;
+    }
+}
+
+static void draw_text(FrameStats *stats, SDL_Renderer *renderer, int x, int y, const char *text) {
+    Font *font = stats->font;
+    int pen_x = x;
+    unsigned char prev = 0;
+
+    // Straight to the renderer, the overlay is not part of the frame counters
+    for (const unsigned char *c = (const unsigned char *) text; *c != '\0'; c++) {
+        Glyph *g = font_glyph(font, renderer, *c);
+        if (g == NULL)
+            continue;
+
+        pen_x += font_kerning(font, prev, *c);
+        SDL_Rect dst = {pen_x + g->offset_x, y, g->rect.w, g->rect.h};
+        SDL_RenderCopy(renderer, font->atlas, &g->rect, &dst);
+        pen_x += g->advance;
+        prev = *c;
+    }
+}
+
+void stats_draw_overlay(FrameStats *stats, SDL_Renderer *renderer) {
+    int screen_width;
+    int screen_height;
+    SDL_GetRendererOutputSize(renderer, &screen_width, &screen_height);
+
+    // One pixel per frame, the newest frames when the screen is narrower
+    int frames = stats->count < screen_width - 16 ? stats->count : screen_width - 16;
+    int lines = stats->font != NULL ? 3 : 0;
+    int line_height = stats->font != NULL ? stats->font->height : 0;
+    SDL_Rect panel = {8, 8, stats->size > frames ? stats->size : frames, STATS_GRAPH_HEIGHT + lines * line_height + 8};
+    if (panel.w > screen_width - 16)
+        panel.w = screen_width - 16;
+    int base = panel.y + 4 + STATS_GRAPH_HEIGHT;
+
+    SDL_BlendMode blend;
+    SDL_GetRenderDrawBlendMode(renderer, &blend);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 170);
+    SDL_RenderFillRect(renderer, &panel);
+
+    // Phases stacked in each bar, one fill call per phase
+    int first = stats->count - frames;
+    double scale = STATS_GRAPH_HEIGHT / (STATS_GRAPH_MS / 1000.0);
+    for (int phase = 0; phase < STATS_PHASES; phase++) {
+        SDL_Rect *bars = &stats->bars[phase * stats->size];
+        int count = 0;
+
+        for (int i = 0; i < frames; i++) {
+            const FrameRecord *record = stats_frame(stats, first + i);
+            double below = 0;
+            for (int p = 0; p < phase; p++)
+                below += record->phases[p];
+
+            int bottom = base - (int) (below * scale);
+            int top = base - (int) ((below + record->phases[phase]) * scale);
+            if (top < base - STATS_GRAPH_HEIGHT)
+                top = base - STATS_GRAPH_HEIGHT;
+            if (bottom <= top)
+                continue;
+
+            SDL_Rect *bar = &bars[count++];
+            bar->x = panel.x + i;
+            bar->y = top;
+            bar->w = 1;
+            bar->h = bottom - top;
+        }
+
+        SDL_Color color = phase_colors[phase];
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRects(renderer, bars, count);
+    }
+
+    // 60 and 30 frames per second
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 120);
+    for (int fps = 60; fps >= 30; fps /= 2) {
+        int y = base - (int) (scale / fps);
+        SDL_RenderDrawLine(renderer, panel.x, y, panel.x + panel.w - 1, y);
+    }
+    SDL_SetRenderDrawBlendMode(renderer, blend);
+
+    if (stats->font == NULL || stats->count == 0)
+        return;
+
+    FrameRecord average;
+    stats_averages(stats, &average);
+    const FrameRecord *last = stats_frame(stats, stats->count - 1);
+    char line[256];
+    int y = base + 4;
+    sort_frames(stats);
+
+    SDL_snprintf(line, sizeof(line), "frame p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms",
+                 sorted_percentile(stats, 0.5) * 1000.0, sorted_percentile(stats, 0.95) * 1000.0,
+                 sorted_percentile(stats, 0.99) * 1000.0, sorted_percentile(stats, 1.0) * 1000.0);
+    draw_text(stats, renderer, panel.x + 4, y, line);
+    y += line_height;
+
+    SDL_snprintf(line, sizeof(line), "avg events %.2f  update %.2f  draw %.2f  present %.2f  gc %.2f ms",
+                 average.phases[STATS_EVENTS] * 1000.0, average.phases[STATS_UPDATE] * 1000.0,
+                 average.phases[STATS_DRAW] * 1000.0, average.phases[STATS_PRESENT] * 1000.0,
+                 average.phases[STATS_GC] * 1000.0);
+    draw_text(stats, renderer, panel.x + 4, y, line);
+    y += line_height;
+
+    SDL_snprintf(line, sizeof(line), "draws %d  switches %d  texts %d  lua %d KB  userdata %d",
+                 last->batches, last->switches, last->texts, last->lua_kb, last->userdata);
+    draw_text(stats, renderer, panel.x + 4, y, line);
+}
+
+bool stats_save_csv(FrameStats *stats, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("stats: could not create %s\n", filename);
+        return false;
+    }
+
+    fprintf(file, "frame,frame_ms");
+    for (int phase = 0; phase < STATS_PHASES; phase++)
+        fprintf(file, ",%s_ms", phase_names[phase]);
+    fprintf(file, ",draw_calls,texture_switches,text_renders,lua_kb,userdata\n");
+
+    for (int i = 0; i < stats->count; i++) {
+        const FrameRecord *record = stats_frame(stats, i);
+        fprintf(file, "%d,%.4f", stats->total - stats->count + i + 1, record->frame * 1000.0);
+        for (int phase = 0; phase < STATS_PHASES; phase++)
+            fprintf(file, ",%.4f", record->phases[phase] * 1000.0);
+        fprintf(file, ",%d,%d,%d,%d,%d\n",
+                record->batches, record->switches, record->texts, record->lua_kb, record->userdata);
+    }
+
+    if (fclose(file) != 0) {
+        printf("stats: could not write %s\n", filename);
+        return false;
+    }
+    printf("stats: %d frames written to %s\n", stats->count, filename);
+    return true;
+}
+
+void stats_report(FrameStats *stats) {
+    if (stats->count == 0)
+        return;
+
+    FrameRecord average;
+    stats_averages(stats, &average);
+    sort_frames(stats);
+    printf("stats: last %d frames, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", stats->count,
+           sorted_percentile(stats, 0.5) * 1000.0, sorted_percentile(stats, 0.95) * 1000.0,
+           sorted_percentile(stats, 0.99) * 1000.0, sorted_percentile(stats, 1.0) * 1000.0);
+    printf("stats: average");
+    for (int phase = 0; phase < STATS_PHASES; phase++)
+        printf(" %s %.3f ms", phase_names[phase], average.phases[phase] * 1000.0);
+    printf("\n");
+}
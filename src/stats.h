@@ -0,0 +1,75 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef STATS_H
+#define STATS_H
+
+#include "core.h"
+#include "fonts.h"
+
+#define STATS_FRAMES 600            // Default number of frames kept
+#define STATS_GRAPH_HEIGHT 150      // Overlay graph height in pixels
+#define STATS_GRAPH_MS 50.0         // Frame time at the top of the graph
+
+typedef enum {
+    STATS_EVENTS,
+    STATS_UPDATE,
+    STATS_DRAW,
+    STATS_PRESENT,
+    STATS_GC,
+    STATS_PHASES
+} StatsPhase;
+
+typedef struct {
+    double phases[STATS_PHASES];    // Seconds spent in each phase
+    double frame;                   // Seconds from the event pump to the end of the collector
+    int batches;                    // Draw calls
+    int switches;                   // Texture switches between draw calls
+    int texts;
+    int lua_kb;
+    int userdata;                   // Userdata created during the frame
+} FrameRecord;
+
+// Timings and counters of the last frames in a ring buffer, shown as an
+// overlay graph and saved as CSV. Frames the loop spends waiting while
+// paused are not recorded.
+typedef struct {
+    FrameRecord *frames;
+    int size;
+    int count;                      // Frames kept, up to size
+    int next;                       // Slot the next frame is recorded into
+    int total;                      // Frames recorded since the start
+
+    FrameRecord current;
+    double frame_start;
+    double phase_start;
+    Uint64 userdata_mark;
+
+    bool overlay;
+    Font *font;                     // Overlay text, no text without it
+    SDL_Rect *bars;                 // Overlay scratch, STATS_PHASES rects per frame
+    double *sorted;                 // Percentile scratch
+} FrameStats;
+
+
+void stats_init(FrameStats *stats, int frames, Font *font);
+
+void stats_free(FrameStats *stats);
+
+void stats_begin_frame(FrameStats *stats);
+
+void stats_begin(FrameStats *stats);
+
+// Adds the time since stats_begin to the phase, phases may run many times a frame
+void stats_end(FrameStats *stats, StatsPhase phase);
+
+// Records the frame with the counters of the last presented frame
+void stats_end_frame(FrameStats *stats, lua_State *L);
+
+void stats_draw_overlay(FrameStats *stats, SDL_Renderer *renderer);
+
+bool stats_save_csv(FrameStats *stats, const char *filename);
+
+// Prints the frame time percentiles and the phase averages
+void stats_report(FrameStats *stats);
+
+#endif // STATS_H
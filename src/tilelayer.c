@@ -0,0 +1,165 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "tilelayer.h"
+#include "assets.h"
+
+static UserdataType TileLayerType = {"TileLayer"};
+
+void tilelayer_update(TileLayer *layer, double dt) {
+    layer->offset += layer->speed * dt;
+
+    while (layer->offset >= layer->size) {
+        layer->offset -= layer->size;
+        layer->first_row = (layer->first_row + layer->rows - 1) % layer->rows;
+    }
+
+    while (layer->offset < 0) {
+        layer->offset += layer->size;
+        layer->first_row = (layer->first_row + 1) % layer->rows;
+    }
+}
+
+void tilelayer_draw(TileLayer *layer) {
+    Rect view = graphics_view_rect();
+
+    // The top row starts one tile above the layer so the wrap is never visible
+    double top = layer->y - layer->size + layer->offset;
+
+    for (int i = 0; i < layer->rows; i++) {
+        double y = top + i * layer->size;
+        if (y + layer->size <= view.y || y >= view.y + view.h)
+            continue;
+
+        int row = (layer->first_row + i) % layer->rows;
+        Sprite *tiles = &layer->tiles[row * layer->cols];
+
+        for (int col = 0; col < layer->cols; col++) {
+            double x = layer->x + col * layer->size;
+            if (x + layer->size <= view.x || x >= view.x + view.w)
+                continue;
+
+            Sprite *tile = &tiles[col];
+            if (tile->sprite_set == NULL)
+                continue;
+
+            graphics_draw_sprite_set(tile->sprite_set, vector_new(x, y), tile->col, tile->row,
+                                     tile->scale, tile->flip_h, tile->flip_v);
+        }
+    }
+}
+
+int api_tilelayer_new(lua_State *L) {
+    double x = luaL_checknumber(L, 1);
+    double y = luaL_checknumber(L, 2);
+    int cols = luaL_checkinteger(L, 3);
+    int rows = luaL_checkinteger(L, 4);
+    int size = luaL_checkinteger(L, 5);
+    double speed = luaL_optnumber(L, 6, 0);
+
+    luaL_argcheck(L, cols > 0, 3, "cols must be positive");
+    luaL_argcheck(L, rows > 0, 4, "rows must be positive");
+    luaL_argcheck(L, size > 0, 5, "size must be positive");
+
+    size_t tiles_size = sizeof(Sprite) * cols * rows;
+    TileLayer *layer = udata_new(L, sizeof(TileLayer) + tiles_size, &TileLayerType);
+    layer->x = x;
+    layer->y = y;
+    layer->cols = cols;
+    layer->rows = rows;
+    layer->size = size;
+    layer->speed = speed;
+    layer->offset = 0;
+    layer->first_row = 0;
+    memset(layer->tiles, 0, tiles_size);
+
+    // Sprite sets used by the tiles, kept alive as long as the layer
+    lua_newtable(L);
+    lua_setuservalue(L, -2);
+    return 1;
+}
+
+int api_tilelayer_set_tile(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    int col = luaL_checkinteger(L, 2);
+    int row = luaL_checkinteger(L, 3);
+    Sprite *sprite = udata_check(L, 4, &SpriteType);
+
+    luaL_argcheck(L, col >= 1 && col <= layer->cols, 2, "col out of range");
+    luaL_argcheck(L, row >= 1 && row <= layer->rows, 3, "row out of range");
+
+    layer->tiles[(row - 1) * layer->cols + (col - 1)] = *sprite;
+
+    lua_getuservalue(L, 1);
+    if (lua_getuservalue(L, 4) != LUA_TNIL) {
+        lua_pushboolean(L, 1);
+        lua_rawset(L, -3);
+    }
+    return 0;
+}
+
+int api_tilelayer_set_speed(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    layer->speed = luaL_checknumber(L, 2);
+    return 0;
+}
+
+int api_tilelayer_cols(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    lua_pushinteger(L, layer->cols);
+    return 1;
+}
+
+int api_tilelayer_rows(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    lua_pushinteger(L, layer->rows);
+    return 1;
+}
+
+int api_tilelayer_update(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    double dt = luaL_checknumber(L, 2);
+    tilelayer_update(layer, dt);
+    return 0;
+}
+
+int api_tilelayer_draw(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    tilelayer_draw(layer);
+    return 0;
+}
+
+int api_tilelayer_tostring(lua_State *L) {
+    TileLayer *layer = udata_check(L, 1, &TileLayerType);
+    lua_pushfstring(L, "TileLayer<cols: %d, rows: %d, size: %d>", layer->cols, layer->rows, layer->size);
+    return 1;
+}
+
+static const struct luaL_Reg tilelayer_methods[] = {
+        {"set_tile",   api_tilelayer_set_tile},
+        {"set_speed",  api_tilelayer_set_speed},
+        {"cols",       api_tilelayer_cols},
+        {"rows",       api_tilelayer_rows},
+        {"update",     api_tilelayer_update},
+        {"draw",       api_tilelayer_draw},
+        {"__tostring", api_tilelayer_tostring},
+        {NULL, NULL}
+};
+
+int module_tilelayer(lua_State *L) {
+    udata_register(L, &TileLayerType);
+    luaL_setfuncs(L, tilelayer_methods, 0);
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    int pos = lua_gettop(L);
+    lua_pushcfunction(L, api_tilelayer_new);
+    lua_setfield(L, pos, "new");
+    return 1;
+}
+
+void api_tilelayer_open(lua_State *L) {
+    luaL_requiref(L, "core.tilelayer", module_tilelayer, 0);
+    lua_pop(L, 1);
+}
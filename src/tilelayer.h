@@ -0,0 +1,30 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef TILELAYER_H
+#define TILELAYER_H
+
+#include "core.h"
+#include "graphics.h"
+
+// A grid of sprites scrolling vertically. Rows are kept in a ring so the row
+// leaving the screen is reused on the opposite side without moving any tile.
+typedef struct {
+    double x;
+    double y;
+    int cols;
+    int rows;
+    int size;
+    double speed;
+    double offset;      // Scroll inside the current row, always in [0, size)
+    int first_row;      // Ring index of the row drawn at the top
+    Sprite tiles[];     // cols * rows, row major
+} TileLayer;
+
+
+void tilelayer_update(TileLayer *layer, double dt);
+
+void tilelayer_draw(TileLayer *layer);
+
+void api_tilelayer_open(lua_State *L);
+
+#endif // TILELAYER_H
@@ -0,0 +1,570 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "tilemap.h"
+#include "assets.h"
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TILEMAP_MAGIC 0x50414D54 // "TMAP"
+#define TILEMAP_VERSION 1
+
+///////////////////////////////////////////////////////////////////////////////
+///// TMX
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    int width;
+    int height;
+    int tile_width;
+    int tile_height;
+    int layer_count;
+    Uint32 *tiles;
+} TmxMap;
+
+static Sint64 file_mtime(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return 0;
+    return (Sint64) st.st_mtime;
+}
+
+// Reads an integer attribute from the tag starting at `tag`
+static int xml_int_attr(const char *tag, const char *name, int def) {
+    const char *end = strchr(tag, '>');
+    size_t len = strlen(name);
+
+    for (const char *p = strstr(tag, name); p != NULL && (end == NULL || p < end); p = strstr(p + 1, name)) {
+        if (p[-1] == ' ' && p[len] == '=' && p[len + 1] == '"')
+            return atoi(p + len + 2);
+    }
+    return def;
+}
+
+static bool xml_has_attr_value(const char *tag, const char *text) {
+    const char *end = strchr(tag, '>');
+    const char *p = strstr(tag, text);
+    return p != NULL && (end == NULL || p < end);
+}
+
+static bool tmx_parse(const char *filename, TmxMap *tmx) {
+    size_t size = 0;
+    char *buffer = SDL_LoadFile(filename, &size);
+    if (buffer == NULL) {
+        printf("error on loading tilemap %s: %s\n", filename, SDL_GetError());
+        return false;
+    }
+
+    bool ok = false;
+    tmx->layer_count = 0;
+    tmx->tiles = NULL;
+
+    const char *map = strstr(buffer, "<map ");
+    if (map == NULL)
+        goto done;
+
+    tmx->width = xml_int_attr(map, "width", 0);
+    tmx->height = xml_int_attr(map, "height", 0);
+    tmx->tile_width = xml_int_attr(map, "tilewidth", 0);
+    tmx->tile_height = xml_int_attr(map, "tileheight", 0);
+
+    if (tmx->width <= 0 || tmx->height <= 0 || tmx->tile_width <= 0 || tmx->tile_height <= 0)
+        goto done;
+
+    // Only the first tileset is supported, its ids start at firstgid
+    const char *tileset = strstr(map, "<tileset ");
+    Uint32 first_gid = tileset != NULL ? xml_int_attr(tileset, "firstgid", 1) : 1;
+    size_t layer_size = (size_t) tmx->width * tmx->height;
+
+    for (const char *layer = strstr(map, "<layer "); layer != NULL; layer = strstr(layer + 1, "<layer ")) {
+        const char *data = strstr(layer, "<data");
+        if (data == NULL)
+            goto done;
+
+        if (!xml_has_attr_value(data, "encoding=\"csv\"")) {
+            printf("error on loading tilemap %s: only csv layers are supported\n", filename);
+            goto done;
+        }
+
+        tmx->tiles = realloc(tmx->tiles, sizeof(Uint32) * layer_size * (tmx->layer_count + 1));
+        Uint32 *tiles = &tmx->tiles[layer_size * tmx->layer_count];
+        tmx->layer_count++;
+
+        const char *p = strchr(data, '>') + 1;
+        for (size_t i = 0; i < layer_size; i++) {
+            char *next = NULL;
+            Uint32 gid = strtoul(p, &next, 10);
+            if (next == p)
+                goto done;
+
+            Uint32 id = gid & TILEMAP_ID_MASK;
+            Uint32 flags = gid & (TILEMAP_FLIP_H | TILEMAP_FLIP_V);
+            tiles[i] = id >= first_gid ? (id - first_gid + 1) | flags : 0;
+
+            p = next;
+            while (*p == ',' || *p == '\n' || *p == '\r' || *p == ' ')
+                p++;
+        }
+    }
+
+    ok = tmx->layer_count > 0;
+
+    done:
+    SDL_free(buffer);
+    if (!ok) {
+        printf("error on parsing tilemap %s\n", filename);
+        free(tmx->tiles);
+        tmx->tiles = NULL;
+    }
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// CACHE
+///////////////////////////////////////////////////////////////////////////////
+
+static bool tilemap_write_cache(const char *cache, TmxMap *tmx, Sint64 mtime) {
+    TilemapHeader header;
+    header.magic = TILEMAP_MAGIC;
+    header.version = TILEMAP_VERSION;
+    header.source_mtime = mtime;
+    header.width = tmx->width;
+    header.height = tmx->height;
+    header.tile_width = tmx->tile_width;
+    header.tile_height = tmx->tile_height;
+    header.chunk_size = TILEMAP_CHUNK_SIZE;
+    header.layer_count = tmx->layer_count;
+    header.chunks_x = (tmx->width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+    header.chunks_y = (tmx->height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+
+    int chunk_count = header.layer_count * header.chunks_x * header.chunks_y;
+    size_t layer_size = (size_t) tmx->width * tmx->height;
+    TilemapChunkInfo *infos = malloc(sizeof(TilemapChunkInfo) * chunk_count);
+    TilemapQuad *quads = malloc(sizeof(TilemapQuad) * layer_size * tmx->layer_count);
+    int quad_count = 0;
+
+    for (int layer = 0; layer < header.layer_count; layer++) {
+        const Uint32 *tiles = &tmx->tiles[layer_size * layer];
+
+        for (int cy = 0; cy < header.chunks_y; cy++) {
+            for (int cx = 0; cx < header.chunks_x; cx++) {
+                TilemapChunkInfo *info = &infos[(layer * header.chunks_y + cy) * header.chunks_x + cx];
+                info->first_quad = quad_count;
+
+                for (int y = cy * TILEMAP_CHUNK_SIZE; y < (cy + 1) * TILEMAP_CHUNK_SIZE && y < tmx->height; y++) {
+                    for (int x = cx * TILEMAP_CHUNK_SIZE; x < (cx + 1) * TILEMAP_CHUNK_SIZE && x < tmx->width; x++) {
+                        Uint32 tile = tiles[y * tmx->width + x];
+                        if (tile == 0)
+                            continue;
+
+                        TilemapQuad *quad = &quads[quad_count++];
+                        quad->x = x * tmx->tile_width;
+                        quad->y = y * tmx->tile_height;
+                        quad->tile = tile;
+                    }
+                }
+
+                info->quad_count = quad_count - info->first_quad;
+            }
+        }
+    }
+
+    FILE *file = fopen(cache, "wb");
+    bool ok = file != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(TilemapHeader), 1, file) == 1 &&
+             fwrite(tmx->tiles, sizeof(Uint32), layer_size * tmx->layer_count, file) == layer_size * tmx->layer_count &&
+             fwrite(infos, sizeof(TilemapChunkInfo), chunk_count, file) == (size_t) chunk_count &&
+             fwrite(quads, sizeof(TilemapQuad), quad_count, file) == (size_t) quad_count;
+        fclose(file);
+    }
+
+    if (!ok)
+        printf("error on writing tilemap cache %s\n", cache);
+
+    free(infos);
+    free(quads);
+    return ok;
+}
+
+static size_t tilemap_expected_size(const TilemapHeader *header, int quad_count) {
+    size_t layer_size = (size_t) header->width * header->height;
+    size_t chunk_count = (size_t) header->layer_count * header->chunks_x * header->chunks_y;
+    return sizeof(TilemapHeader) + sizeof(Uint32) * layer_size * header->layer_count +
+           sizeof(TilemapChunkInfo) * chunk_count + sizeof(TilemapQuad) * quad_count;
+}
+
+// Maps the cache and checks it still matches the source file
+static bool tilemap_map_cache(Tilemap *map, const char *cache, Sint64 mtime) {
+    int fd = open(cache, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(TilemapHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    const TilemapHeader *header = mapping;
+    bool valid = header->magic == TILEMAP_MAGIC && header->version == TILEMAP_VERSION &&
+                 (mtime == 0 || header->source_mtime == mtime) &&
+                 header->chunk_size == TILEMAP_CHUNK_SIZE && header->layer_count > 0 &&
+                 header->width > 0 && header->height > 0 &&
+                 header->chunks_x == (header->width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE &&
+                 header->chunks_y == (header->height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE &&
+                 (size_t) st.st_size >= tilemap_expected_size(header, 0);
+
+    if (!valid) {
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    map->header = header;
+    map->tiles = (const Uint32 *) (header + 1);
+    map->mapping = mapping;
+    map->mapping_size = st.st_size;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// GEOMETRY
+///////////////////////////////////////////////////////////////////////////////
+
+static void set_vertex(SDL_Vertex *v, float x, float y, float u, float t) {
+    SDL_Color white = {255, 255, 255, SDL_ALPHA_OPAQUE};
+    v->position.x = x;
+    v->position.y = y;
+    v->tex_coord.x = u;
+    v->tex_coord.y = t;
+    v->color = white;
+}
+
+static void tilemap_build_chunk(Tilemap *map, TilemapChunk *chunk, const TilemapQuad *quads, int count,
+                                SpriteSet *set) {
+    const TilemapHeader *header = map->header;
+    chunk->vertices = malloc(sizeof(SDL_Vertex) * 4 * count);
+    chunk->runs = NULL;
+    chunk->run_count = 0;
+    chunk->quad_count = 0;
+
+    // Quads are built in map order, then grouped by texture into runs
+    SDL_Vertex *staged = malloc(sizeof(SDL_Vertex) * 4 * count);
+    SDL_Texture **textures = malloc(sizeof(SDL_Texture *) * count);
+    int staged_count = 0;
+
+    double min_x = DBL_MAX, min_y = DBL_MAX, max_x = -DBL_MAX, max_y = -DBL_MAX;
+
+    for (int i = 0; i < count; i++) {
+        const TilemapQuad *quad = &quads[i];
+        int id = (int) (quad->tile & TILEMAP_ID_MASK) - 1;
+        bool flip_h = (quad->tile & TILEMAP_FLIP_H) != 0;
+        bool flip_v = (quad->tile & TILEMAP_FLIP_V) != 0;
+
+        SDL_Texture *texture;
+        SDL_Rect src;
+        int offset_x, offset_y;
+        if (!graphics_sprite_source(set, id % set->cols, id / set->cols, flip_h, flip_v,
+                                    &texture, &src, &offset_x, &offset_y))
+            continue;
+
+        float u0 = (float) src.x / set->w;
+        float v0 = (float) src.y / set->h;
+        float u1 = (float) (src.x + src.w) / set->w;
+        float v1 = (float) (src.y + src.h) / set->h;
+
+        if (flip_h) {
+            float tmp = u0;
+            u0 = u1;
+            u1 = tmp;
+        }
+
+        if (flip_v) {
+            float tmp = v0;
+            v0 = v1;
+            v1 = tmp;
+        }
+
+        float x0 = (quad->x + offset_x) * map->scale;
+        float y0 = (quad->y + offset_y) * map->scale;
+        float x1 = x0 + src.w * map->scale;
+        float y1 = y0 + src.h * map->scale;
+
+        SDL_Vertex *v = &staged[staged_count * 4];
+        set_vertex(&v[0], x0, y0, u0, v0);
+        set_vertex(&v[1], x1, y0, u1, v0);
+        set_vertex(&v[2], x1, y1, u1, v1);
+        set_vertex(&v[3], x0, y1, u0, v1);
+        textures[staged_count++] = texture;
+
+        if (quad->x < min_x) min_x = quad->x;
+        if (quad->y < min_y) min_y = quad->y;
+        if (quad->x + header->tile_width > max_x) max_x = quad->x + header->tile_width;
+        if (quad->y + header->tile_height > max_y) max_y = quad->y + header->tile_height;
+    }
+
+    // Tilesets spread over several atlas pages get one run per page. Tiles of
+    // one layer do not overlap, so the changed draw order is not visible.
+    for (int i = 0; i < staged_count; i++) {
+        if (textures[i] == NULL)
+            continue;
+
+        SDL_Texture *texture = textures[i];
+        chunk->runs = realloc(chunk->runs, sizeof(TilemapRun) * (chunk->run_count + 1));
+        TilemapRun *run = &chunk->runs[chunk->run_count++];
+        run->texture = texture;
+        run->first_quad = chunk->quad_count;
+        run->quad_count = 0;
+
+        for (int j = i; j < staged_count; j++) {
+            if (textures[j] != texture)
+                continue;
+            memcpy(&chunk->vertices[chunk->quad_count * 4], &staged[j * 4], sizeof(SDL_Vertex) * 4);
+            chunk->quad_count++;
+            run->quad_count++;
+            textures[j] = NULL;
+        }
+    }
+
+    free(staged);
+    free(textures);
+
+    if (chunk->quad_count > 0) {
+        chunk->bounds = rect_new(min_x * map->scale, min_y * map->scale,
+                                 (max_x - min_x) * map->scale, (max_y - min_y) * map->scale);
+    }
+}
+
+static const TilemapChunkInfo *tilemap_chunk_infos(const Tilemap *map) {
+    const TilemapHeader *header = map->header;
+    size_t layer_size = (size_t) header->width * header->height;
+    return (const TilemapChunkInfo *) (map->tiles + layer_size * header->layer_count);
+}
+
+// Every chunk must point to quads inside the mapping, the quads of all
+// chunks follow the chunk table
+static bool tilemap_check_chunks(const Tilemap *map) {
+    const TilemapHeader *header = map->header;
+    int chunk_count = header->layer_count * header->chunks_x * header->chunks_y;
+    const TilemapChunkInfo *infos = tilemap_chunk_infos(map);
+
+    Sint64 quad_total = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        if (infos[i].first_quad < 0 || infos[i].quad_count < 0)
+            return false;
+        quad_total += infos[i].quad_count;
+    }
+
+    if (quad_total > INT_MAX || map->mapping_size < tilemap_expected_size(header, (int) quad_total))
+        return false;
+
+    for (int i = 0; i < chunk_count; i++) {
+        if ((Sint64) infos[i].first_quad + infos[i].quad_count > quad_total)
+            return false;
+    }
+    return true;
+}
+
+bool tilemap_load(Tilemap *map, const char *filename, const char *cache, SpriteSet *set, double scale) {
+    map->chunks = NULL;
+    map->mapping = NULL;
+    map->scale = scale;
+
+    Sint64 mtime = file_mtime(filename);
+
+    bool mapped = tilemap_map_cache(map, cache, mtime);
+    if (mapped && !tilemap_check_chunks(map)) {
+        printf("tilemap: cache %s is corrupt, rebuilding it\n", cache);
+        tilemap_free(map);
+        mapped = false;
+    }
+
+    if (!mapped) {
+        TmxMap tmx;
+        if (!tmx_parse(filename, &tmx))
+            return false;
+
+        bool written = tilemap_write_cache(cache, &tmx, mtime);
+        free(tmx.tiles);
+
+        if (!written || !tilemap_map_cache(map, cache, mtime))
+            return false;
+
+        if (!tilemap_check_chunks(map)) {
+            printf("error on loading tilemap cache %s: truncated file\n", cache);
+            tilemap_free(map);
+            return false;
+        }
+    }
+
+    const TilemapHeader *header = map->header;
+    int chunk_count = header->layer_count * header->chunks_x * header->chunks_y;
+    const TilemapChunkInfo *infos = tilemap_chunk_infos(map);
+    const TilemapQuad *quads = (const TilemapQuad *) (infos + chunk_count);
+
+    map->chunks = calloc(chunk_count, sizeof(TilemapChunk));
+    for (int i = 0; i < chunk_count; i++)
+        tilemap_build_chunk(map, &map->chunks[i], &quads[infos[i].first_quad], infos[i].quad_count, set);
+
+    return true;
+}
+
+void tilemap_draw(Tilemap *map) {
+    const TilemapHeader *header = map->header;
+    Rect view = graphics_view_rect();
+
+    // Only the chunks under the view are visited
+    double chunk_w = header->chunk_size * header->tile_width * map->scale;
+    double chunk_h = header->chunk_size * header->tile_height * map->scale;
+    int first_x = SDL_max(0, (int) floor(view.x / chunk_w));
+    int first_y = SDL_max(0, (int) floor(view.y / chunk_h));
+    int last_x = SDL_min(header->chunks_x - 1, (int) floor((view.x + view.w) / chunk_w));
+    int last_y = SDL_min(header->chunks_y - 1, (int) floor((view.y + view.h) / chunk_h));
+
+    for (int layer = 0; layer < header->layer_count; layer++) {
+        for (int cy = first_y; cy <= last_y; cy++) {
+            for (int cx = first_x; cx <= last_x; cx++) {
+                TilemapChunk *chunk = &map->chunks[(layer * header->chunks_y + cy) * header->chunks_x + cx];
+                for (int r = 0; r < chunk->run_count; r++) {
+                    const TilemapRun *run = &chunk->runs[r];
+                    graphics_draw_quads(run->texture, &chunk->vertices[run->first_quad * 4], run->quad_count,
+                                        chunk->bounds);
+                }
+            }
+        }
+    }
+}
+
+void tilemap_free(Tilemap *map) {
+    if (map->chunks != NULL) {
+        int chunk_count = map->header->layer_count * map->header->chunks_x * map->header->chunks_y;
+        for (int i = 0; i < chunk_count; i++) {
+            free(map->chunks[i].vertices);
+            free(map->chunks[i].runs);
+        }
+        free(map->chunks);
+        map->chunks = NULL;
+    }
+
+    if (map->mapping != NULL) {
+        munmap(map->mapping, map->mapping_size);
+        map->mapping = NULL;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static UserdataType TilemapType = {"Tilemap"};
+
+int api_tilemap_load(lua_State *L) {
+    const char *filename = luaL_checkstring(L, 1);
+    SpriteSet *set = asset_check(L, 2, &SpriteSetType);
+    const char *cache = luaL_checkstring(L, 3);
+    double scale = luaL_optnumber(L, 4, 1);
+
+    Tilemap *map = udata_new(L, sizeof(Tilemap), &TilemapType);
+    map->chunks = NULL;
+    map->mapping = NULL;
+
+    // The map draws straight from the sprite set texture
+    lua_pushvalue(L, 2);
+    lua_setuservalue(L, -2);
+
+    if (!tilemap_load(map, filename, cache, set, scale))
+        return luaL_error(L, "could not load tilemap %s", filename);
+
+    return 1;
+}
+
+int api_tilemap_draw(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    tilemap_draw(map);
+    return 0;
+}
+
+int api_tilemap_width(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    lua_pushinteger(L, map->header->width);
+    return 1;
+}
+
+int api_tilemap_height(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    lua_pushinteger(L, map->header->height);
+    return 1;
+}
+
+int api_tilemap_size(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    lua_pushnumber(L, map->header->width * map->header->tile_width * map->scale);
+    lua_pushnumber(L, map->header->height * map->header->tile_height * map->scale);
+    return 2;
+}
+
+int api_tilemap_tile(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    int layer = luaL_checkinteger(L, 2);
+    int col = luaL_checkinteger(L, 3);
+    int row = luaL_checkinteger(L, 4);
+    const TilemapHeader *header = map->header;
+
+    if (layer < 1 || layer > header->layer_count || col < 1 || col > header->width ||
+        row < 1 || row > header->height) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    size_t layer_size = (size_t) header->width * header->height;
+    Uint32 tile = map->tiles[(layer - 1) * layer_size + (row - 1) * header->width + (col - 1)];
+    if (tile == 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, tile & TILEMAP_ID_MASK);
+    return 1;
+}
+
+int api_tilemap_gc(lua_State *L) {
+    Tilemap *map = udata_check(L, 1, &TilemapType);
+    tilemap_free(map);
+    return 0;
+}
+
+static const struct luaL_Reg tilemap_methods[] = {
+        {"draw",   api_tilemap_draw},
+        {"width",  api_tilemap_width},
+        {"height", api_tilemap_height},
+        {"size",   api_tilemap_size},
+        {"tile",   api_tilemap_tile},
+        {"__gc",   api_tilemap_gc},
+        {NULL, NULL}
+};
+
+int module_tilemap(lua_State *L) {
+    udata_register(L, &TilemapType);
+    luaL_setfuncs(L, tilemap_methods, 0);
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    int pos = lua_gettop(L);
+    lua_pushcfunction(L, api_tilemap_load);
+    lua_setfield(L, pos, "load");
+    return 1;
+}
+
+void api_tilemap_open(lua_State *L) {
+    luaL_requiref(L, "core.tilemap", module_tilemap, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,75 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "core.h"
+#include "graphics.h"
+
+#define TILEMAP_CHUNK_SIZE 16
+#define TILEMAP_FLIP_H 0x80000000u
+#define TILEMAP_FLIP_V 0x40000000u
+#define TILEMAP_ID_MASK 0x1FFFFFFFu
+
+// Layout of the binary cache, written once from the TMX file and memory
+// mapped afterwards. The header is followed by the tiles of every layer, the
+// chunk table and then the quads of every chunk.
+typedef struct {
+    Uint32 magic;
+    Uint32 version;
+    Sint64 source_mtime;
+    Sint32 width;
+    Sint32 height;
+    Sint32 tile_width;
+    Sint32 tile_height;
+    Sint32 chunk_size;
+    Sint32 layer_count;
+    Sint32 chunks_x;
+    Sint32 chunks_y;
+} TilemapHeader;
+
+typedef struct {
+    Sint32 first_quad;
+    Sint32 quad_count;
+} TilemapChunkInfo;
+
+typedef struct {
+    float x;            // Position in map pixels, before scaling
+    float y;
+    Uint32 tile;        // Tile id starting at 1 plus the flip flags
+} TilemapQuad;
+
+// Quads of a chunk sharing one atlas page, drawn in a single call
+typedef struct {
+    SDL_Texture *texture;
+    int first_quad;
+    int quad_count;
+} TilemapRun;
+
+typedef struct {
+    TilemapRun *runs;
+    int run_count;
+    SDL_Vertex *vertices;   // Grouped by run
+    int quad_count;
+    Rect bounds;
+} TilemapChunk;
+
+typedef struct {
+    const TilemapHeader *header;
+    const Uint32 *tiles;    // layer_count * height * width, 0 is an empty cell
+    TilemapChunk *chunks;   // layer_count * chunks_y * chunks_x
+    double scale;
+    void *mapping;
+    size_t mapping_size;
+} Tilemap;
+
+
+bool tilemap_load(Tilemap *map, const char *filename, const char *cache, SpriteSet *set, double scale);
+
+void tilemap_draw(Tilemap *map);
+
+void tilemap_free(Tilemap *map);
+
+void api_tilemap_open(lua_State *L);
+
+#endif // TILEMAP_H
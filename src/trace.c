@@ -0,0 +1,257 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "trace.h"
+
+SDL_atomic_t trace_enabled;
+
+static TraceBuffer buffers[TRACE_MAX_THREADS];
+static SDL_atomic_t buffer_count;
+static _Thread_local TraceBuffer *local_buffer;
+static _Thread_local bool local_missing;
+
+static Uint64 capture_start;
+static int capture_frames = TRACE_FRAMES;
+static int requested_frames;
+static int frames_left;
+static const char *output = TRACE_OUTPUT;
+
+static char *names[TRACE_MAX_NAMES];
+
+// The buffer of the calling thread, taken on its first event
+static TraceBuffer *trace_buffer() {
+    if (local_buffer != NULL || local_missing)
+        return local_buffer;
+
+    int slot = SDL_AtomicAdd(&buffer_count, 1);
+    if (slot >= TRACE_MAX_THREADS) {
+        local_missing = true;
+        return NULL;
+    }
+
+    local_buffer = &buffers[slot];
+    local_buffer->events = malloc(sizeof(TraceEvent) * TRACE_BUFFER_EVENTS);
+    return local_buffer;
+}
+
+void trace_record(const char *name, char phase) {
+    TraceBuffer *buffer = trace_buffer();
+    if (buffer == NULL)
+        return;
+
+    SDL_AtomicLock(&buffer->lock);
+    if (buffer->count == TRACE_BUFFER_EVENTS) {
+        buffer->dropped++;
+    } else {
+        TraceEvent *ev = &buffer->events[buffer->count++];
+        ev->name = name;
+        ev->time = SDL_GetPerformanceCounter();
+        ev->phase = phase;
+    }
+    SDL_AtomicUnlock(&buffer->lock);
+}
+
+void trace_thread_name(const char *name) {
+    TraceBuffer *buffer = trace_buffer();
+    if (buffer != NULL)
+        buffer->thread_name = name;
+}
+
+void trace_configure(int frames, const char *file) {
+    if (frames > 0)
+        capture_frames = frames;
+    if (file != NULL)
+        output = file;
+}
+
+void trace_capture(int frames) {
+    if (SDL_AtomicGet(&trace_enabled) || requested_frames > 0)
+        return;
+    requested_frames = frames > 0 ? frames : capture_frames;
+}
+
+bool trace_capturing() {
+    return SDL_AtomicGet(&trace_enabled) || requested_frames > 0;
+}
+
+void trace_stop() {
+    requested_frames = 0;
+    if (!SDL_AtomicGet(&trace_enabled))
+        return;
+    SDL_AtomicSet(&trace_enabled, 0);
+    trace_save(output);
+}
+
+void trace_frame_begin() {
+    if (requested_frames > 0) {
+        // A thread that saw the last capture enabled may still be recording
+        int count = SDL_AtomicGet(&buffer_count);
+        for (int i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+            SDL_AtomicLock(&buffers[i].lock);
+            buffers[i].count = 0;
+            buffers[i].dropped = 0;
+            SDL_AtomicUnlock(&buffers[i].lock);
+        }
+
+        frames_left = requested_frames;
+        requested_frames = 0;
+        capture_start = SDL_GetPerformanceCounter();
+        SDL_AtomicSet(&trace_enabled, 1);
+        printf("trace: capturing %d frames\n", frames_left);
+    }
+    trace_begin("frame");
+}
+
+void trace_frame_end() {
+    trace_end();
+    if (SDL_AtomicGet(&trace_enabled) && --frames_left == 0)
+        trace_stop();
+}
+
+const char *trace_intern(const char *name) {
+    Uint32 hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *) name; *c != '\0'; c++)
+        hash = (hash ^ *c) * 16777619u;
+
+    for (int probe = 0; probe < TRACE_MAX_NAMES; probe++) {
+        char **slot = &names[(hash + probe) & (TRACE_MAX_NAMES - 1)];
+        if (*slot == NULL)
+            *slot = strdup(name);
+        if (strcmp(*slot, name) == 0)
+            return *slot;
+    }
+    return "(too many names)";
+}
+
+static void write_string(FILE *file, const char *s) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *) s; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+bool trace_save(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("trace: could not create %s\n", filename);
+        return false;
+    }
+
+    double to_us = 1000000.0 / (double) SDL_GetPerformanceFrequency();
+    int threads = SDL_AtomicGet(&buffer_count);
+    if (threads > TRACE_MAX_THREADS)
+        threads = TRACE_MAX_THREADS;
+    int events = 0;
+    int dropped = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int t = 0; t < threads; t++) {
+        TraceBuffer *buffer = &buffers[t];
+        // Events below the count do not change until the next capture resets it
+        SDL_AtomicLock(&buffer->lock);
+        int count = buffer->count;
+        int buffer_dropped = buffer->dropped;
+        SDL_AtomicUnlock(&buffer->lock);
+
+        if (buffer->thread_name != NULL) {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",", t + 1);
+            write_string(file, buffer->thread_name);
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            const TraceEvent *ev = &buffer->events[i];
+            fprintf(file, "%s\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", first ? "" : ",", ev->phase, t + 1,
+                    (double) (ev->time - capture_start) * to_us);
+            if (ev->name != NULL) {
+                fprintf(file, ",\"name\":");
+                write_string(file, ev->name);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+        events += count;
+        dropped += buffer_dropped;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        printf("trace: could not write %s\n", filename);
+        return false;
+    }
+
+    printf("trace: %d events from %d threads written to %s", events, threads, filename);
+    if (dropped > 0)
+        printf(", %d dropped past %d per thread", dropped, TRACE_BUFFER_EVENTS);
+    printf("\n");
+    return true;
+}
+
+static int api_trace_begin(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    if (SDL_AtomicGet(&trace_enabled))
+        trace_record(trace_intern(name), 'B');
+    return 0;
+}
+
+static int api_trace_end(lua_State *L) {
+    trace_end();
+    return 0;
+}
+
+// scope(name, fn, ...) calls fn inside a zone and returns what it returns
+static int api_trace_scope(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    bool traced = SDL_AtomicGet(&trace_enabled);
+    if (traced)
+        trace_record(trace_intern(name), 'B');
+
+    // The zone is closed even when fn fails
+    int status = lua_pcall(L, lua_gettop(L) - 2, LUA_MULTRET, 0);
+    if (traced)
+        trace_record(NULL, 'E');
+    if (status != LUA_OK)
+        return lua_error(L);
+    return lua_gettop(L) - 1;
+}
+
+static int api_trace_capture(lua_State *L) {
+    trace_capture((int) luaL_optinteger(L, 1, 0));
+    return 0;
+}
+
+static int api_trace_capturing(lua_State *L) {
+    lua_pushboolean(L, trace_capturing());
+    return 1;
+}
+
+static const struct luaL_Reg trace_funcs[] = {
+        {"begin",     api_trace_begin},
+        {"end",       api_trace_end},
+        {"finish",    api_trace_end},   // Same as end, which is a keyword in Trace.end()
+        {"scope",     api_trace_scope},
+        {"capture",   api_trace_capture},
+        {"capturing", api_trace_capturing},
+        {NULL, NULL}
+};
+
+int module_trace(lua_State *L) {
+    lua_newtable(L);
+    luaL_setfuncs(L, trace_funcs, 0);
+    return 1;
+}
+
+void api_trace_open(lua_State *L) {
+    luaL_requiref(L, "core.trace", module_trace, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,75 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "core.h"
+
+#define TRACE_MAX_THREADS 16
+#define TRACE_BUFFER_EVENTS 65536   // Events kept per thread in one capture
+#define TRACE_MAX_NAMES 1024        // Distinct zone names from scripts, a power of two
+#define TRACE_FRAMES 120            // Default frames captured
+#define TRACE_OUTPUT "trace.json"
+
+typedef struct {
+    const char *name;       // Literals, or names interned by trace_intern
+    Uint64 time;
+    char phase;             // 'B' or 'E'
+} TraceEvent;
+
+// Written by its thread under the lock, which the main thread takes to reset
+// or save the buffer. Only the main thread and the owner ever touch it, the
+// lock is free in all but a race with a capture starting or ending.
+typedef struct {
+    const char *thread_name;
+    TraceEvent *events;
+    int count;
+    int dropped;
+    SDL_SpinLock lock;
+} TraceBuffer;
+
+// Set by the main thread while capturing and read by every recording
+// thread, recording is one atomic load and a branch otherwise
+extern SDL_atomic_t trace_enabled;
+
+void trace_record(const char *name, char phase);
+
+static inline void trace_begin(const char *name) {
+    if (SDL_AtomicGet(&trace_enabled))
+        trace_record(name, 'B');
+}
+
+static inline void trace_end() {
+    if (SDL_AtomicGet(&trace_enabled))
+        trace_record(NULL, 'E');
+}
+
+// Names the calling thread in the trace
+void trace_thread_name(const char *name);
+
+void trace_configure(int frames, const char *output);
+
+// Captures the next frames, from the next trace_frame_begin
+void trace_capture(int frames);
+
+bool trace_capturing();
+
+// Ends a capture early and writes it
+void trace_stop();
+
+void trace_frame_begin();
+
+// Writes the trace once the captured frames are done
+void trace_frame_end();
+
+// Copy of name that lives as long as the program, for names from scripts.
+// Only called from the main thread.
+const char *trace_intern(const char *name);
+
+// Writes the events recorded so far as Chrome trace event JSON
+bool trace_save(const char *filename);
+
+// core.trace: begin(name), end(), scope(name, fn, ...), capture([frames])
+void api_trace_open(lua_State *L);
+
+#endif // TRACE_H
@@ -0,0 +1,31 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "udata.h"
+
+Uint64 udata_allocations = 0;
+
+void udata_register(lua_State *L, UserdataType *type) {
+    luaL_newmetatable(L, type->name);
+    type->metatable = lua_topointer(L, -1);
+    lua_pushvalue(L, -1);
+    type->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+void *udata_new(lua_State *L, size_t size, const UserdataType *type) {
+    udata_allocations++;
+    void *p = lua_newuserdata(L, size);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, type->ref);
+    lua_setmetatable(L, -2);
+    return p;
+}
+
+// Same message luaL_checkudata gives
+void *udata_type_error(lua_State *L, int idx, const UserdataType *type) {
+    const char *actual;
+    if (luaL_getmetafield(L, idx, "__name") == LUA_TSTRING)
+        actual = lua_tostring(L, -1);
+    else
+        actual = luaL_typename(L, idx);
+    luaL_argerror(L, idx, lua_pushfstring(L, "%s expected, got %s", type->name, actual));
+    return NULL;
+}
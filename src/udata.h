@@ -0,0 +1,44 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef UDATA_H
+#define UDATA_H
+
+#include "core.h"
+
+// A userdata type whose metatable is looked up once, when it is registered.
+// Afterwards it is pushed from the registry array by reference and checked by
+// comparing pointers, instead of the lookups by name luaL_checkudata does on
+// every call. There is one engine lua_State, registering again replaces it.
+typedef struct {
+    const char *name;
+    int ref;
+    const void *metatable;
+} UserdataType;
+
+// Userdata created by udata_new so far, for the frame counters
+extern Uint64 udata_allocations;
+
+// Creates the metatable, also reachable by name, and leaves it on the stack
+void udata_register(lua_State *L, UserdataType *type);
+
+// Pushes a new userdata with the type metatable set
+void *udata_new(lua_State *L, size_t size, const UserdataType *type);
+
+// The userdata at idx, or NULL when it is not of this type
+static inline void *udata_test(lua_State *L, int idx, const UserdataType *type) {
+    void *p = lua_touserdata(L, idx);
+    if (p == NULL || !lua_getmetatable(L, idx))
+        return NULL;
+    const void *metatable = lua_topointer(L, -1);
+    lua_pop(L, 1);
+    return metatable == type->metatable ? p : NULL;
+}
+
+void *udata_type_error(lua_State *L, int idx, const UserdataType *type);
+
+static inline void *udata_check(lua_State *L, int idx, const UserdataType *type) {
+    void *p = udata_test(L, idx, type);
+    return p != NULL ? p : udata_type_error(L, idx, type);
+}
+
+#endif // UDATA_H
@@ -0,0 +1,459 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#include "vecarray.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VECARRAY_X86
+#include <immintrin.h>
+#endif
+
+static const VecArrayKernels *kernels = NULL;
+
+bool vecarray_init(VecArray *array, int count) {
+    // Padding lets the kernels run whole registers over the last vectors
+    size_t padded = ((size_t) count + VECARRAY_LANES - 1) / VECARRAY_LANES * VECARRAY_LANES;
+    size_t bytes = sizeof(float) * (padded > 0 ? padded : VECARRAY_LANES);
+
+    array->count = count;
+    array->x = SDL_SIMDAlloc(bytes);
+    array->y = SDL_SIMDAlloc(bytes);
+    if (array->x == NULL || array->y == NULL) {
+        vecarray_release(array);
+        return false;
+    }
+
+    memset(array->x, 0, bytes);
+    memset(array->y, 0, bytes);
+    return true;
+}
+
+void vecarray_release(VecArray *array) {
+    SDL_SIMDFree(array->x);
+    SDL_SIMDFree(array->y);
+    array->x = NULL;
+    array->y = NULL;
+    array->count = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// SCALAR KERNELS
+///////////////////////////////////////////////////////////////////////////////
+
+static void scalar_add(float *x, float *y, int n, float dx, float dy) {
+    for (int i = 0; i < n; i++) {
+        x[i] += dx;
+        y[i] += dy;
+    }
+}
+
+static void scalar_add_array(float *x, float *y, const float *ox, const float *oy, int n) {
+    for (int i = 0; i < n; i++) {
+        x[i] += ox[i];
+        y[i] += oy[i];
+    }
+}
+
+static void scalar_scale(float *x, float *y, int n, float s) {
+    for (int i = 0; i < n; i++) {
+        x[i] *= s;
+        y[i] *= s;
+    }
+}
+
+static void scalar_lerp(float *x, float *y, const float *tx, const float *ty, int n, float t) {
+    for (int i = 0; i < n; i++) {
+        x[i] += (tx[i] - x[i]) * t;
+        y[i] += (ty[i] - y[i]) * t;
+    }
+}
+
+static void scalar_clamp(float *x, float *y, int n, float min_x, float min_y, float max_x, float max_y) {
+    for (int i = 0; i < n; i++) {
+        x[i] = fminf(fmaxf(x[i], min_x), max_x);
+        y[i] = fminf(fmaxf(y[i], min_y), max_y);
+    }
+}
+
+static void scalar_distance(const float *x, const float *y, int n, float px, float py, float *out) {
+    for (int i = 0; i < n; i++) {
+        float dx = x[i] - px;
+        float dy = y[i] - py;
+        out[i] = sqrtf(dx * dx + dy * dy);
+    }
+}
+
+static const VecArrayKernels scalar_kernels = {
+        "scalar", scalar_add, scalar_add_array, scalar_scale, scalar_lerp, scalar_clamp, scalar_distance
+};
+
+#ifdef VECARRAY_X86
+
+///////////////////////////////////////////////////////////////////////////////
+///// SSE2 KERNELS
+///////////////////////////////////////////////////////////////////////////////
+// Buffers are padded to VECARRAY_LANES, so n is rounded up and every loop
+// runs whole registers. Padding lanes hold garbage that is never read back.
+
+#define SSE_COUNT(n) (((n) + 3) & ~3)
+
+__attribute__((target("sse2")))
+static void sse2_add(float *x, float *y, int n, float dx, float dy) {
+    __m128 vdx = _mm_set1_ps(dx);
+    __m128 vdy = _mm_set1_ps(dy);
+    for (int i = 0; i < SSE_COUNT(n); i += 4) {
+        _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), vdx));
+        _mm_store_ps(y + i, _mm_add_ps(_mm_load_ps(y + i), vdy));
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_add_array(float *x, float *y, const float *ox, const float *oy, int n) {
+    for (int i = 0; i < SSE_COUNT(n); i += 4) {
+        _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), _mm_load_ps(ox + i)));
+        _mm_store_ps(y + i, _mm_add_ps(_mm_load_ps(y + i), _mm_load_ps(oy + i)));
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_scale(float *x, float *y, int n, float s) {
+    __m128 vs = _mm_set1_ps(s);
+    for (int i = 0; i < SSE_COUNT(n); i += 4) {
+        _mm_store_ps(x + i, _mm_mul_ps(_mm_load_ps(x + i), vs));
+        _mm_store_ps(y + i, _mm_mul_ps(_mm_load_ps(y + i), vs));
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_lerp(float *x, float *y, const float *tx, const float *ty, int n, float t) {
+    __m128 vt = _mm_set1_ps(t);
+    for (int i = 0; i < SSE_COUNT(n); i += 4) {
+        __m128 vx = _mm_load_ps(x + i);
+        __m128 vy = _mm_load_ps(y + i);
+        vx = _mm_add_ps(vx, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(tx + i), vx), vt));
+        vy = _mm_add_ps(vy, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(ty + i), vy), vt));
+        _mm_store_ps(x + i, vx);
+        _mm_store_ps(y + i, vy);
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_clamp(float *x, float *y, int n, float min_x, float min_y, float max_x, float max_y) {
+    __m128 vmin_x = _mm_set1_ps(min_x);
+    __m128 vmin_y = _mm_set1_ps(min_y);
+    __m128 vmax_x = _mm_set1_ps(max_x);
+    __m128 vmax_y = _mm_set1_ps(max_y);
+    for (int i = 0; i < SSE_COUNT(n); i += 4) {
+        _mm_store_ps(x + i, _mm_min_ps(_mm_max_ps(_mm_load_ps(x + i), vmin_x), vmax_x));
+        _mm_store_ps(y + i, _mm_min_ps(_mm_max_ps(_mm_load_ps(y + i), vmin_y), vmax_y));
+    }
+}
+
+// out is not padded, the last partial register is done in scalar code
+__attribute__((target("sse2")))
+static void sse2_distance(const float *x, const float *y, int n, float px, float py, float *out) {
+    __m128 vpx = _mm_set1_ps(px);
+    __m128 vpy = _mm_set1_ps(py);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 dx = _mm_sub_ps(_mm_load_ps(x + i), vpx);
+        __m128 dy = _mm_sub_ps(_mm_load_ps(y + i), vpy);
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+    }
+    scalar_distance(x + i, y + i, n - i, px, py, out + i);
+}
+
+static const VecArrayKernels sse2_kernels = {
+        "sse2", sse2_add, sse2_add_array, sse2_scale, sse2_lerp, sse2_clamp, sse2_distance
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///// AVX2 KERNELS
+///////////////////////////////////////////////////////////////////////////////
+
+#define AVX_COUNT(n) (((n) + 7) & ~7)
+
+__attribute__((target("avx2")))
+static void avx2_add(float *x, float *y, int n, float dx, float dy) {
+    __m256 vdx = _mm256_set1_ps(dx);
+    __m256 vdy = _mm256_set1_ps(dy);
+    for (int i = 0; i < AVX_COUNT(n); i += 8) {
+        _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), vdx));
+        _mm256_store_ps(y + i, _mm256_add_ps(_mm256_load_ps(y + i), vdy));
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_add_array(float *x, float *y, const float *ox, const float *oy, int n) {
+    for (int i = 0; i < AVX_COUNT(n); i += 8) {
+        _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), _mm256_load_ps(ox + i)));
+        _mm256_store_ps(y + i, _mm256_add_ps(_mm256_load_ps(y + i), _mm256_load_ps(oy + i)));
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_scale(float *x, float *y, int n, float s) {
+    __m256 vs = _mm256_set1_ps(s);
+    for (int i = 0; i < AVX_COUNT(n); i += 8) {
+        _mm256_store_ps(x + i, _mm256_mul_ps(_mm256_load_ps(x + i), vs));
+        _mm256_store_ps(y + i, _mm256_mul_ps(_mm256_load_ps(y + i), vs));
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_lerp(float *x, float *y, const float *tx, const float *ty, int n, float t) {
+    __m256 vt = _mm256_set1_ps(t);
+    for (int i = 0; i < AVX_COUNT(n); i += 8) {
+        __m256 vx = _mm256_load_ps(x + i);
+        __m256 vy = _mm256_load_ps(y + i);
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(tx + i), vx), vt));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(ty + i), vy), vt));
+        _mm256_store_ps(x + i, vx);
+        _mm256_store_ps(y + i, vy);
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_clamp(float *x, float *y, int n, float min_x, float min_y, float max_x, float max_y) {
+    __m256 vmin_x = _mm256_set1_ps(min_x);
+    __m256 vmin_y = _mm256_set1_ps(min_y);
+    __m256 vmax_x = _mm256_set1_ps(max_x);
+    __m256 vmax_y = _mm256_set1_ps(max_y);
+    for (int i = 0; i < AVX_COUNT(n); i += 8) {
+        _mm256_store_ps(x + i, _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(x + i), vmin_x), vmax_x));
+        _mm256_store_ps(y + i, _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(y + i), vmin_y), vmax_y));
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_distance(const float *x, const float *y, int n, float px, float py, float *out) {
+    __m256 vpx = _mm256_set1_ps(px);
+    __m256 vpy = _mm256_set1_ps(py);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_load_ps(x + i), vpx);
+        __m256 dy = _mm256_sub_ps(_mm256_load_ps(y + i), vpy);
+        _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy))));
+    }
+    scalar_distance(x + i, y + i, n - i, px, py, out + i);
+}
+
+static const VecArrayKernels avx2_kernels = {
+        "avx2", avx2_add, avx2_add_array, avx2_scale, avx2_lerp, avx2_clamp, avx2_distance
+};
+
+#endif // VECARRAY_X86
+
+const VecArrayKernels *vecarray_kernels(VecArrayBackend backend) {
+    switch (backend) {
+        case VECARRAY_SCALAR:
+            return &scalar_kernels;
+#ifdef VECARRAY_X86
+        case VECARRAY_SSE2:
+            return SDL_HasSSE2() ? &sse2_kernels : NULL;
+        case VECARRAY_AVX2:
+            return SDL_HasAVX2() ? &avx2_kernels : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+const VecArrayKernels *vecarray_best_kernels() {
+    for (int backend = VECARRAY_BACKENDS - 1; backend >= 0; backend--) {
+        const VecArrayKernels *k = vecarray_kernels(backend);
+        if (k != NULL)
+            return k;
+    }
+    return &scalar_kernels;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///// LUA API
+///////////////////////////////////////////////////////////////////////////////
+
+static UserdataType VecArrayType = {"VecArray"};
+
+static VecArray *check_vecarray(lua_State *L, int idx) {
+    VecArray *array = udata_check(L, idx, &VecArrayType);
+    if (array->x == NULL)
+        luaL_argerror(L, idx, "released VecArray");
+    return array;
+}
+
+int api_vecarray_new(lua_State *L) {
+    lua_Integer count = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, count >= 0 && count <= SDL_MAX_SINT32 / 2, 1, "invalid size");
+
+    VecArray *array = udata_new(L, sizeof(VecArray), &VecArrayType);
+    array->x = NULL;
+    array->y = NULL;
+
+    if (!vecarray_init(array, (int) count))
+        return luaL_error(L, "vecarray: out of memory");
+    return 1;
+}
+
+int api_vecarray_gc(lua_State *L) {
+    VecArray *array = udata_check(L, 1, &VecArrayType);
+    vecarray_release(array);
+    return 0;
+}
+
+int api_vecarray_size(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    lua_pushinteger(L, array->count);
+    return 1;
+}
+
+static int check_index(lua_State *L, VecArray *array, int idx) {
+    lua_Integer i = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, i >= 1 && i <= array->count, idx, "index out of range");
+    return (int) i - 1;
+}
+
+// a:get(i) returns x, y of the vector at 1-based index i
+int api_vecarray_get(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    int i = check_index(L, array, 2);
+    lua_pushnumber(L, array->x[i]);
+    lua_pushnumber(L, array->y[i]);
+    return 2;
+}
+
+int api_vecarray_set(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    int i = check_index(L, array, 2);
+    array->x[i] = (float) luaL_checknumber(L, 3);
+    array->y[i] = (float) luaL_checknumber(L, 4);
+    return 0;
+}
+
+// a:add(dx, dy) or a:add(other)
+int api_vecarray_add(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        VecArray *other = check_vecarray(L, 2);
+        luaL_argcheck(L, other->count == array->count, 2, "size mismatch");
+        kernels->add_array(array->x, array->y, other->x, other->y, array->count);
+    } else {
+        float dx = (float) luaL_checknumber(L, 2);
+        float dy = (float) luaL_optnumber(L, 3, dx);
+        kernels->add(array->x, array->y, array->count, dx, dy);
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+int api_vecarray_scale(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    kernels->scale(array->x, array->y, array->count, (float) luaL_checknumber(L, 2));
+    lua_settop(L, 1);
+    return 1;
+}
+
+// a:lerp(target, t) moves every vector a fraction t toward the same index in target
+int api_vecarray_lerp(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    VecArray *target = check_vecarray(L, 2);
+    luaL_argcheck(L, target->count == array->count, 2, "size mismatch");
+    kernels->lerp(array->x, array->y, target->x, target->y, array->count, (float) luaL_checknumber(L, 3));
+    lua_settop(L, 1);
+    return 1;
+}
+
+// a:clamp(rect) or a:clamp(min_x, min_y, max_x, max_y)
+int api_vecarray_clamp(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    float min_x, min_y, max_x, max_y;
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        Rect *r = check_rect(L, 2);
+        min_x = (float) r->x;
+        min_y = (float) r->y;
+        max_x = (float) (r->x + r->w);
+        max_y = (float) (r->y + r->h);
+    } else {
+        min_x = (float) luaL_checknumber(L, 2);
+        min_y = (float) luaL_checknumber(L, 3);
+        max_x = (float) luaL_checknumber(L, 4);
+        max_y = (float) luaL_checknumber(L, 5);
+    }
+    kernels->clamp(array->x, array->y, array->count, min_x, min_y, max_x, max_y);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// a:distance(px, py, out) writes the distance of every vector to the point
+// in the x components of out, which must have the same size
+int api_vecarray_distance(lua_State *L) {
+    VecArray *array = check_vecarray(L, 1);
+    float px = (float) luaL_checknumber(L, 2);
+    float py = (float) luaL_checknumber(L, 3);
+    VecArray *out = check_vecarray(L, 4);
+    luaL_argcheck(L, out->count == array->count, 4, "size mismatch");
+    kernels->distance(array->x, array->y, array->count, px, py, out->x);
+    lua_settop(L, 4);
+    return 1;
+}
+
+int api_vecarray_tostring(lua_State *L) {
+    VecArray *array = udata_check(L, 1, &VecArrayType);
+    lua_pushfstring(L, "VecArray<size: %d>", array->count);
+    return 1;
+}
+
+static const char *const backend_names[] = {"scalar", "sse2", "avx2", NULL};
+
+// VecArray.backend() returns the kernels in use, VecArray.backend(name)
+// switches to them and returns false when the CPU does not support them
+int api_vecarray_backend(lua_State *L) {
+    if (lua_gettop(L) == 0) {
+        lua_pushstring(L, kernels->name);
+        return 1;
+    }
+
+    const VecArrayKernels *k = vecarray_kernels(luaL_checkoption(L, 1, NULL, backend_names));
+    if (k != NULL)
+        kernels = k;
+    lua_pushboolean(L, k != NULL);
+    return 1;
+}
+
+static const struct luaL_Reg vecarray_methods[] = {
+        {"size",       api_vecarray_size},
+        {"get",        api_vecarray_get},
+        {"set",        api_vecarray_set},
+        {"add",        api_vecarray_add},
+        {"scale",      api_vecarray_scale},
+        {"lerp",       api_vecarray_lerp},
+        {"clamp",      api_vecarray_clamp},
+        {"distance",   api_vecarray_distance},
+        {"__len",      api_vecarray_size},
+        {"__gc",       api_vecarray_gc},
+        {"__tostring", api_vecarray_tostring},
+        {NULL, NULL}
+};
+
+static const struct luaL_Reg vecarray_funcs[] = {
+        {"new",     api_vecarray_new},
+        {"backend", api_vecarray_backend},
+        {NULL, NULL}
+};
+
+int module_vecarray(lua_State *L) {
+    udata_register(L, &VecArrayType);
+    luaL_setfuncs(L, vecarray_methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    lua_newtable(L);
+    luaL_setfuncs(L, vecarray_funcs, 0);
+    return 1;
+}
+
+void api_vecarray_open(lua_State *L) {
+    if (kernels == NULL)
+        kernels = vecarray_best_kernels();
+
+    luaL_requiref(L, "core.vecarray", module_vecarray, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,49 @@
+// Copyright 2023 Lucas Klassmann
+// License: Apache License 2.0
+#ifndef VECARRAY_H
+#define VECARRAY_H
+
+#include "core.h"
+#include "game_math.h"
+
+// Buffers come from SDL_SIMDAlloc, aligned for the widest registers the CPU
+// has, and are padded to whole AVX registers
+#define VECARRAY_LANES 8
+
+// N 2D vectors as structure of arrays, so the kernels below work on whole
+// registers of x and y. Components are floats, twice the lanes of doubles.
+typedef struct {
+    int count;
+    float *x;
+    float *y;
+} VecArray;
+
+// One implementation of every bulk operation, picked at startup
+typedef struct {
+    const char *name;
+    void (*add)(float *x, float *y, int n, float dx, float dy);
+    void (*add_array)(float *x, float *y, const float *ox, const float *oy, int n);
+    void (*scale)(float *x, float *y, int n, float s);
+    void (*lerp)(float *x, float *y, const float *tx, const float *ty, int n, float t);
+    void (*clamp)(float *x, float *y, int n, float min_x, float min_y, float max_x, float max_y);
+    void (*distance)(const float *x, const float *y, int n, float px, float py, float *out);
+} VecArrayKernels;
+
+typedef enum {
+    VECARRAY_SCALAR, VECARRAY_SSE2, VECARRAY_AVX2, VECARRAY_BACKENDS
+} VecArrayBackend;
+
+
+// Allocates zeroed buffers for count vectors
+bool vecarray_init(VecArray *array, int count);
+
+void vecarray_release(VecArray *array);
+
+// NULL when the backend is not supported by the CPU or the build
+const VecArrayKernels *vecarray_kernels(VecArrayBackend backend);
+
+const VecArrayKernels *vecarray_best_kernels();
+
+void api_vecarray_open(lua_State *L);
+
+#endif // VECARRAY_H